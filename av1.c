@@ -0,0 +1,107 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "av1.h"
+#include "bitreader.h"
+#include "hdr10plus.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define OBU_METADATA 5
+
+#define METADATA_TYPE_HDR_CLL 1
+#define METADATA_TYPE_HDR_MDCV 2
+#define METADATA_TYPE_ITUT_T35 4
+
+/* reads an leb128 value, returns the amount of bytes consumed or 0 if the
+ * value is truncated or too large */
+static size_t read_leb128(const uint8_t *buf, size_t size, uint64_t *val) {
+    *val = 0;
+    for (size_t i = 0; i < 8 && i < size; i++) {
+        *val |= (uint64_t)(buf[i] & 0x7f) << (i * 7);
+        if (!(buf[i] & 0x80))
+            return i + 1;
+    }
+    return 0;
+}
+
+static void parse_mdcv(const uint8_t *buf, size_t size, av1_metadata *md) {
+    bitreader br;
+    br_init(&br, buf, size);
+    av1_mdcv mdcv;
+    for (int i = 0; i < 3; i++) {
+        mdcv.primaries[i][0] = br_read(&br, 16);
+        mdcv.primaries[i][1] = br_read(&br, 16);
+    }
+    mdcv.white_point[0] = br_read(&br, 16);
+    mdcv.white_point[1] = br_read(&br, 16);
+    mdcv.max_luminance = br_read(&br, 32);
+    mdcv.min_luminance = br_read(&br, 32);
+    if (br.overrun)
+        return;
+    md->mdcv = mdcv;
+    md->has_mdcv = true;
+}
+
+static void parse_cll(const uint8_t *buf, size_t size, av1_metadata *md) {
+    if (size < 4)
+        return;
+    md->max_cll = (buf[0] << 8) | buf[1];
+    md->max_fall = (buf[2] << 8) | buf[3];
+    md->has_cll = true;
+}
+
+static void parse_metadata(const uint8_t *buf, size_t size, av1_metadata *md) {
+    uint64_t type;
+    size_t len = read_leb128(buf, size, &type);
+    if (len == 0)
+        return;
+    buf += len;
+    size -= len;
+    switch (type) {
+    case METADATA_TYPE_HDR_CLL:
+        parse_cll(buf, size, md);
+        break;
+    case METADATA_TYPE_HDR_MDCV:
+        parse_mdcv(buf, size, md);
+        break;
+    case METADATA_TYPE_ITUT_T35:
+        if (hdr10plus_parse_t35(buf, size, &md->hdr10plus) == 0)
+            md->has_hdr10plus = true;
+        break;
+    }
+}
+
+int av1_parse_obus(const uint8_t *buf, size_t size, av1_metadata *md) {
+    size_t pos = 0;
+    while (pos < size) {
+        uint8_t header = buf[pos];
+        if (header & 0x80)
+            return -1; /* forbidden bit */
+        int type = (header >> 3) & 0x0f;
+        bool has_extension = header & 0x04;
+        bool has_size = header & 0x02;
+        size_t hlen = has_extension ? 2 : 1;
+        if (pos + hlen > size)
+            return -1;
+        uint64_t obu_size = size - pos - hlen;
+        if (has_size) {
+            size_t len = read_leb128(buf + pos + hlen, size - pos - hlen,
+                                     &obu_size);
+            if (len == 0)
+                return -1;
+            hlen += len;
+        }
+        if (obu_size > size - pos - hlen)
+            return -1;
+        if (type == OBU_METADATA)
+            parse_metadata(buf + pos + hlen, obu_size, md);
+        pos += hlen + obu_size;
+    }
+    return 0;
+}
+
+int av1_parse_config(const uint8_t *buf, size_t size, av1_metadata *md) {
+    if (size < 4 || buf[0] != 0x81) /* marker bit and version 1 */
+        return -1;
+    return av1_parse_obus(buf + 4, size - 4, md);
+}
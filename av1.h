@@ -0,0 +1,37 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_AV1
+#define _INCL_AV1
+
+#include "hdr10plus.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* AV1 mastering display colour volume, values as coded in the metadata OBU */
+typedef struct av1_mdcv {
+    uint16_t primaries[3][2]; /* 0.16 fixed point, order red, green, blue */
+    uint16_t white_point[2];  /* 0.16 fixed point */
+    uint32_t max_luminance;   /* 24.8 fixed point */
+    uint32_t min_luminance;   /* 18.14 fixed point */
+} av1_mdcv;
+
+typedef struct av1_metadata {
+    bool has_mdcv;
+    av1_mdcv mdcv;
+    bool has_cll;
+    uint16_t max_cll;
+    uint16_t max_fall;
+    bool has_hdr10plus;
+    hdr10plus hdr10plus;
+} av1_metadata;
+
+/* av1_parse_obus walks the OBUs of a temporal unit in low overhead bitstream
+ * format and collects the HDR metadata OBUs in md. Fields of md that are not
+ * found in buf are left untouched. Returns -1 if buf is malformed. */
+int av1_parse_obus(const uint8_t *buf, size_t size, av1_metadata *md);
+
+/* av1_parse_config parses an AV1CodecConfigurationRecord (av1C) including its
+ * configOBUs. Returns -1 if buf is malformed. */
+int av1_parse_config(const uint8_t *buf, size_t size, av1_metadata *md);
+
+#endif
@@ -0,0 +1,334 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "bdmv.h"
+#include "budget.h"
+#include "errors.h"
+#include "hevcsei.h"
+#include "mpegts.h"
+#include "scan.h"
+#include "wrappers.h"
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+/* playlists and clip information files are small, larger files are not read
+ * completely */
+#define BDMV_MAX_FILE (1024 * 1024)
+
+static uint16_t rd16(const uint8_t *p) { return (uint16_t)(p[0] << 8 | p[1]); }
+
+static uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+           p[3];
+}
+
+static bool has_suffix(const char *s, const char *suffix) {
+    size_t len = strlen(s), slen = strlen(suffix);
+    return len > slen && !strcasecmp(s + len - slen, suffix);
+}
+
+static bool is_dir(const char *dir, const char *name) {
+    char *path = scan_join_path(dir, name);
+    struct stat st;
+    bool ret = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+    free(path);
+    return ret;
+}
+
+/* returns the BDMV directory of path, that is path itself or path/BDMV, NULL
+ * if path is neither */
+static char *bdmv_root(const char *path) {
+    if (is_dir(path, "BDMV/PLAYLIST"))
+        return scan_join_path(path, "BDMV");
+    if (is_dir(path, "PLAYLIST"))
+        return md_strdup(path);
+    return NULL;
+}
+
+bool bdmv_is_input(const char *path) {
+    if (has_suffix(path, ".mpls"))
+        return true;
+    char *root = bdmv_root(path);
+    free(root);
+    return root != NULL;
+}
+
+/* reads up to BDMV_MAX_FILE bytes of path, returns NULL on error */
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return NULL;
+    uint8_t *buf = md_malloc(BDMV_MAX_FILE);
+    *size = fread(buf, 1, BDMV_MAX_FILE, f);
+    fclose(f);
+    return buf;
+}
+
+bdmv_playlist *bdmv_parse_mpls(const uint8_t *buf, size_t size) {
+    if (size < 20 || memcmp(buf, "MPLS", 4))
+        return NULL;
+    size_t pos = rd32(buf + 8); /* PlayList() */
+    if (pos + 10 > size)
+        return NULL;
+    int nb_items = rd16(buf + pos + 6);
+    pos += 10;
+
+    bdmv_playlist *pl = md_calloc(1, sizeof(bdmv_playlist));
+    pl->items = md_calloc(nb_items > 0 ? nb_items : 1, sizeof(bdmv_item));
+    for (int i = 0; i < nb_items; i++) {
+        if (pos + 2 > size)
+            break;
+        size_t len = rd16(buf + pos);
+        const uint8_t *p = buf + pos + 2;
+        pos += 2 + len;
+        if (len < 32 || pos > size)
+            break;
+        bdmv_item *item = &pl->items[pl->nb_items++];
+        memcpy(item->clips[0], p, 5);
+        item->nb_clips = 1;
+        item->in_time = rd32(p + 12);
+        item->out_time = rd32(p + 16);
+
+        /* the other angles follow the fixed part of a multi angle item */
+        bool multi_angle = p[10] & 0x10;
+        if (multi_angle && len >= 34) {
+            int nb_angles = p[32];
+            for (int a = 1; a < nb_angles && a < BDMV_MAX_ANGLES; a++) {
+                if (34 + (size_t)a * 10 > len)
+                    break;
+                memcpy(item->clips[a], p + 34 + (a - 1) * 10, 5);
+                item->nb_clips++;
+            }
+        }
+    }
+    if (pl->nb_items == 0) {
+        bdmv_playlist_free(pl);
+        return NULL;
+    }
+
+    /* clips that are played more than once do not make a title longer */
+    for (int i = 0; i < pl->nb_items; i++) {
+        const bdmv_item *item = &pl->items[i];
+        bool repeated = false;
+        for (int j = 0; j < i && !repeated; j++)
+            repeated = !strcmp(pl->items[j].clips[0], item->clips[0]);
+        if (!repeated && item->out_time > item->in_time)
+            pl->duration += item->out_time - item->in_time;
+    }
+    return pl;
+}
+
+void bdmv_playlist_free(bdmv_playlist *pl) {
+    free(pl->items);
+    free(pl);
+}
+
+int bdmv_parse_clpi(const uint8_t *buf, size_t size) {
+    if (size < 16 || memcmp(buf, "HDMV", 4))
+        return -1;
+    size_t pos = rd32(buf + 12); /* ProgramInfo() */
+    if (pos + 6 > size)
+        return -1;
+    int nb_sequences = buf[pos + 5];
+    pos += 6;
+    for (int i = 0; i < nb_sequences; i++) {
+        if (pos + 8 > size)
+            return -1;
+        int nb_streams = buf[pos + 6];
+        pos += 8;
+        for (int j = 0; j < nb_streams; j++) {
+            if (pos + 3 > size)
+                return -1;
+            int pid = rd16(buf + pos);
+            size_t len = buf[pos + 2]; /* StreamCodingInfo() */
+            if (pos + 3 + len > size)
+                return -1;
+            if (len > 0 && buf[pos + 3] == TS_STREAM_TYPE_HEVC)
+                return pid;
+            pos += 3 + len;
+        }
+    }
+    return -1;
+}
+
+static bdmv_playlist *load_mpls(const char *path) {
+    size_t size;
+    uint8_t *buf = read_file(path, &size);
+    if (buf == NULL)
+        return NULL;
+    bdmv_playlist *pl = bdmv_parse_mpls(buf, size);
+    free(buf);
+    return pl;
+}
+
+/* returns the playlist in root/PLAYLIST with the longest duration, the first
+ * by name if several are equally long */
+static bdmv_playlist *longest_playlist(const char *root) {
+    char *dir = scan_join_path(root, "PLAYLIST");
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        free(dir);
+        return NULL;
+    }
+    bdmv_playlist *best = NULL;
+    char *best_name = NULL;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (!has_suffix(ent->d_name, ".mpls"))
+            continue;
+        char *path = scan_join_path(dir, ent->d_name);
+        bdmv_playlist *pl = load_mpls(path);
+        free(path);
+        if (pl == NULL)
+            continue;
+        if (best == NULL || pl->duration > best->duration ||
+            (pl->duration == best->duration &&
+             strcmp(ent->d_name, best_name) < 0)) {
+            if (best != NULL) {
+                bdmv_playlist_free(best);
+                free(best_name);
+            }
+            best = pl;
+            best_name = md_strdup(ent->d_name);
+        } else
+            bdmv_playlist_free(pl);
+    }
+    closedir(d);
+    free(best_name);
+    free(dir);
+    return best;
+}
+
+bdmv_title *bdmv_title_open(const char *path) {
+    char *root = NULL;
+    bdmv_playlist *pl = NULL;
+    if (has_suffix(path, ".mpls")) {
+        /* BDMV/PLAYLIST/xxxxx.mpls */
+        char *dir = md_strdup(path);
+        char *slash = strrchr(dir, '/');
+        if (slash != NULL)
+            *slash = '\0';
+        root = scan_join_path(slash != NULL ? dir : ".", "..");
+        free(dir);
+        pl = load_mpls(path);
+    } else {
+        root = bdmv_root(path);
+        if (root != NULL)
+            pl = longest_playlist(root);
+    }
+    if (pl == NULL) {
+        free(root);
+        md_error_custom("No valid Blu-ray playlist found");
+        return NULL;
+    }
+    bdmv_title *title = md_malloc(sizeof(bdmv_title));
+    title->root = root;
+    title->playlist = pl;
+    return title;
+}
+
+void bdmv_title_free(bdmv_title *title) {
+    bdmv_playlist_free(title->playlist);
+    free(title->root);
+    free(title);
+}
+
+/* returns root/dir/clip+suffix */
+static char *clip_file(const bdmv_title *title, const char *dir,
+                       const char *clip, const char *suffix) {
+    size_t len = strlen(title->root) + strlen(dir) + strlen(clip) +
+                 strlen(suffix) + 3;
+    char *path = md_malloc(len);
+    snprintf(path, len, "%s/%s/%s%s", title->root, dir, clip, suffix);
+    return path;
+}
+
+char *bdmv_clip_path(const bdmv_title *title, const char *clip) {
+    return clip_file(title, "STREAM", clip, ".m2ts");
+}
+
+/* returns the HEVC PID of clip or -1 if the clip information does not tell */
+static int clip_pid(const bdmv_title *title, const char *clip) {
+    char *path = clip_file(title, "CLIPINF", clip, ".clpi");
+    size_t size;
+    uint8_t *buf = read_file(path, &size);
+    free(path);
+    if (buf == NULL)
+        return -1;
+    int pid = bdmv_parse_clpi(buf, size);
+    free(buf);
+    return pid;
+}
+
+typedef struct clip_job {
+    char *path;
+    int pid;
+    probe_budget *budget; /* shared by the angles */
+    hevc_sei sei;
+    int ret;
+    pthread_t thread;
+    bool started;
+} clip_job;
+
+static void *clip_worker(void *arg) {
+    clip_job *job = arg;
+    job->ret = ts_scan_hevc(job->path, job->pid, BDMV_CLIP_LIMIT, job->budget,
+                            &job->sei, NULL);
+    return NULL;
+}
+
+/* scans the clips of every angle of item, returns like bdmv_scan */
+static int scan_item(const bdmv_title *title, const bdmv_item *item,
+                     probe_budget *budget, hevc_sei *sei) {
+    clip_job jobs[BDMV_MAX_ANGLES];
+    int n = item->nb_clips;
+    for (int a = 0; a < n; a++) {
+        clip_job *job = &jobs[a];
+        job->path = bdmv_clip_path(title, item->clips[a]);
+        job->pid = clip_pid(title, item->clips[a]);
+        job->budget = budget;
+        job->ret = -1;
+        job->started = n > 1 && pthread_create(&job->thread, NULL,
+                                               &clip_worker, job) == 0;
+        if (!job->started)
+            clip_worker(job);
+    }
+
+    int ret = -1;
+    for (int a = 0; a < n; a++) {
+        clip_job *job = &jobs[a];
+        if (job->started)
+            pthread_join(job->thread, NULL);
+        if (job->ret > 0 && ret <= 0)
+            *sei = job->sei; /* first angle that carries the metadata */
+        if (job->ret > ret)
+            ret = job->ret;
+        free(job->path);
+    }
+    if (ret < 0 && global_md_error == ERR_NONE)
+        md_error_custom("Could not read the clips of the Blu-ray title");
+    return ret;
+}
+
+int bdmv_scan(const bdmv_title *title, probe_budget *budget, hevc_sei *sei) {
+    const bdmv_playlist *pl = title->playlist;
+    int ret = -1;
+    for (int i = 0; i < pl->nb_items && i < BDMV_MAX_ITEMS; i++) {
+        int item_ret = scan_item(title, &pl->items[i], budget, sei);
+        if (item_ret > 0)
+            return 1;
+        if (item_ret == 0)
+            ret = 0;
+        else if (ret == 0)
+            clear_global_md_error(); /* an earlier clip could be read */
+        if (budget_expired(budget))
+            break;
+    }
+    return ret;
+}
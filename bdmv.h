@@ -0,0 +1,70 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_BDMV
+#define _INCL_BDMV
+
+#include "budget.h"
+#include "hevcsei.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* amount of bytes read from the start of every clip that is checked */
+#define BDMV_CLIP_LIMIT (4 * 1024 * 1024)
+/* play items of the main title whose clips are checked at most */
+#define BDMV_MAX_ITEMS 3
+#define BDMV_MAX_ANGLES 9
+
+/* play item of an MPLS playlist, times are in 45 kHz ticks */
+typedef struct bdmv_item {
+    char clips[BDMV_MAX_ANGLES][6]; /* clip of every angle, e.g. "00001" */
+    int nb_clips;
+    uint32_t in_time;
+    uint32_t out_time;
+} bdmv_item;
+
+typedef struct bdmv_playlist {
+    bdmv_item *items;
+    int nb_items;
+    uint64_t duration; /* of distinct clips, in 45 kHz ticks */
+} bdmv_playlist;
+
+/* bdmv_is_input returns true if path is an MPLS playlist, a BDMV directory or
+ * a directory containing one */
+bool bdmv_is_input(const char *path);
+
+/* bdmv_parse_mpls parses the MPLS playlist in buf. Returns NULL if the
+ * playlist is malformed. */
+bdmv_playlist *bdmv_parse_mpls(const uint8_t *buf, size_t size);
+
+/* destructor for bdmv_playlist */
+void bdmv_playlist_free(bdmv_playlist *pl);
+
+/* bdmv_parse_clpi returns the PID of the first HEVC stream in the clip
+ * information file in buf or -1 if there is none */
+int bdmv_parse_clpi(const uint8_t *buf, size_t size);
+
+/* main title of a disc */
+typedef struct bdmv_title {
+    char *root; /* BDMV directory */
+    bdmv_playlist *playlist;
+} bdmv_title;
+
+/* bdmv_title_open picks the longest playlist of the disc at path or the
+ * playlist path names. Returns NULL and sets an error if there is no
+ * playlist with at least one play item. */
+bdmv_title *bdmv_title_open(const char *path);
+
+/* destructor for bdmv_title */
+void bdmv_title_free(bdmv_title *title);
+
+/* bdmv_clip_path returns the path of the stream file of clip, must be
+ * freed */
+char *bdmv_clip_path(const bdmv_title *title, const char *clip);
+
+/* bdmv_scan scans the clips of the first play items of title with
+ * ts_scan_hevc until one carries the metadata, every clip is read up to
+ * BDMV_CLIP_LIMIT bytes. The angles of a play item are read in parallel. The
+ * bytes read are accounted to budget. Returns 1 if the metadata was found, 0
+ * if not and -1 on error (error is set). */
+int bdmv_scan(const bdmv_title *title, probe_budget *budget, hevc_sei *sei);
+
+#endif
@@ -0,0 +1,118 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "bench.h"
+#include "wrappers.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t nb_allocs;
+
+static void count_alloc(size_t size) {
+    (void)size;
+    nb_allocs++;
+}
+
+static int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void bench_run(const char *name, bench_func func, void *arg,
+               bench_result *out) {
+    int64_t warmup_end = now_ns() + BENCH_WARMUP_NS;
+    while (now_ns() < warmup_end)
+        func(arg);
+
+    /* batch calls so the clock resolution does not matter */
+    uint64_t batch = 1;
+    while (true) {
+        int64_t start = now_ns();
+        for (uint64_t i = 0; i < batch; i++)
+            func(arg);
+        if (now_ns() - start >= BENCH_SAMPLE_NS)
+            break;
+        batch *= 2;
+    }
+
+    double samples[BENCH_SAMPLES];
+    nb_allocs = 0;
+    md_alloc_hook = &count_alloc;
+    for (int s = 0; s < BENCH_SAMPLES; s++) {
+        int64_t start = now_ns();
+        for (uint64_t i = 0; i < batch; i++)
+            func(arg);
+        samples[s] = (double)(now_ns() - start) / batch;
+    }
+    md_alloc_hook = NULL;
+
+    qsort(samples, BENCH_SAMPLES, sizeof(double), &compare_double);
+    snprintf(out->name, sizeof(out->name), "%s", name);
+    out->median_ns = samples[BENCH_SAMPLES / 2];
+    out->p99_ns = samples[BENCH_SAMPLES * 99 / 100];
+    out->allocs = (double)nb_allocs / ((double)batch * BENCH_SAMPLES);
+}
+
+void bench_write_json(FILE *ostream, const bench_result *res, size_t n) {
+    fprintf(ostream, "{\"benchmarks\": [\n");
+    for (size_t i = 0; i < n; i++)
+        fprintf(ostream,
+                "{\"name\": \"%s\", \"median_ns\": %.2f, \"p99_ns\": %.2f, "
+                "\"allocs\": %.2f}%s\n",
+                res[i].name, res[i].median_ns, res[i].p99_ns, res[i].allocs,
+                i + 1 < n ? "," : "");
+    fprintf(ostream, "]}\n");
+}
+
+int bench_read_json(const char *path, bench_result *res, size_t max) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+    char line[256];
+    size_t n = 0;
+    while (n < max && fgets(line, sizeof(line), f) != NULL) {
+        bench_result *r = &res[n];
+        if (sscanf(line,
+                   "{\"name\": \"%63[^\"]\", \"median_ns\": %lf, \"p99_ns\": "
+                   "%lf, \"allocs\": %lf}",
+                   r->name, &r->median_ns, &r->p99_ns, &r->allocs) == 4)
+            n++;
+    }
+    fclose(f);
+    return (int)n;
+}
+
+bool bench_compare(FILE *ostream, const bench_result *cur, size_t n,
+                   const bench_result *base, size_t nbase, double tolerance) {
+    bool ok = true;
+    for (size_t i = 0; i < n; i++) {
+        const bench_result *b = NULL;
+        for (size_t j = 0; j < nbase && b == NULL; j++)
+            if (!strcmp(cur[i].name, base[j].name))
+                b = &base[j];
+        if (b == NULL) {
+            fprintf(ostream, "%s: not in baseline\n", cur[i].name);
+            continue;
+        }
+        if (cur[i].median_ns > b->median_ns * (1 + tolerance)) {
+            fprintf(ostream, "%s: %.2f ns per call, baseline %.2f ns\n",
+                    cur[i].name, cur[i].median_ns, b->median_ns);
+            ok = false;
+        }
+        /* allocation counts are exact, any increase is a regression */
+        if (cur[i].allocs > b->allocs + 0.005) {
+            fprintf(ostream, "%s: %.2f allocations per call, baseline %.2f\n",
+                    cur[i].name, cur[i].allocs, b->allocs);
+            ok = false;
+        }
+    }
+    return ok;
+}
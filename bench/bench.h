@@ -0,0 +1,42 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_BENCH
+#define _INCL_BENCH
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* ns of calls before the measurement starts, lets the CPU clock ramp up */
+#define BENCH_WARMUP_NS 50000000
+/* samples per benchmark, the median and the 99th percentile are reported */
+#define BENCH_SAMPLES 301
+/* minimal duration of a sample in ns, calls are batched to reach it */
+#define BENCH_SAMPLE_NS 20000
+
+typedef void (*bench_func)(void *arg);
+
+typedef struct bench_result {
+    char name[64];
+    double median_ns; /* per call */
+    double p99_ns;    /* per call */
+    double allocs;    /* md_malloc, md_calloc and md_realloc calls per call */
+} bench_result;
+
+/* bench_run measures func(arg) and stores the result in out */
+void bench_run(const char *name, bench_func func, void *arg,
+               bench_result *out);
+
+/* bench_write_json writes the results as JSON, one benchmark per line */
+void bench_write_json(FILE *ostream, const bench_result *res, size_t n);
+
+/* bench_read_json reads up to max results written by bench_write_json.
+ * Returns the amount of results or -1 if path cannot be read. */
+int bench_read_json(const char *path, bench_result *res, size_t max);
+
+/* bench_compare reports every result of cur that takes more than tolerance
+ * (0.1 means 10%) longer than in base or allocates more to ostream. Returns
+ * true if there is no regression. */
+bool bench_compare(FILE *ostream, const bench_result *cur, size_t n,
+                   const bench_result *base, size_t nbase, double tolerance);
+
+#endif
@@ -0,0 +1,169 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "bench.h"
+#include "cmdline.h"
+#include "errors.h"
+#include "eval.h"
+#include "mdinfo.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* allowed slowdown against the baseline unless -tolerance is given */
+#define DEFAULT_TOLERANCE 0.25
+#define MAX_BENCHMARKS 32
+/* words of the response file given to bench_response */
+#define RESPONSE_WORDS 100000
+
+/* keeps results of pure functions alive */
+static volatile uint64_t sink;
+
+static point red = {0.68, 0.32};
+static point green = {0.265, 0.69};
+static point blue = {0.15, 0.06};
+static point white = {0.3127, 0.329};
+static disp_meta meta = {&red, &green, &blue, &white};
+static disp_lum lum = {0.0001, 1000};
+
+static char *manual_argv[] = {
+    "convertmdinfo", "-r",   "0.68",   "0.32",  "-g",    "0.265", "0.69",
+    "-b",            "0.15", "0.06",   "-wp",   "0.3127", "0.329", "-lmax",
+    "1000",          "-lmin", "0.0001"};
+
+static void bench_point(void *arg) {
+    point_x265 *p = point_to_point_x265(arg);
+    free(p);
+}
+
+static void bench_lum(void *arg) {
+    (void)arg;
+    sink += lum_to_x265(lum.max);
+}
+
+static void bench_meta(void *arg) {
+    (void)arg;
+    disp_meta_x265_free(meta_to_x265(&meta, &lum));
+}
+
+static void bench_str(void *arg) { free(x265_str(arg)); }
+
+static void bench_parse_double(void *arg) {
+    sink += (uint64_t)parse_double(arg);
+}
+
+static void bench_eval(void *arg) {
+    (void)arg;
+    int argc = sizeof(manual_argv) / sizeof(char *);
+    cmdline *cl = eval_parse(argc, manual_argv);
+    eval_container *ct = eval_container_alloc();
+    eval_cmdline(ct, cl);
+    eval_container_free(ct);
+    cmdline_free(cl);
+}
+
+/* parses "@path" where path holds -i and RESPONSE_WORDS - 1 inputs */
+static void bench_response(void *arg) {
+    char *argv[] = {"convertmdinfo", arg};
+    cmdline_free(eval_parse(2, argv));
+}
+
+/* writes the response file for bench_response, returns "@path" */
+static char *write_response_file() {
+    static char arg[] = "@/tmp/bench_core.XXXXXX";
+    int fd = mkstemp(arg + 1);
+    FILE *f = fd < 0 ? NULL : fdopen(fd, "w");
+    if (f == NULL) {
+        perror("response file");
+        exit(1);
+    }
+    fputs("-i", f);
+    for (int i = 1; i < RESPONSE_WORDS; i++)
+        fprintf(f, "%cinput%d.mkv", i % 8 ? ' ' : '\n', i);
+    fclose(f);
+    return arg;
+}
+
+typedef struct bench_options {
+    cmdline_spec spec;
+    int id;
+} bench_options;
+
+enum { OPT_BASELINE, OPT_OUTPUT, OPT_TOLERANCE };
+
+static const bench_options options[] = {
+    {{"-baseline", false}, OPT_BASELINE},
+    {{"-o", false}, OPT_OUTPUT},
+    {{"-tolerance", false}, OPT_TOLERANCE},
+};
+
+int main(int argc, char **argv) {
+    const char *baseline = NULL, *output = NULL;
+    double tolerance = DEFAULT_TOLERANCE;
+    cmdline *cl = cmdline_parse(argc, argv, options,
+                                sizeof(options) / sizeof(bench_options),
+                                sizeof(bench_options));
+    exit_on_error();
+    for (size_t i = 0; i < cl->nb_switches; i++) {
+        const cmdline_switch *sw = &cl->switches[i];
+        if (sw->argc != 1) {
+            fprintf(stderr, "%s takes one argument\n", sw->spec->id);
+            return 1;
+        }
+        switch (((const bench_options *)sw->spec)->id) {
+        case OPT_BASELINE:
+            baseline = sw->args[0];
+            break;
+        case OPT_OUTPUT:
+            output = sw->args[0];
+            break;
+        case OPT_TOLERANCE:
+            tolerance = parse_double(sw->args[0]);
+            exit_on_error();
+            break;
+        }
+    }
+
+    disp_meta_x265 *x265 = meta_to_x265(&meta, &lum);
+    exit_on_error();
+    char *response = write_response_file();
+
+    bench_result res[MAX_BENCHMARKS];
+    size_t n = 0;
+    bench_run("point_to_point_x265", &bench_point, &white, &res[n++]);
+    bench_run("lum_to_x265", &bench_lum, NULL, &res[n++]);
+    bench_run("meta_to_x265", &bench_meta, NULL, &res[n++]);
+    bench_run("x265_str", &bench_str, x265, &res[n++]);
+    bench_run("parse_double", &bench_parse_double, "0.3127", &res[n++]);
+    bench_run("eval_cmdline", &bench_eval, NULL, &res[n++]);
+    bench_run("cmdline_response_100k", &bench_response, response, &res[n++]);
+    unlink(response + 1);
+    disp_meta_x265_free(x265);
+    exit_on_error();
+
+    FILE *ostream = stdout;
+    if (output != NULL && (ostream = fopen(output, "w")) == NULL) {
+        perror(output);
+        return 1;
+    }
+    bench_write_json(ostream, res, n);
+    if (ostream != stdout)
+        fclose(ostream);
+
+    int ret = 0;
+    if (baseline != NULL) {
+        bench_result base[MAX_BENCHMARKS];
+        int nbase = bench_read_json(baseline, base, MAX_BENCHMARKS);
+        if (nbase < 0) {
+            perror(baseline);
+            fprintf(stderr, "Record a baseline with -o first\n");
+            ret = 1;
+        } else if (!bench_compare(stderr, res, n, base, nbase, tolerance)) {
+            fprintf(stderr, "Performance regression against %s\n", baseline);
+            ret = 1;
+        }
+    }
+    cmdline_free(cl);
+    return ret;
+}
@@ -0,0 +1,52 @@
+#!/bin/sh
+# This file is part of convertmdinfo, (c) 2021 Joerg Walter
+#
+# compares the CPU time of the decoder fallback in the default reduced mode
+# with -fulldecode:
+#   bench_decode.sh path/to/convertmdinfo sample.mkv
+# If sample.mkv does not exist, 10 s of 1080p HEVC without HDR metadata are
+# encoded into it with the ffmpeg command line tool and libx265. Without
+# mastering display SEI messages every probe falls back to the decoder for
+# its whole frame budget. Each mode runs RUNS times, the fastest run counts.
+
+set -e
+RUNS=${RUNS:-3}
+if [ $# -ne 2 ]; then
+	echo "usage: $0 convertmdinfo sample" >&2
+	exit 1
+fi
+bin=$1
+sample=$2
+
+if [ ! -f "$sample" ]; then
+	ffmpeg -nostdin -loglevel error -f lavfi \
+		-i testsrc2=size=1920x1080:rate=24 -t 10 -pix_fmt yuv420p10le \
+		-c:v libx265 -x265-params log-level=error "$sample"
+fi
+
+# prints the lowest CPU time of -stats over RUNS probes with the options $@
+cpu() {
+	i=0
+	while [ $i -lt "$RUNS" ]; do
+		# the probe fails as the sample carries no metadata
+		"$bin" -i "$sample" -stats "$@" 2>&1 >/dev/null || true
+		i=$((i + 1))
+	done | sed -n 's/.*(\([0-9.]*\) s CPU)$/\1/p' | sort -n | head -n 1
+}
+
+reduced=$(cpu)
+full=$(cpu -fulldecode)
+reduced_dyn=$(cpu -dynamic)
+full_dyn=$(cpu -dynamic -fulldecode)
+awk -v r="$reduced" -v f="$full" -v rd="$reduced_dyn" -v fd="$full_dyn" '
+function line(name, reduced, full) {
+	printf "%-8s reduced: %.3f s CPU, -fulldecode: %.3f s CPU", name,
+		reduced, full
+	if (reduced > 0)
+		printf " (%.1fx)", full / reduced
+	printf "\n"
+}
+BEGIN {
+	line("probe", r, f)
+	line("-dynamic", rd, fd)
+}'
@@ -0,0 +1,50 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "bitreader.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void br_init(bitreader *br, const uint8_t *buf, size_t size) {
+    br->buf = buf;
+    br->size = size;
+    br->pos = 0;
+    br->overrun = false;
+}
+
+uint32_t br_read(bitreader *br, unsigned n) {
+    uint32_t val = 0;
+    for (unsigned i = 0; i < n; i++) {
+        size_t byte = br->pos >> 3;
+        uint32_t bit = 0;
+        if (byte < br->size)
+            bit = (br->buf[byte] >> (7 - (br->pos & 7))) & 1;
+        else
+            br->overrun = true;
+        val = (val << 1) | bit;
+        br->pos++;
+    }
+    return val;
+}
+
+void br_skip(bitreader *br, size_t n) {
+    br->pos += n;
+    if (br->pos > br->size * 8)
+        br->overrun = true;
+}
+
+uint32_t br_read_ue(bitreader *br) {
+    unsigned zeros = 0;
+    while (br_read(br, 1) == 0) {
+        if (br->overrun || ++zeros > 31)
+            return 0; /* invalid code */
+    }
+    if (zeros == 0)
+        return 0;
+    return (UINT32_C(1) << zeros) - 1 + br_read(br, zeros);
+}
+
+size_t br_left(const bitreader *br) {
+    if (br->pos >= br->size * 8)
+        return 0;
+    return br->size * 8 - br->pos;
+}
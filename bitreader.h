@@ -0,0 +1,31 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_BITREADER
+#define _INCL_BITREADER
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* big endian bit reader over a byte buffer. Reading past the end of the
+ * buffer yields zero bits and sets the overrun flag. */
+typedef struct bitreader {
+    const uint8_t *buf;
+    size_t size; /* size of buf in bytes */
+    size_t pos;  /* position in bits */
+    bool overrun;
+} bitreader;
+
+void br_init(bitreader *br, const uint8_t *buf, size_t size);
+
+/* reads n bits, n must not exceed 32 */
+uint32_t br_read(bitreader *br, unsigned n);
+
+void br_skip(bitreader *br, size_t n);
+
+/* reads an unsigned exp-golomb code */
+uint32_t br_read_ue(bitreader *br);
+
+/* returns the amount of unread bits */
+size_t br_left(const bitreader *br);
+
+#endif
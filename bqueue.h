@@ -0,0 +1,39 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_BQUEUE
+#define _INCL_BQUEUE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* bounded blocking FIFO of pointers, producers block while it is full */
+typedef struct bqueue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    void **items;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    bool closed;
+} bqueue;
+
+/* constructor for bqueue */
+bqueue *bqueue_alloc(size_t capacity);
+
+/* destructor for bqueue, items still queued are not freed */
+void bqueue_free(bqueue *q);
+
+/* bqueue_push appends item, which must not be NULL, and blocks while the queue
+ * is full. Returns false if the queue was closed. */
+bool bqueue_push(bqueue *q, void *item);
+
+/* bqueue_pop removes the oldest item and blocks while the queue is empty.
+ * Returns NULL once the queue is closed and drained. */
+void *bqueue_pop(bqueue *q);
+
+/* bqueue_close wakes up every waiting thread, pushing is refused afterwards
+ * while the queued items can still be popped */
+void bqueue_close(bqueue *q);
+
+#endif
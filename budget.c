@@ -0,0 +1,47 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "budget.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+int64_t budget_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t cpu_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void budget_start(probe_budget *b, double seconds, uint64_t byte_limit) {
+    b->start = budget_now();
+    b->deadline = 0;
+    if (seconds > 0)
+        b->deadline = b->start + (int64_t)(seconds * 1e9);
+    b->byte_limit = byte_limit;
+    b->bytes = 0;
+    b->cpu_start = cpu_now();
+}
+
+bool budget_timed_out(const probe_budget *b) {
+    return b->deadline != 0 && budget_now() >= b->deadline;
+}
+
+bool budget_bytes_exhausted(const probe_budget *b) {
+    return b->byte_limit != 0 && b->bytes >= b->byte_limit;
+}
+
+bool budget_expired(const probe_budget *b) {
+    return budget_bytes_exhausted(b) || budget_timed_out(b);
+}
+
+double budget_elapsed(const probe_budget *b) {
+    return (budget_now() - b->start) / 1e9;
+}
+
+double budget_cpu(const probe_budget *b) {
+    return (cpu_now() - b->cpu_start) / 1e9;
+}
@@ -0,0 +1,40 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_BUDGET
+#define _INCL_BUDGET
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* wall-clock and byte budget of a single probe */
+typedef struct probe_budget {
+    int64_t start;       /* monotonic clock in ns when the probe started */
+    int64_t deadline;    /* monotonic clock in ns, 0 means no deadline */
+    uint64_t byte_limit; /* 0 means no limit */
+    int64_t cpu_start;   /* process CPU clock in ns when the probe started */
+    /* bytes read so far. The worker threads of a probe share the budget, they
+     * add what they read and check the budget before every read. */
+    _Atomic uint64_t bytes;
+} probe_budget;
+
+/* returns the monotonic clock in nanoseconds */
+int64_t budget_now();
+
+/* budget_start starts the clock, seconds and byte_limit may be 0 for no
+ * limit */
+void budget_start(probe_budget *b, double seconds, uint64_t byte_limit);
+
+bool budget_timed_out(const probe_budget *b);
+
+bool budget_bytes_exhausted(const probe_budget *b);
+
+/* returns true if either limit was hit */
+bool budget_expired(const probe_budget *b);
+
+/* returns the seconds passed since budget_start */
+double budget_elapsed(const probe_budget *b);
+
+/* returns the CPU seconds the process, including decoder threads, spent
+ * since budget_start */
+double budget_cpu(const probe_budget *b);
+
+#endif
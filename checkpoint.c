@@ -0,0 +1,81 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "checkpoint.h"
+#include "budget.h"
+#include "errors.h"
+#include "wrappers.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+char *ckpt_path(const char *output) {
+    char *path = md_malloc(strlen(output) + sizeof(CKPT_SUFFIX));
+    sprintf(path, "%s%s", output, CKPT_SUFFIX);
+    return path;
+}
+
+/* FNV-1a over the record up to the checksum */
+static uint32_t ckpt_checksum(const ckpt_record *rec) {
+    const uint8_t *p = (const uint8_t *)rec;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < offsetof(ckpt_record, checksum); i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+checkpoint *ckpt_open(const char *path, double interval) {
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        md_error_custom(strerror(errno));
+        return NULL;
+    }
+    checkpoint *c = md_calloc(1, sizeof(checkpoint));
+    c->fd = fd;
+    c->interval = (int64_t)(interval * 1e9);
+    c->last_sync = budget_now();
+    memcpy(c->rec.magic, CKPT_MAGIC, sizeof(c->rec.magic));
+    c->rec.keyframe_pos = -1;
+    return c;
+}
+
+bool ckpt_due(const checkpoint *c) {
+    return budget_now() - c->last_sync >= c->interval;
+}
+
+int ckpt_sync(checkpoint *c) {
+    c->rec.checksum = ckpt_checksum(&c->rec);
+    c->last_sync = budget_now();
+    if (pwrite(c->fd, &c->rec, sizeof(ckpt_record), 0) !=
+        sizeof(ckpt_record))
+        return -1;
+    return fsync(c->fd);
+}
+
+void ckpt_close(checkpoint *c, const char *path, bool remove) {
+    close(c->fd);
+    if (remove)
+        unlink(path);
+    free(c);
+}
+
+int ckpt_load(const char *path, ckpt_record *rec) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        md_error_custom("No checkpoint to resume from");
+        return -1;
+    }
+    ssize_t n = read(fd, rec, sizeof(ckpt_record));
+    close(fd);
+    if (n != sizeof(ckpt_record) ||
+        memcmp(rec->magic, CKPT_MAGIC, sizeof(rec->magic)) ||
+        rec->checksum != ckpt_checksum(rec)) {
+        md_error_custom("Checkpoint is invalid");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_CHECKPOINT
+#define _INCL_CHECKPOINT
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CKPT_MAGIC "MDCKPT01"
+#define CKPT_SUFFIX ".ckpt"
+
+/* fixed size record describing how far a full scan got. Everything before
+ * output_offset was produced by frames with a timestamp up to last_pts. */
+typedef struct ckpt_record {
+    char magic[8];
+    int64_t keyframe_pts;   /* latest keyframe at or before last_pts */
+    int64_t keyframe_pos;   /* byte position of that keyframe, -1 if unknown */
+    int64_t last_pts;       /* timestamp of the last dispatched frame */
+    uint64_t frames;        /* frames dispatched so far */
+    uint64_t records;       /* records the consumer has written */
+    uint64_t output_offset; /* bytes of flushed output */
+    int32_t stream_index;
+    uint32_t checksum; /* over all preceding fields */
+} ckpt_record;
+
+typedef struct checkpoint {
+    int fd;
+    int64_t interval; /* ns between two synced records */
+    int64_t last_sync;
+    ckpt_record rec;
+} checkpoint;
+
+/* ckpt_path returns the checkpoint file name for output, must be freed */
+char *ckpt_path(const char *output);
+
+/* ckpt_open creates the checkpoint file at path, a record is synced to disk
+ * at most every interval seconds. Returns NULL and sets an error on
+ * failure. */
+checkpoint *ckpt_open(const char *path, double interval);
+
+/* ckpt_due returns true if the interval has passed since the last sync */
+bool ckpt_due(const checkpoint *c);
+
+/* ckpt_sync overwrites the record on disk with c->rec and fsyncs it. Returns
+ * -1 on failure. */
+int ckpt_sync(checkpoint *c);
+
+/* ckpt_close closes the checkpoint, the file is deleted if remove is true */
+void ckpt_close(checkpoint *c, const char *path, bool remove);
+
+/* ckpt_load reads and verifies the record at path. Returns -1 and sets an
+ * error if there is no valid record. */
+int ckpt_load(const char *path, ckpt_record *rec);
+
+#endif
@@ -3,128 +3,238 @@
 #include "cmdline.h"
 #include "errors.h"
 #include "wrappers.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
-/* forward declarations */
-static cmdline_switch *parse_switch(cmdline_switch *sw, int pos, int argc,
-                                    char **argv);
-static int parse_arguments(cmdline_switch *sw, int pos, int argc, char **argv);
-static cmdline_switch *find_switch(cmdline_switch *sw, const char *s_search);
-static cmdline_switch *first_switch(cmdline_switch *sw);
-static size_t count_elements(cmdline_switch *sw, size_t e);
+/* appends token to the token list of cl */
+static void push_token(cmdline *cl, size_t *alloc, char *token) {
+    if (cl->nb_tokens == *alloc) {
+        *alloc = *alloc ? *alloc * 2 : 64;
+        cl->tokens = md_realloc(cl->tokens, *alloc * sizeof(char *));
+    }
+    cl->tokens[cl->nb_tokens++] = token;
+}
 
-/* constructor for cmdline_switch, only used internally */
-static cmdline_switch *cmdline_switch_alloc() {
-    cmdline_switch *sw = md_malloc(sizeof(cmdline_switch));
-    sw->id = NULL;
-    sw->args = NULL;
-    sw->argc = 0;
-    sw->prev = NULL;
-    sw->next = NULL;
-    return sw;
+/* reads the response file path, the buffer is owned by cl. Returns NULL and
+ * sets an error if the file cannot be read. */
+static char *read_response_file(cmdline *cl, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        const size_t bufsize = 256;
+        char *buf = md_malloc(bufsize);
+        snprintf(buf, bufsize, "Command line parser: %s: %s", path,
+                 strerror(errno));
+        md_error_custom(buf);
+        return NULL;
+    }
+    size_t size = 0, alloc = 4096;
+    char *data = md_malloc(alloc);
+    size_t n;
+    while ((n = fread(data + size, 1, alloc - size - 1, f)) > 0) {
+        size += n;
+        if (size + 1 == alloc) {
+            alloc *= 2;
+            data = md_realloc(data, alloc);
+        }
+    }
+    fclose(f);
+    data[size] = '\0';
+    cl->buffers =
+        md_realloc(cl->buffers, (cl->nb_buffers + 1) * sizeof(char *));
+    cl->buffers[cl->nb_buffers++] = data;
+    return data;
 }
 
-void cmdline_free(cmdline_switch *sw) {
-    if (sw == NULL)
-        return;
-    cmdline_free(sw->next);
-    if (sw->args != NULL) {
-        for (size_t i = 0; i < sw->argc; i++)
-            free(sw->args[i]);
-        free(sw->args);
+/* splits data into words in place, returns the next word and advances data
+ * behind it. Returns NULL at the end of data. */
+static char *next_word(char **data) {
+    char *in = *data;
+    while (true) {
+        while (isspace((unsigned char)*in))
+            in++;
+        if (*in != '#')
+            break;
+        while (*in != '\0' && *in != '\n')
+            in++; /* comment */
     }
-    free(sw);
+    if (*in == '\0')
+        return NULL;
+
+    char *word = in, *out = in;
+    char quote = '\0';
+    while (*in != '\0' && (quote || !isspace((unsigned char)*in))) {
+        if (quote && *in == quote)
+            quote = '\0';
+        else if (!quote && (*in == '"' || *in == '\''))
+            quote = *in;
+        else
+            *out++ = *in;
+        in++;
+    }
+    if (*in != '\0')
+        in++;
+    *out = '\0';
+    *data = in;
+    return word;
 }
 
-cmdline_switch *cmdline_parse(int argc, char **argv) {
-    return parse_switch(NULL, 1, argc, argv);
+/* returns path relative to the directory of the response file parent */
+static char *resolve_nested(const char *parent, const char *path) {
+    const char *slash = strrchr(parent, '/');
+    if (path[0] == '/' || slash == NULL)
+        return md_strdup(path);
+    size_t dirlen = (size_t)(slash - parent) + 1;
+    char *resolved = md_malloc(dirlen + strlen(path) + 1);
+    memcpy(resolved, parent, dirlen);
+    strcpy(resolved + dirlen, path);
+    return resolved;
 }
 
-static int parse_arguments(cmdline_switch *sw, int pos, int argc, char **argv) {
-    char **arguments = NULL;
-    size_t elements = 0;
-    for (int i = pos; i < argc; i++) {
-        if (argv[i][0] == '-')
-            break; /* end of arguments */
-        elements++;
-        if (elements == 1) {
-            arguments = md_malloc(sizeof(char *));
-        } else {
-            arguments = md_realloc(arguments, sizeof(char *) * elements);
+/* adds the words of the response file path to the token list, nested
+ * response files are expanded up to CMDLINE_MAX_DEPTH. Relative paths of
+ * nested response files are resolved against the file naming them. */
+static int expand_response_file(cmdline *cl, size_t *alloc, const char *path) {
+    char *pos[CMDLINE_MAX_DEPTH];
+    char *paths[CMDLINE_MAX_DEPTH];
+    int depth = 0, ret = 0;
+    paths[0] = md_strdup(path);
+    pos[0] = read_response_file(cl, path);
+    if (pos[0] == NULL) {
+        free(paths[0]);
+        return -1;
+    }
+    while (depth >= 0) {
+        char *word = next_word(&pos[depth]);
+        if (word == NULL) {
+            free(paths[depth--]);
+            continue;
+        }
+        if (word[0] != '@' || word[1] == '\0') {
+            push_token(cl, alloc, word);
+            continue;
+        }
+        if (depth + 1 == CMDLINE_MAX_DEPTH) {
+            md_error_custom("Command line parser: Response files nested too "
+                            "deeply");
+            ret = -1;
+            break;
+        }
+        paths[depth + 1] = resolve_nested(paths[depth], word + 1);
+        depth++;
+        pos[depth] = read_response_file(cl, paths[depth]);
+        if (pos[depth] == NULL) {
+            ret = -1;
+            break;
         }
-        arguments[elements - 1] = md_strdup(argv[i]);
     }
-    sw->argc = elements;
-    sw->args = arguments;
-    return 0;
+    while (depth >= 0)
+        free(paths[depth--]);
+    return ret;
 }
 
-static cmdline_switch *parse_switch(cmdline_switch *sw, int pos, int argc,
-                                    char **argv) {
-    if (pos >= argc) {
-        return NULL; /* base case */
-    }
-    if (argv[pos][0] != '-') {
-        const size_t bufsize = 64;
-        char *buf = md_malloc(bufsize);
-        snprintf(buf, bufsize,
-                 "Command line parser: Expected switch at token %d", pos);
-        md_error_custom(buf);
-        return NULL;
-    }
+static int compare_spec(const void *key, const void *entry) {
+    return strcmp(key, ((const cmdline_spec *)entry)->id);
+}
 
-    /* backtrack to detect duplicate switches */
-    if (find_switch(first_switch(sw), argv[pos]) != NULL) {
-        const size_t bufsize = 128;
-        char *buf = md_malloc(bufsize);
-        snprintf(buf, bufsize,
-                 "Command line parser: Duplicate command line switch \"%s\"",
-                 argv[pos]);
-        md_error_custom(buf);
-        return NULL;
+/* appends a switch for the table entry spec to cl */
+static cmdline_switch *push_switch(cmdline *cl, size_t *alloc,
+                                   const cmdline_spec *spec, char **args) {
+    if (cl->nb_switches == *alloc) {
+        *alloc = *alloc ? *alloc * 2 : 16;
+        cl->switches =
+            md_realloc(cl->switches, *alloc * sizeof(cmdline_switch));
     }
-
-    cmdline_switch *sw_prev = NULL;
-    if (sw != NULL)
-        sw_prev = sw;
-    sw = cmdline_switch_alloc();
-    sw->id = argv[pos];
-    parse_arguments(sw, pos + 1, argc, argv);
-    sw->prev = sw_prev;
-    sw->next = parse_switch(sw, pos + 1 + sw->argc, argc, argv);
+    cmdline_switch *sw = &cl->switches[cl->nb_switches++];
+    sw->spec = spec;
+    sw->args = args;
+    sw->argc = 0;
     return sw;
 }
 
-/* searches for a particular command line switch and returns its object if found
- */
-static cmdline_switch *find_switch(cmdline_switch *sw, const char *s_search) {
-    if (sw == NULL)
-        return NULL; // base case
-    if (!strcmp(sw->id, s_search))
-        return sw; // found match
-    return find_switch(sw->next, s_search);
+static void parse_error(const char *fmt, const char *token, size_t pos) {
+    const size_t bufsize = 128;
+    char *buf = md_malloc(bufsize);
+    if (token != NULL)
+        snprintf(buf, bufsize, fmt, token);
+    else
+        snprintf(buf, bufsize, fmt, pos);
+    md_error_custom(buf);
 }
 
-/* returns first switch of the list */
-static cmdline_switch *first_switch(cmdline_switch *sw) {
-    if (sw == NULL)
-        return NULL;
-    if (sw->prev == NULL)
-        return sw;
-    return first_switch(sw->prev);
-}
+cmdline *cmdline_parse(int argc, char **argv, const void *table, size_t n,
+                       size_t size) {
+    const char *entries = table;
+    for (size_t i = 1; i < n; i++) {
+        const cmdline_spec *a =
+            (const cmdline_spec *)(entries + (i - 1) * size);
+        const cmdline_spec *b = (const cmdline_spec *)(entries + i * size);
+        if (strcmp(a->id, b->id) >= 0) /* table must be sorted */
+            md_bug(__FILE__, __LINE__, true);
+    }
+
+    cmdline *cl = md_calloc(1, sizeof(cmdline));
+    size_t token_alloc = 0;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '@' && argv[i][1] != '\0') {
+            if (expand_response_file(cl, &token_alloc, argv[i] + 1) < 0) {
+                cmdline_free(cl);
+                return NULL;
+            }
+        } else
+            push_token(cl, &token_alloc, argv[i]);
+    }
 
-size_t cmdline_elements(cmdline_switch *sw) {
-    if (sw == NULL)
-        return 0;
-    cmdline_switch *start = first_switch(sw);
-    return count_elements(start, 0);
+    /* one bit per table entry for duplicate detection */
+    uint64_t *seen = md_calloc((n + 63) / 64, sizeof(uint64_t));
+    size_t switch_alloc = 0;
+    cmdline_switch *sw = NULL;
+    for (size_t i = 0; i < cl->nb_tokens; i++) {
+        char *token = cl->tokens[i];
+        if (token[0] != '-' || token[1] == '\0') {
+            /* argument, a lone "-" denotes stdin */
+            if (sw == NULL) {
+                parse_error("Command line parser: Expected switch at token %zu",
+                            NULL, i + 1);
+                break;
+            }
+            sw->argc++;
+            continue;
+        }
+        const cmdline_spec *spec = bsearch(token, table, n, size, compare_spec);
+        if (spec == NULL) {
+            parse_error("Unknown command line switch \"%s\"", token, 0);
+            break;
+        }
+        size_t idx = (size_t)((const char *)spec - entries) / size;
+        uint64_t bit = UINT64_C(1) << (idx % 64);
+        if ((seen[idx / 64] & bit) && !spec->repeatable) {
+            parse_error(
+                "Command line parser: Duplicate command line switch \"%s\"",
+                token, 0);
+            break;
+        }
+        seen[idx / 64] |= bit;
+        sw = push_switch(cl, &switch_alloc, spec, cl->tokens + i + 1);
+    }
+    free(seen);
+    if (global_md_error != ERR_NONE) {
+        cmdline_free(cl);
+        return NULL;
+    }
+    return cl;
 }
 
-static size_t count_elements(cmdline_switch *sw, size_t e) {
-    if (sw == NULL)
-        return e;
-    e++;
-    return count_elements(sw->next, e);
+void cmdline_free(cmdline *cl) {
+    if (cl == NULL)
+        return;
+    for (size_t i = 0; i < cl->nb_buffers; i++)
+        free(cl->buffers[i]);
+    free(cl->buffers);
+    free(cl->tokens);
+    free(cl->switches);
+    free(cl);
 }
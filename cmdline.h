@@ -2,22 +2,43 @@
 #ifndef _INCL_CMDLINE
 #define _INCL_CMDLINE
 
+#include <stdbool.h>
 #include <stdlib.h>
 
+/* response files may include other response files up to this depth */
+#define CMDLINE_MAX_DEPTH 8
+
+/* entry of a switch table. The table passed to cmdline_parse may consist of
+ * larger structs that start with a cmdline_spec. */
+typedef struct cmdline_spec {
+    const char *id;
+    bool repeatable; /* may be given more than once */
+} cmdline_spec;
+
 typedef struct cmdline_switch {
-    char *id;
-    char **args;
+    const cmdline_spec *spec; /* entry of the switch table */
+    char **args;              /* points into the tokens of the cmdline */
     size_t argc;
-    struct cmdline_switch *prev;
-    struct cmdline_switch *next;
 } cmdline_switch;
 
-cmdline_switch *cmdline_parse(int argc, char **argv);
+typedef struct cmdline {
+    cmdline_switch *switches;
+    size_t nb_switches;
+    char **tokens; /* argv with expanded response files */
+    size_t nb_tokens;
+    char **buffers; /* contents of the response files */
+    size_t nb_buffers;
+} cmdline;
+
+/* cmdline_parse splits argv into switches and their arguments in a single
+ * pass. table holds n entries of size bytes, sorted by id. An argument of the
+ * form @file is replaced by the whitespace separated words of file, words may
+ * be quoted with ' or ", lines starting with # are ignored. Returns NULL and
+ * sets an error on unknown or duplicate switches. */
+cmdline *cmdline_parse(int argc, char **argv, const void *table, size_t n,
+                       size_t size);
 
-/* recursively frees all cmdline_switch structs */
-void cmdline_free(cmdline_switch *sw);
+/* destructor for cmdline */
+void cmdline_free(cmdline *cl);
 
-/* return amount of parsed command line switches, always backtraces to the first
- * element */
-size_t cmdline_elements(cmdline_switch *sw);
 #endif
@@ -0,0 +1,338 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "compare.h"
+#include "bqueue.h"
+#include "errors.h"
+#include "eval.h"
+#include "ffmpeg.h"
+#include "hdr10plus.h"
+#include "wrappers.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    CMP_MASTERING, /* x265 --master-display string */
+    CMP_CLL,       /* x265 --max-cll string */
+    CMP_HDR10PLUS, /* record of a frame */
+} cmp_kind;
+
+/* kinds of static metadata */
+#define CMP_STATIC 2
+
+static const char *const cmp_names[CMP_STATIC] = {"mastering display",
+                                                  "content light level"};
+
+typedef struct cmp_item {
+    cmp_kind kind;
+    char *text;   /* static metadata as printed by a probe */
+    hdr10plus md; /* HDR10+ record */
+} cmp_item;
+
+/* one of the inputs, the probe thread only touches the fields above queue
+ * once it is started */
+typedef struct cmp_side {
+    const char *path;
+    const char *role;
+    const eval_container *ct;
+    ff_fullscan fs;
+    uint64_t records; /* HDR10+ records queued */
+    int ret;          /* of the probe */
+    char *error;      /* of a failed probe */
+    ff_stats stats;
+    bqueue *queue;
+    pthread_t thread;
+    bool started;
+    bool ended;                    /* the queue was drained */
+    cmp_item *statics[CMP_STATIC]; /* static metadata received so far */
+} cmp_side;
+
+typedef struct cmp_state {
+    cmp_side sides[2];
+    FILE *ostream;
+    uint64_t max;    /* mismatches that end the comparison, 0 means none */
+    uint64_t frames; /* HDR10+ records compared */
+    uint64_t mismatches;
+    bool compared[CMP_STATIC];
+} cmp_state;
+
+static void item_free(cmp_item *item) {
+    if (item == NULL)
+        return;
+    free(item->text);
+    free(item);
+}
+
+/* hands item to the comparison. Returns false if the comparison has already
+ * ended. */
+static bool side_push(cmp_side *side, cmp_item *item) {
+    if (bqueue_push(side->queue, item))
+        return true;
+    item_free(item);
+    return false;
+}
+
+/* queues what print writes for sd as static metadata of kind */
+static ff_return_t push_static(cmp_side *side, cmp_kind kind,
+                               ff_recv_func print, AVFrameSideData *sd) {
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *mem = open_memstream(&buf, &size);
+    if (mem == NULL) {
+        md_error_custom(strerror(errno));
+        return FFRET_ERROR;
+    }
+    ff_return_t ret = print(mem, sd, NULL);
+    fclose(mem);
+    if (ret != FFRET_DONE) {
+        free(buf);
+        return ret;
+    }
+    buf[strcspn(buf, "\n")] = '\0';
+    cmp_item *item = md_calloc(1, sizeof(cmp_item));
+    item->kind = kind;
+    item->text = buf;
+    side_push(side, item);
+    return FFRET_DONE;
+}
+
+static ff_return_t cmp_mastering(FILE *ostream, AVFrameSideData *sd,
+                                 void *opaque) {
+    (void)ostream;
+    return push_static(opaque, CMP_MASTERING, &ffmpeg_disp_meta, sd);
+}
+
+static ff_return_t cmp_cll(FILE *ostream, AVFrameSideData *sd, void *opaque) {
+    (void)ostream;
+    return push_static(opaque, CMP_CLL, &ffmpeg_content_light, sd);
+}
+
+static ff_return_t cmp_dynamic(FILE *ostream, AVFrameSideData *sd,
+                               void *opaque) {
+    (void)ostream;
+    cmp_side *side = opaque;
+    if (sd->type != AV_FRAME_DATA_DYNAMIC_HDR_PLUS)
+        return FFRET_CONTINUE;
+    cmp_item *item = md_calloc(1, sizeof(cmp_item));
+    item->kind = CMP_HDR10PLUS;
+    ffmpeg_conv_hdrplus(&item->md, (AVDynamicHDRPlus *)sd->data);
+    side->records++;
+    if (!side_push(side, item))
+        return FFRET_DONE; /* stopped early */
+    return FFRET_BREAK;    /* one record per frame */
+}
+
+/* builds the registry of a side. Metadata that is missing is a mismatch
+ * rather than an error, so every consumer is done at the end of stream. */
+static ff_registry *side_registry(cmp_side *side) {
+    const eval_container *ct = side->ct;
+    const enum AVFrameSideDataType mdcv_types[] = {
+        AV_FRAME_DATA_MASTERING_DISPLAY_METADATA};
+    const enum AVFrameSideDataType cll_types[] = {
+        AV_FRAME_DATA_CONTENT_LIGHT_LEVEL};
+    const enum AVFrameSideDataType hdrplus_types[] = {
+        AV_FRAME_DATA_DYNAMIC_HDR_PLUS};
+    ff_registry *reg = ff_registry_alloc();
+    ff_consumer *c =
+        ff_registry_add(reg, &cmp_mastering, NULL, side, mdcv_types, 1, 24);
+    c->until_eof = true;
+    if (ct->ffcll) {
+        c = ff_registry_add(reg, &cmp_cll, NULL, side, cll_types, 1, 24);
+        c->until_eof = true;
+    }
+    if (ct->ffdynamic) {
+        c = ff_registry_add(reg, &cmp_dynamic, NULL, side, hdrplus_types, 1,
+                            0);
+        c->until_eof = true;
+        side->fs = (ff_fullscan){.records = &side->records};
+        reg->fullscan = &side->fs;
+    }
+    ff_registry_set_budget(reg, ct->ffdeadline, ct->ffmaxbytes);
+    reg->decode = ct->fffulldecode ? FF_DECODE_FULL : FF_DECODE_REDUCED;
+    return reg;
+}
+
+static void *side_thread(void *arg) {
+    cmp_side *side = arg;
+    ff_registry *reg = side_registry(side);
+    side->ret = ffmpeg_dispatch_sidedata(side->path, reg);
+    side->stats = reg->stats;
+    if (side->ret < 0) {
+        /* errors are per thread */
+        side->error = md_strdup(global_md_error_str(global_md_error));
+        clear_global_md_error();
+    }
+    ff_registry_free(reg);
+    bqueue_close(side->queue); /* end of input */
+    return NULL;
+}
+
+/* counts a mismatch, only the first one is written. Returns false if the
+ * comparison ends. */
+static bool mismatch(cmp_state *st, const char *fmt, ...) {
+    if (st->mismatches++ == 0) {
+        va_list ap;
+        va_start(ap, fmt);
+        fprintf(st->ostream, "first mismatch: ");
+        vfprintf(st->ostream, fmt, ap);
+        fputc('\n', st->ostream);
+        va_end(ap);
+    }
+    return st->max == 0 || st->mismatches < st->max;
+}
+
+/* compares the static metadata once both sides either have it or ended.
+ * Returns false if the comparison ends. */
+static bool check_statics(cmp_state *st) {
+    for (int kind = 0; kind < CMP_STATIC; kind++) {
+        const cmp_item *a = st->sides[0].statics[kind];
+        const cmp_item *b = st->sides[1].statics[kind];
+        if (st->compared[kind] || (a == NULL && !st->sides[0].ended) ||
+            (b == NULL && !st->sides[1].ended))
+            continue;
+        st->compared[kind] = true;
+        bool differs = (a == NULL) != (b == NULL) ||
+                       (a != NULL && strcmp(a->text, b->text) != 0);
+        if (differs && !mismatch(st, "%s: %s %s, %s %s", cmp_names[kind],
+                                 st->sides[0].role, a ? a->text : "none",
+                                 st->sides[1].role, b ? b->text : "none"))
+            return false;
+    }
+    return true;
+}
+
+/* pops the items of side up to its next HDR10+ record and keeps the static
+ * metadata. Returns NULL at the end of the input. */
+static cmp_item *next_record(cmp_side *side) {
+    cmp_item *item;
+    while ((item = bqueue_pop(side->queue)) != NULL) {
+        if (item->kind == CMP_HDR10PLUS)
+            return item;
+        item_free(side->statics[item->kind]);
+        side->statics[item->kind] = item;
+    }
+    side->ended = true;
+    return NULL;
+}
+
+/* compares the HDR10+ records of both sides in lockstep, so neither side
+ * gets further ahead than its queue allows */
+static void compare_loop(cmp_state *st) {
+    while (true) {
+        cmp_item *a = next_record(&st->sides[0]);
+        cmp_item *b = next_record(&st->sides[1]);
+        /* a probe that failed or ran out of budget has nothing to compare,
+         * its thread wrote ret before it closed the queue */
+        bool go_on = !(st->sides[0].ended && st->sides[0].ret < 0) &&
+                     !(st->sides[1].ended && st->sides[1].ret < 0) &&
+                     check_statics(st);
+        if (go_on && (a == NULL) != (b == NULL)) {
+            const cmp_side *shorter = &st->sides[a == NULL ? 0 : 1];
+            mismatch(st, "frame %llu: HDR10+ metadata of %s ends",
+                     (unsigned long long)st->frames, shorter->role);
+            go_on = false; /* the rest cannot be aligned */
+        } else if (go_on && a != NULL) {
+            int window;
+            const char *field = hdr10plus_diff(&a->md, &b->md, &window);
+            if (field != NULL && window >= 0)
+                go_on = mismatch(st, "frame %llu: HDR10+ %s of window %d",
+                                 (unsigned long long)st->frames, field,
+                                 window);
+            else if (field != NULL)
+                go_on = mismatch(st, "frame %llu: HDR10+ %s",
+                                 (unsigned long long)st->frames, field);
+            st->frames++;
+        }
+        bool end = a == NULL && b == NULL;
+        item_free(a);
+        item_free(b);
+        if (!go_on || end)
+            return;
+    }
+}
+
+/* stops the probes and frees what they left in the queues */
+static void side_close(cmp_side *side) {
+    if (side->started) {
+        bqueue_close(side->queue);
+        pthread_join(side->thread, NULL);
+    }
+    cmp_item *item;
+    while ((item = bqueue_pop(side->queue)) != NULL)
+        item_free(item);
+    bqueue_free(side->queue);
+    for (int kind = 0; kind < CMP_STATIC; kind++)
+        item_free(side->statics[kind]);
+}
+
+int compare_inputs(const char *source, const char *encode,
+                   const eval_container *ct, FILE *ostream) {
+    cmp_state st;
+    memset(&st, 0, sizeof(cmp_state));
+    st.ostream = ostream;
+    st.max = ct->ffmaxdiffs;
+    const char *paths[2] = {source, encode};
+    const char *roles[2] = {"source", "encode"};
+    for (int i = 0; i < 2; i++) {
+        cmp_side *side = &st.sides[i];
+        side->path = paths[i];
+        side->role = roles[i];
+        side->ct = ct;
+        side->queue = bqueue_alloc(COMPARE_QUEUE_DEPTH);
+    }
+    int ret = 0;
+    for (int i = 0; i < 2 && ret == 0; i++) {
+        cmp_side *side = &st.sides[i];
+        side->started =
+            pthread_create(&side->thread, NULL, &side_thread, side) == 0;
+        if (!side->started) {
+            md_error_custom("Could not start comparison thread");
+            ret = 1;
+        }
+    }
+    if (ret == 0)
+        compare_loop(&st);
+    for (int i = 0; i < 2; i++)
+        side_close(&st.sides[i]);
+    if (ret != 0)
+        return ret;
+
+    /* an exhausted budget only matters if no mismatch was found before */
+    bool budget = false;
+    for (int i = 0; i < 2; i++) {
+        cmp_side *side = &st.sides[i];
+        ff_probe_status status = side->stats.status;
+        bool exhausted = side->ret < 0 && (status == FF_PROBE_TIMEOUT ||
+                                           status == FF_PROBE_BYTES);
+        if (side->ret < 0 && !exhausted && ret == 0) {
+            size_t len = strlen(side->path) + strlen(side->error) + 3;
+            char *msg = md_malloc(len);
+            snprintf(msg, len, "%s: %s", side->path, side->error);
+            md_error_custom(msg);
+            ret = 1;
+        }
+        budget |= exhausted;
+        if (ct->ffstats || exhausted) {
+            fprintf(stderr, "%s: ", side->path);
+            ff_stats_print(stderr, &side->stats);
+        }
+        free(side->error);
+    }
+    if (ret == 1)
+        return 1;
+
+    bool stopped = st.max != 0 && st.mismatches >= st.max;
+    fprintf(ostream, "mismatches: %llu%s\n",
+            (unsigned long long)st.mismatches,
+            stopped ? " (stopped early)" : "");
+    if (ct->ffdynamic)
+        fprintf(ostream, "frames compared: %llu\n",
+                (unsigned long long)st.frames);
+    if (st.mismatches > 0)
+        return 3;
+    return budget ? 2 : 0;
+}
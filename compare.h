@@ -0,0 +1,24 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_COMPARE
+#define _INCL_COMPARE
+
+#include "eval.h"
+#include <stdio.h>
+
+/* items a side may run ahead of the other */
+#define COMPARE_QUEUE_DEPTH 64
+
+/* compare_inputs probes source and encode at the same time on two threads,
+ * with the ffmpeg options in ct, and compares what they carry: the
+ * mastering display metadata, the content light level with -cll and the
+ * HDR10+ metadata of every frame with -dynamic. The HDR10+ records are
+ * aligned by their position in presentation order and handed over through
+ * queues of COMPARE_QUEUE_DEPTH items, so memory does not grow with the
+ * length of the streams. The first mismatch and a summary are written to
+ * ostream, both probes stop once ct->ffmaxdiffs mismatches were found.
+ * Returns 0 if the metadata matches, 3 if it differs, 2 if a budget ended a
+ * probe before the comparison was complete and 1 on error (error is set). */
+int compare_inputs(const char *source, const char *encode,
+                   const eval_container *ct, FILE *ostream);
+
+#endif
@@ -0,0 +1,325 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "dynindex.h"
+#include "dynmeta.h"
+#include "errors.h"
+#include "hdr10plus.h"
+#include "wrappers.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* little endian output buffer */
+typedef struct le_writer {
+    uint8_t *buf;
+    size_t pos;
+} le_writer;
+
+static void put(le_writer *w, uint64_t val, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        w->buf[w->pos++] = (uint8_t)(val >> (8 * i));
+}
+
+/* little endian input buffer, reads past the end return 0 and set overrun */
+typedef struct le_reader {
+    const uint8_t *buf;
+    size_t size;
+    size_t pos;
+    bool overrun;
+} le_reader;
+
+static uint64_t get(le_reader *r, int bytes) {
+    if (r->pos + bytes > r->size) {
+        r->overrun = true;
+        return 0;
+    }
+    uint64_t val = 0;
+    for (int i = 0; i < bytes; i++)
+        val |= (uint64_t)r->buf[r->pos++] << (8 * i);
+    return val;
+}
+
+static uint64_t get_at(const uint8_t *buf, int bytes) {
+    le_reader r = {.buf = buf, .size = (size_t)bytes};
+    return get(&r, bytes);
+}
+
+/* serializes md into buf, returns the size */
+static size_t serialize(const hdr10plus *md, uint8_t *buf) {
+    le_writer w = {.buf = buf};
+    put(&w, md->application_version, 1);
+    put(&w, md->num_windows, 1);
+    put(&w, md->targeted_max_luminance, 4);
+    put(&w, md->targeted_peak_flag, 1);
+    put(&w, md->mastering_peak_flag, 1);
+    for (int i = 0; i < md->num_windows && i < 3; i++) {
+        const hdr10plus_window *win = &md->windows[i];
+        if (i > 0) {
+            put(&w, win->upper_left_x, 2);
+            put(&w, win->upper_left_y, 2);
+            put(&w, win->lower_right_x, 2);
+            put(&w, win->lower_right_y, 2);
+            put(&w, win->center_x, 2);
+            put(&w, win->center_y, 2);
+            put(&w, win->rotation_angle, 1);
+            put(&w, win->semimajor_internal, 2);
+            put(&w, win->semimajor_external, 2);
+            put(&w, win->semiminor_external, 2);
+            put(&w, win->overlap_process_option, 1);
+        }
+        for (int c = 0; c < 3; c++)
+            put(&w, win->maxscl[c], 4);
+        put(&w, win->average_maxrgb, 4);
+        put(&w, win->num_percentiles, 1);
+        for (int j = 0; j < win->num_percentiles; j++) {
+            put(&w, win->percentages[j], 1);
+            put(&w, win->percentiles[j], 4);
+        }
+        put(&w, win->fraction_bright_pixels, 2);
+        put(&w, win->tone_mapping_flag, 1);
+        if (win->tone_mapping_flag) {
+            put(&w, win->knee_point_x, 2);
+            put(&w, win->knee_point_y, 2);
+            put(&w, win->num_anchors, 1);
+            for (int j = 0; j < win->num_anchors; j++)
+                put(&w, win->anchors[j], 2);
+        }
+        put(&w, win->color_saturation_mapping_flag, 1);
+        if (win->color_saturation_mapping_flag)
+            put(&w, win->color_saturation_weight, 1);
+    }
+    return w.pos;
+}
+
+/* inverse of serialize, returns -1 if buf is truncated or invalid */
+static int deserialize(const uint8_t *buf, size_t size, hdr10plus *md) {
+    le_reader r = {.buf = buf, .size = size};
+    memset(md, 0, sizeof(hdr10plus));
+    md->application_version = get(&r, 1);
+    md->num_windows = get(&r, 1);
+    md->targeted_max_luminance = get(&r, 4);
+    md->targeted_peak_flag = get(&r, 1);
+    md->mastering_peak_flag = get(&r, 1);
+    if (md->num_windows > 3)
+        return -1;
+    for (int i = 0; i < md->num_windows; i++) {
+        hdr10plus_window *win = &md->windows[i];
+        if (i > 0) {
+            win->upper_left_x = get(&r, 2);
+            win->upper_left_y = get(&r, 2);
+            win->lower_right_x = get(&r, 2);
+            win->lower_right_y = get(&r, 2);
+            win->center_x = get(&r, 2);
+            win->center_y = get(&r, 2);
+            win->rotation_angle = get(&r, 1);
+            win->semimajor_internal = get(&r, 2);
+            win->semimajor_external = get(&r, 2);
+            win->semiminor_external = get(&r, 2);
+            win->overlap_process_option = get(&r, 1);
+        }
+        for (int c = 0; c < 3; c++)
+            win->maxscl[c] = get(&r, 4);
+        win->average_maxrgb = get(&r, 4);
+        win->num_percentiles = get(&r, 1);
+        if (win->num_percentiles > 15)
+            return -1;
+        for (int j = 0; j < win->num_percentiles; j++) {
+            win->percentages[j] = get(&r, 1);
+            win->percentiles[j] = get(&r, 4);
+        }
+        win->fraction_bright_pixels = get(&r, 2);
+        win->tone_mapping_flag = get(&r, 1);
+        if (win->tone_mapping_flag) {
+            win->knee_point_x = get(&r, 2);
+            win->knee_point_y = get(&r, 2);
+            win->num_anchors = get(&r, 1);
+            if (win->num_anchors > 15)
+                return -1;
+            for (int j = 0; j < win->num_anchors; j++)
+                win->anchors[j] = get(&r, 2);
+        }
+        win->color_saturation_mapping_flag = get(&r, 1);
+        if (win->color_saturation_mapping_flag)
+            win->color_saturation_weight = get(&r, 1);
+    }
+    return r.overrun ? -1 : 0;
+}
+
+static void write_header(uint8_t *buf, const dynidx_header *hdr) {
+    le_writer w = {.buf = buf};
+    memset(buf, 0, DYNIDX_HEADER_SIZE);
+    memcpy(buf, DYNIDX_MAGIC, 8);
+    w.pos = 8;
+    put(&w, hdr->version, 4);
+    put(&w, 0, 4); /* reserved */
+    put(&w, hdr->frames, 8);
+    put(&w, hdr->records, 8);
+    put(&w, hdr->index_offset, 8);
+}
+
+static int write_error(const char *msg) {
+    md_error_custom(msg);
+    return -1;
+}
+
+dynidx_writer *dynidx_writer_open(FILE *ostream) {
+    if (fseeko(ostream, 0, SEEK_SET) < 0) {
+        md_error_custom("Binary output needs a seekable output file");
+        return NULL;
+    }
+    FILE *index = tmpfile();
+    if (index == NULL) {
+        md_error_custom(strerror(errno));
+        return NULL;
+    }
+    dynidx_writer *w = md_calloc(1, sizeof(dynidx_writer));
+    w->ostream = ostream;
+    w->index = index;
+    w->hdr.version = DYNIDX_VERSION;
+    w->offset = DYNIDX_HEADER_SIZE;
+
+    /* placeholder without magic, completed by dynidx_finish */
+    uint8_t header[DYNIDX_HEADER_SIZE] = {0};
+    if (fwrite(header, DYNIDX_HEADER_SIZE, 1, ostream) != 1) {
+        dynidx_abort(w);
+        md_error_custom("Could not write binary output");
+        return NULL;
+    }
+    return w;
+}
+
+int dynidx_write(dynidx_writer *w, const hdr10plus *md) {
+    uint8_t rec[DYNIDX_MAX_RECORD];
+    size_t size = serialize(md, rec);
+
+    /* frames of a scene usually share their metadata */
+    if (w->hdr.records == 0 || size != w->last_size ||
+        memcmp(rec, w->last, size)) {
+        uint8_t len[2] = {(uint8_t)size, (uint8_t)(size >> 8)};
+        if (fwrite(len, 2, 1, w->ostream) != 1 ||
+            fwrite(rec, size, 1, w->ostream) != 1)
+            return write_error("Could not write binary output");
+        memcpy(w->last, rec, size);
+        w->last_size = size;
+        w->last_offset = w->offset;
+        w->offset += 2 + size;
+        w->hdr.records++;
+    }
+
+    uint8_t entry[8];
+    le_writer e = {.buf = entry};
+    put(&e, w->last_offset, 8);
+    if (fwrite(entry, 8, 1, w->index) != 1)
+        return write_error("Could not write index");
+    w->hdr.frames++;
+    return 0;
+}
+
+void dynidx_abort(dynidx_writer *w) {
+    fclose(w->index);
+    free(w);
+}
+
+int dynidx_finish(dynidx_writer *w) {
+    int ret = 0;
+    /* the index is 8-byte aligned for mapped access */
+    static const uint8_t pad[8];
+    size_t padding = (8 - w->offset % 8) % 8;
+    if (padding && fwrite(pad, padding, 1, w->ostream) != 1)
+        ret = write_error("Could not write binary output");
+    w->hdr.index_offset = w->offset + padding;
+
+    uint8_t buf[8 * 1024];
+    rewind(w->index);
+    size_t n;
+    while (ret == 0 && (n = fread(buf, 1, sizeof(buf), w->index)) > 0) {
+        if (fwrite(buf, n, 1, w->ostream) != 1)
+            ret = write_error("Could not write index");
+    }
+
+    uint8_t header[DYNIDX_HEADER_SIZE];
+    write_header(header, &w->hdr);
+    if (ret == 0 && (fseeko(w->ostream, 0, SEEK_SET) < 0 ||
+                     fwrite(header, DYNIDX_HEADER_SIZE, 1, w->ostream) != 1 ||
+                     fseeko(w->ostream, 0, SEEK_END) < 0))
+        ret = write_error("Could not write binary output header");
+    dynidx_abort(w);
+    return ret;
+}
+
+dynidx_reader *dynidx_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        md_error_custom(strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < DYNIDX_HEADER_SIZE) {
+        close(fd);
+        md_error_custom("Not a binary dynamic metadata file");
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        md_error_custom(strerror(errno));
+        return NULL;
+    }
+    dynidx_reader *r = md_malloc(sizeof(dynidx_reader));
+    r->map = map;
+    r->size = st.st_size;
+
+    le_reader h = {.buf = r->map, .size = DYNIDX_HEADER_SIZE, .pos = 8};
+    r->hdr.version = get(&h, 4);
+    get(&h, 4);
+    r->hdr.frames = get(&h, 8);
+    r->hdr.records = get(&h, 8);
+    r->hdr.index_offset = get(&h, 8);
+    if (memcmp(r->map, DYNIDX_MAGIC, 8) || r->hdr.version != DYNIDX_VERSION ||
+        r->hdr.index_offset > r->size ||
+        (r->size - r->hdr.index_offset) / 8 < r->hdr.frames) {
+        dynidx_close(r);
+        md_error_custom("Not a binary dynamic metadata file");
+        return NULL;
+    }
+    return r;
+}
+
+int dynidx_get(const dynidx_reader *r, uint64_t frame, hdr10plus *out) {
+    if (frame >= r->hdr.frames) {
+        md_error_custom("Frame is not in the binary dynamic metadata file");
+        return -1;
+    }
+    uint64_t offset = get_at(r->map + r->hdr.index_offset + frame * 8, 8);
+    if (offset + 2 > r->hdr.index_offset)
+        return write_error("Corrupt binary dynamic metadata file");
+    size_t size = get_at(r->map + offset, 2);
+    if (offset + 2 + size > r->hdr.index_offset ||
+        deserialize(r->map + offset + 2, size, out) < 0)
+        return write_error("Corrupt binary dynamic metadata file");
+    return 0;
+}
+
+void dynidx_close(dynidx_reader *r) {
+    munmap((void *)r->map, r->size);
+    free(r);
+}
+
+int dynidx_to_json(const dynidx_reader *r, FILE *ostream) {
+    hdr10plus md;
+    for (uint64_t i = 0; i < r->hdr.frames; i++) {
+        if (dynidx_get(r, i, &md) < 0)
+            return -1;
+        dyn_json_frame(ostream, &md, i);
+    }
+    dyn_json_end(ostream, r->hdr.frames);
+    return 0;
+}
@@ -0,0 +1,79 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_DYNINDEX
+#define _INCL_DYNINDEX
+
+#include "hdr10plus.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Binary container for per-frame HDR10+ metadata. All numbers are little
+ * endian.
+ *
+ *   header   DYNIDX_HEADER_SIZE bytes, see dynidx_header
+ *   records  u16 size followed by size bytes of a serialized hdr10plus,
+ *            consecutive frames with identical metadata share one record
+ *   index    u64 file offset of the record of every frame, 8-byte aligned
+ *
+ * The index allows to look up any frame in O(1) from a mapping of the
+ * file. */
+#define DYNIDX_MAGIC "MDDYNIX1"
+#define DYNIDX_VERSION 1
+#define DYNIDX_HEADER_SIZE 64
+/* upper bound of a serialized record */
+#define DYNIDX_MAX_RECORD 512
+
+typedef struct dynidx_header {
+    uint32_t version;
+    uint64_t frames;
+    uint64_t records;
+    uint64_t index_offset;
+} dynidx_header;
+
+typedef struct dynidx_writer {
+    FILE *ostream;
+    FILE *index; /* spilled index entries, appended by dynidx_finish */
+    uint64_t offset; /* of the next record in ostream */
+    dynidx_header hdr;
+    uint8_t last[DYNIDX_MAX_RECORD]; /* serialized metadata of the last frame */
+    size_t last_size;
+    uint64_t last_offset;
+} dynidx_writer;
+
+/* dynidx_writer_open starts a container in the seekable stream ostream. The
+ * writer keeps only the last record in memory. Returns NULL and sets an
+ * error if ostream cannot be used. */
+dynidx_writer *dynidx_writer_open(FILE *ostream);
+
+/* dynidx_write appends the metadata of the next frame. Returns -1 and sets
+ * an error on failure. */
+int dynidx_write(dynidx_writer *w, const hdr10plus *md);
+
+/* dynidx_finish appends the index, completes the header and frees w.
+ * Returns -1 and sets an error on failure. */
+int dynidx_finish(dynidx_writer *w);
+
+/* dynidx_abort frees w without completing the container */
+void dynidx_abort(dynidx_writer *w);
+
+typedef struct dynidx_reader {
+    const uint8_t *map;
+    size_t size;
+    dynidx_header hdr;
+} dynidx_reader;
+
+/* dynidx_open maps the container at path. Returns NULL and sets an error if
+ * it is not a valid container. */
+dynidx_reader *dynidx_open(const char *path);
+
+/* dynidx_get decodes the metadata of frame. Returns -1 and sets an error if
+ * the frame does not exist or the record is corrupt. */
+int dynidx_get(const dynidx_reader *r, uint64_t frame, hdr10plus *out);
+
+/* dynidx_close unmaps r and frees it */
+void dynidx_close(dynidx_reader *r);
+
+/* dynidx_to_json writes the frames of r as x265 --dhdr10-info JSON */
+int dynidx_to_json(const dynidx_reader *r, FILE *ostream);
+
+#endif
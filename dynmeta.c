@@ -0,0 +1,64 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "dynmeta.h"
+#include "hdr10plus.h"
+#include <stdint.h>
+#include <stdio.h>
+
+static void json_header(FILE *ostream, char profile) {
+    fprintf(ostream,
+            "{\"JSONInfo\":{\"HDR10plusProfile\":\"%c\",\"Version\":\"1.0\"},"
+            "\"SceneInfo\":[\n",
+            profile);
+}
+
+static void json_array(FILE *ostream, const char *name, const uint32_t *val,
+                       int n) {
+    fprintf(ostream, "\"%s\":[", name);
+    for (int i = 0; i < n; i++)
+        fprintf(ostream, i ? ",%u" : "%u", val[i]);
+    fprintf(ostream, "]");
+}
+
+void dyn_json_frame(FILE *ostream, const hdr10plus *md, uint64_t index) {
+    /* x265 applies the first window to the whole picture */
+    const hdr10plus_window *win = &md->windows[0];
+    if (index == 0)
+        json_header(ostream, win->tone_mapping_flag ? 'B' : 'A');
+    else
+        fprintf(ostream, ",\n");
+
+    uint32_t percentages[15];
+    uint32_t anchors[15];
+    for (int i = 0; i < win->num_percentiles; i++)
+        percentages[i] = win->percentages[i];
+    for (int i = 0; i < win->num_anchors; i++)
+        anchors[i] = win->anchors[i];
+
+    fprintf(ostream, "{\"LuminanceParameters\":{\"AverageRGB\":%u,"
+                     "\"LuminanceDistributions\":{",
+            win->average_maxrgb);
+    json_array(ostream, "DistributionIndex", percentages, win->num_percentiles);
+    fprintf(ostream, ",");
+    json_array(ostream, "DistributionValues", win->percentiles,
+               win->num_percentiles);
+    fprintf(ostream, "},");
+    json_array(ostream, "MaxScl", win->maxscl, 3);
+    fprintf(ostream,
+            "},\"NumberOfWindows\":%u,"
+            "\"TargetedSystemDisplayMaximumLuminance\":%u,",
+            md->num_windows, md->targeted_max_luminance);
+    if (win->tone_mapping_flag) {
+        fprintf(ostream, "\"BezierCurveData\":{");
+        json_array(ostream, "Anchors", anchors, win->num_anchors);
+        fprintf(ostream, ",\"KneePointX\":%u,\"KneePointY\":%u},",
+                win->knee_point_x, win->knee_point_y);
+    }
+    fprintf(ostream, "\"SequenceFrameIndex\":%llu}",
+            (unsigned long long)index);
+}
+
+void dyn_json_end(FILE *ostream, uint64_t frames) {
+    if (frames == 0)
+        json_header(ostream, 'A');
+    fprintf(ostream, "\n]}\n");
+}
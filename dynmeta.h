@@ -0,0 +1,20 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_DYNMETA
+#define _INCL_DYNMETA
+
+#include "hdr10plus.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* The dyn_json functions stream HDR10+ metadata in the JSON format of x265's
+ * --dhdr10-info option. Frames are written one per line so the output never
+ * has to be held in memory. */
+
+/* dyn_json_frame writes frame number index, the document header is written
+ * in front of the first frame */
+void dyn_json_frame(FILE *ostream, const hdr10plus *md, uint64_t index);
+
+/* dyn_json_end finishes a document that contains frames frames */
+void dyn_json_end(FILE *ostream, uint64_t frames);
+
+#endif
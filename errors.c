@@ -5,8 +5,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-md_error_t global_md_error = ERR_NONE;
-static const char *error_msg = NULL;
+_Thread_local md_error_t global_md_error = ERR_NONE;
+static _Thread_local const char *error_msg = NULL;
 
 const char *global_md_error_str(md_error_t err) {
     switch (err) {
@@ -6,8 +6,8 @@
 
 typedef enum { ERR_NONE = 0, ERR_OUTOFRANGE, ERR_INPUT, ERR_CUSTOM } md_error_t;
 
-/* program-wide error variable */
-extern md_error_t global_md_error;
+/* program-wide error variable, every thread has its own */
+extern _Thread_local md_error_t global_md_error;
 
 /* global_md_error_str returns an error message for the given error */
 const char *global_md_error_str(md_error_t err);
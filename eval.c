@@ -13,7 +13,6 @@
 #include <string.h>
 
 /* forward declarations */
-static void eval_err_undefined(cmdline_switch *sw);
 static void eval_err_class_mismatch(cmdline_switch *sw);
 
 eval_container *eval_container_alloc() {
@@ -22,16 +21,45 @@ eval_container *eval_container_alloc() {
     ct->output_file = NULL;
     ct->col = disp_meta_alloc();
     ct->lum = disp_lum_alloc();
-    ct->ffinput = NULL;
+    ct->ffinputs = NULL;
+    ct->nb_ffinputs = 0;
     ct->ffdynamic = false;
+    ct->ffcll = false;
+    ct->ffdeadline = 0;
+    ct->ffmaxbytes = 0;
+    ct->ffstats = false;
+    ct->ffscan = NULL;
+    ct->ffwatch = NULL;
+    ct->ffthreads = 0;
+    ct->ffcheckpoint = 0;
+    ct->ffresume = false;
+    ct->fffulldecode = false;
+    ct->ffbinary = false;
+    ct->fftojson = NULL;
+    ct->fftrace = NULL;
+    ct->ffalltracks = false;
+    ct->ffcompare = NULL;
+    ct->ffmaxdiffs = 1;
+    ct->fffollow = -1;
     return ct;
 }
 
 void eval_container_free(eval_container *ct) {
     if (ct->output_file)
         free(ct->output_file);
-    if (ct->ffinput)
-        free(ct->ffinput);
+    for (size_t i = 0; i < ct->nb_ffinputs; i++)
+        free(ct->ffinputs[i]);
+    free(ct->ffinputs);
+    if (ct->ffscan)
+        free(ct->ffscan);
+    if (ct->ffwatch)
+        free(ct->ffwatch);
+    if (ct->fftojson)
+        free(ct->fftojson);
+    if (ct->fftrace)
+        free(ct->fftrace);
+    if (ct->ffcompare)
+        free(ct->ffcompare);
     if (ct->col)
         disp_meta_free(ct->col);
     if (ct->lum)
@@ -85,7 +113,7 @@ static bool is_zero(const char *input) {
     return true;
 }
 
-static double parse_double(const char *input) {
+double parse_double(const char *input) {
     double d = atof(input);
     if (d == 0 &&
         !is_zero(
@@ -124,6 +152,18 @@ static double eval_lum(char **input, int elements) {
     return parse_double(input[0]);
 }
 
+/* evaluates a single non-negative number */
+static double eval_budget(char **input, int elements) {
+    if (elements != 1) {
+        global_md_error = ERR_INPUT;
+        return 0;
+    }
+    double d = parse_double(input[0]);
+    if (global_md_error == ERR_NONE && d < 0)
+        global_md_error = ERR_OUTOFRANGE;
+    return d;
+}
+
 char *eval_file(char **input, int elements) {
     if (elements != 1) {
         global_md_error = ERR_INPUT;
@@ -132,53 +172,193 @@ char *eval_file(char **input, int elements) {
     return md_strdup(input[0]);
 }
 
-eval_container *eval_cmdline(eval_container *ct, cmdline_switch *sw) {
-    if (sw == NULL)
-        return ct; // base case
-    if (!strcmp("-r", sw->id)) {
-        eval_container_type(ct, EVAL_PRIMARY, sw);
-        ct->col->r = eval_point(sw->args, sw->argc);
-    } else if (!strcmp("-g", sw->id)) {
-        eval_container_type(ct, EVAL_PRIMARY, sw);
-        ct->col->g = eval_point(sw->args, sw->argc);
-    } else if (!strcmp("-b", sw->id)) {
-        eval_container_type(ct, EVAL_PRIMARY, sw);
-        ct->col->b = eval_point(sw->args, sw->argc);
-    } else if (!strcmp("-wp", sw->id)) {
-        eval_container_type(ct, EVAL_PRIMARY, sw);
-        ct->col->wp = eval_point(sw->args, sw->argc);
-    } else if (!strcmp("-lmin", sw->id)) {
-        eval_container_type(ct, EVAL_PRIMARY, sw);
-        ct->lum->min = eval_lum(sw->args, sw->argc);
-    } else if (!strcmp("-lmax", sw->id)) {
-        eval_container_type(ct, EVAL_PRIMARY, sw);
-        ct->lum->max = eval_lum(sw->args, sw->argc);
-    } else if (!strcmp("-i", sw->id)) {
-        eval_container_type(ct, EVAL_FFMPEG, sw);
-        ct->ffinput = eval_file(sw->args, sw->argc);
-    } else if (!strcmp("-dynamic", sw->id)) {
-        eval_container_type(ct, EVAL_FFMPEG, sw);
-        ct->ffdynamic = true;
-    } else if (!strcmp("-o", sw->id)) {
-        ct->output_file = eval_file(sw->args, sw->argc);
-    } else
-        eval_err_undefined(sw);
-    if (global_md_error != ERR_NONE)
-        return NULL;
-    return eval_cmdline(ct, sw->next);
+typedef enum {
+    SW_ALLTRACKS,
+    SW_B,
+    SW_BINARY,
+    SW_CHECKPOINT,
+    SW_CLL,
+    SW_COMPARE,
+    SW_DEADLINE,
+    SW_DYNAMIC,
+    SW_FOLLOW,
+    SW_FULLDECODE,
+    SW_G,
+    SW_I,
+    SW_LMAX,
+    SW_LMIN,
+    SW_MAXBYTES,
+    SW_MISMATCHES,
+    SW_O,
+    SW_R,
+    SW_RESUME,
+    SW_SCAN,
+    SW_STATS,
+    SW_THREADS,
+    SW_TOJSON,
+    SW_TRACE,
+    SW_WATCH,
+    SW_WP,
+} eval_switch_id;
+
+typedef struct eval_switch {
+    cmdline_spec spec; /* must be the first member */
+    eval_switch_id id;
+    eval_class type;
+} eval_switch;
+
+/* sorted by name for cmdline_parse */
+static const eval_switch eval_switches[] = {
+    {{"-alltracks", false}, SW_ALLTRACKS, EVAL_FFMPEG},
+    {{"-b", false}, SW_B, EVAL_PRIMARY},
+    {{"-binary", false}, SW_BINARY, EVAL_FFMPEG},
+    {{"-checkpoint", false}, SW_CHECKPOINT, EVAL_FFMPEG},
+    {{"-cll", false}, SW_CLL, EVAL_FFMPEG},
+    {{"-compare", false}, SW_COMPARE, EVAL_FFMPEG},
+    {{"-deadline", false}, SW_DEADLINE, EVAL_FFMPEG},
+    {{"-dynamic", false}, SW_DYNAMIC, EVAL_FFMPEG},
+    {{"-follow", false}, SW_FOLLOW, EVAL_FFMPEG},
+    {{"-fulldecode", false}, SW_FULLDECODE, EVAL_FFMPEG},
+    {{"-g", false}, SW_G, EVAL_PRIMARY},
+    {{"-i", true}, SW_I, EVAL_FFMPEG},
+    {{"-lmax", false}, SW_LMAX, EVAL_PRIMARY},
+    {{"-lmin", false}, SW_LMIN, EVAL_PRIMARY},
+    {{"-maxbytes", false}, SW_MAXBYTES, EVAL_FFMPEG},
+    {{"-mismatches", false}, SW_MISMATCHES, EVAL_FFMPEG},
+    {{"-o", false}, SW_O, EVAL_GLOBAL},
+    {{"-r", false}, SW_R, EVAL_PRIMARY},
+    {{"-resume", false}, SW_RESUME, EVAL_FFMPEG},
+    {{"-scan", false}, SW_SCAN, EVAL_FFMPEG},
+    {{"-stats", false}, SW_STATS, EVAL_FFMPEG},
+    {{"-threads", false}, SW_THREADS, EVAL_FFMPEG},
+    {{"-tojson", false}, SW_TOJSON, EVAL_FFMPEG},
+    {{"-trace", false}, SW_TRACE, EVAL_FFMPEG},
+    {{"-watch", false}, SW_WATCH, EVAL_FFMPEG},
+    {{"-wp", false}, SW_WP, EVAL_PRIMARY},
+};
+
+cmdline *eval_parse(int argc, char **argv) {
+    return cmdline_parse(argc, argv, eval_switches,
+                         sizeof(eval_switches) / sizeof(eval_switch),
+                         sizeof(eval_switch));
 }
 
-/* thrown if an unknown command line switch is encountered */
-static void eval_err_undefined(cmdline_switch *sw) {
-    const size_t len = 128;
-    char *msg = md_malloc(len);
-    snprintf(msg, len, "Unknown command line switch \"%s\"", sw->id);
-    md_error_custom(msg);
+/* appends the files of every -i switch of cl to ct, the list is allocated
+ * once for all of them */
+static void eval_inputs(eval_container *ct, const cmdline *cl,
+                        cmdline_switch *sw) {
+    if (sw->argc == 0) {
+        global_md_error = ERR_INPUT;
+        return;
+    }
+    if (ct->ffinputs == NULL) {
+        size_t total = 0;
+        for (size_t i = 0; i < cl->nb_switches; i++) {
+            const eval_switch *es = (const eval_switch *)cl->switches[i].spec;
+            if (es->id == SW_I)
+                total += cl->switches[i].argc;
+        }
+        ct->ffinputs = md_malloc(total * sizeof(char *));
+    }
+    for (size_t i = 0; i < sw->argc; i++)
+        ct->ffinputs[ct->nb_ffinputs++] = md_strdup(sw->args[i]);
+}
+
+eval_container *eval_cmdline(eval_container *ct, const cmdline *cl) {
+    for (size_t i = 0; i < cl->nb_switches; i++) {
+        cmdline_switch *sw = &cl->switches[i];
+        const eval_switch *es = (const eval_switch *)sw->spec;
+        if (es->type != EVAL_GLOBAL)
+            eval_container_type(ct, es->type, sw);
+        switch (es->id) {
+        case SW_R:
+            ct->col->r = eval_point(sw->args, sw->argc);
+            break;
+        case SW_G:
+            ct->col->g = eval_point(sw->args, sw->argc);
+            break;
+        case SW_B:
+            ct->col->b = eval_point(sw->args, sw->argc);
+            break;
+        case SW_WP:
+            ct->col->wp = eval_point(sw->args, sw->argc);
+            break;
+        case SW_LMIN:
+            ct->lum->min = eval_lum(sw->args, sw->argc);
+            break;
+        case SW_LMAX:
+            ct->lum->max = eval_lum(sw->args, sw->argc);
+            break;
+        case SW_I:
+            eval_inputs(ct, cl, sw);
+            break;
+        case SW_DYNAMIC:
+            ct->ffdynamic = true;
+            break;
+        case SW_ALLTRACKS:
+            ct->ffalltracks = true;
+            break;
+        case SW_BINARY:
+            ct->ffbinary = true;
+            break;
+        case SW_TOJSON:
+            ct->fftojson = eval_file(sw->args, sw->argc);
+            break;
+        case SW_TRACE:
+            ct->fftrace = eval_file(sw->args, sw->argc);
+            break;
+        case SW_COMPARE:
+            ct->ffcompare = eval_file(sw->args, sw->argc);
+            break;
+        case SW_MISMATCHES:
+            ct->ffmaxdiffs = (uint64_t)eval_budget(sw->args, sw->argc);
+            break;
+        case SW_FOLLOW:
+            ct->fffollow = eval_budget(sw->args, sw->argc);
+            break;
+        case SW_FULLDECODE:
+            ct->fffulldecode = true;
+            break;
+        case SW_CLL:
+            ct->ffcll = true;
+            break;
+        case SW_DEADLINE:
+            ct->ffdeadline = eval_budget(sw->args, sw->argc);
+            break;
+        case SW_MAXBYTES:
+            ct->ffmaxbytes = (uint64_t)eval_budget(sw->args, sw->argc);
+            break;
+        case SW_STATS:
+            ct->ffstats = true;
+            break;
+        case SW_SCAN:
+            ct->ffscan = eval_file(sw->args, sw->argc);
+            break;
+        case SW_WATCH:
+            ct->ffwatch = eval_file(sw->args, sw->argc);
+            break;
+        case SW_THREADS:
+            ct->ffthreads = (unsigned)eval_budget(sw->args, sw->argc);
+            break;
+        case SW_CHECKPOINT:
+            ct->ffcheckpoint = eval_budget(sw->args, sw->argc);
+            break;
+        case SW_RESUME:
+            ct->ffresume = true;
+            break;
+        case SW_O:
+            ct->output_file = eval_file(sw->args, sw->argc);
+            break;
+        }
+        if (global_md_error != ERR_NONE)
+            return NULL;
+    }
+    return ct;
 }
 
 static void eval_err_class_mismatch(cmdline_switch *sw) {
     const size_t len = 128;
     char *msg = md_malloc(len);
-    snprintf(msg, len, "Class mismatch for switch \"%s\"", sw->id);
+    snprintf(msg, len, "Class mismatch for switch \"%s\"", sw->spec->id);
     md_error_custom(msg);
 }
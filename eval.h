@@ -5,6 +5,7 @@
 #include "cmdline.h"
 #include "mdinfo.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum {
     EVAL_UNDEFINED, /*unknown switch*/
@@ -23,13 +24,38 @@ typedef struct eval_container {
     disp_meta *col;
     disp_lum *lum;
     /* ffmpeg options */
-    char *ffinput;
+    char **ffinputs; /* files of every -i switch */
+    size_t nb_ffinputs;
     bool ffdynamic;
+    bool ffcll;          /* also extract the content light level */
+    double ffdeadline;   /* wall-clock budget in seconds, 0 means none */
+    uint64_t ffmaxbytes; /* byte budget, 0 means none */
+    bool ffstats;        /* print probe statistics */
+    char *ffscan;        /* root of a directory tree to scan */
+    char *ffwatch;       /* hot folder to watch */
+    unsigned ffthreads;  /* worker threads, 0 means one per CPU */
+    double ffcheckpoint; /* seconds between checkpoints, 0 means none */
+    bool ffresume;       /* resume a full scan from its checkpoint */
+    bool fffulldecode;   /* decode with the decoder defaults */
+    bool ffbinary;       /* write -dynamic output as binary container */
+    char *fftojson;      /* binary container to convert to JSON */
+    char *fftrace;       /* Chrome trace-event output */
+    bool ffalltracks;    /* probe every HEVC track */
+    char *ffcompare;     /* encode to compare the input with */
+    uint64_t ffmaxdiffs; /* mismatches that end a comparison, 0 means none */
+    double fffollow;     /* idle seconds that end -follow, < 0 means off */
 } eval_container;
 
 eval_container *eval_container_alloc();
 void eval_container_free(eval_container *ct);
 
-eval_container *eval_cmdline(eval_container *ct, cmdline_switch *sw);
+/* parse_double parses input as floating-point value, sets an error if it is
+ * not a number */
+double parse_double(const char *input);
+
+/* eval_parse parses the command line with the switches eval_cmdline knows */
+cmdline *eval_parse(int argc, char **argv);
+
+eval_container *eval_cmdline(eval_container *ct, const cmdline *cl);
 
 #endif
@@ -0,0 +1,183 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "ffio.h"
+#include "budget.h"
+#include "errors.h"
+#include "wrappers.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <libavformat/avio.h>
+#include <libavutil/avutil.h>
+#include <libavutil/error.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FFIO_BUFSIZE 32768
+
+bool ffio_is_stream(const char *path) {
+    if (!strcmp(path, "-"))
+        return true;
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+    return S_ISFIFO(st.st_mode);
+}
+
+/* set by SIGINT and SIGTERM while a file is followed */
+static volatile sig_atomic_t follow_stop = 0;
+
+static void follow_signal(int sig) {
+    (void)sig;
+    follow_stop = 1;
+}
+
+/* waits until the followed file s was modified. Returns 0 if it was and
+ * AVERROR_EOF if the wait ended. */
+static int ffio_wait(ffio_stream *s) {
+    if (s->on_wait)
+        s->on_wait(s->opaque);
+    while (!follow_stop) {
+        int64_t end = s->idle > 0 ? s->last_data + s->idle : 0;
+        if (s->deadline > 0 && (end == 0 || s->deadline < end))
+            end = s->deadline;
+        int timeout = -1;
+        if (end > 0) {
+            int64_t now = budget_now();
+            if (now >= end)
+                return AVERROR_EOF;
+            int64_t ms = (end - now + 999999) / 1000000;
+            timeout = ms > INT_MAX ? INT_MAX : (int)ms;
+        }
+        struct pollfd pfd = {.fd = s->ifd, .events = POLLIN};
+        int ready = poll(&pfd, 1, timeout);
+        if (ready < 0 && errno != EINTR)
+            return AVERROR(errno);
+        if (ready > 0) {
+            /* the events only wake us up, the read tells what is new */
+            _Alignas(struct inotify_event) char buf[4096];
+            while (read(s->ifd, buf, sizeof(buf)) > 0)
+                ;
+            return 0;
+        }
+    }
+    return AVERROR_EOF;
+}
+
+static int ffio_read(void *opaque, uint8_t *buf, int buf_size) {
+    ffio_stream *s = opaque;
+    if (s->fd < 0)
+        return AVERROR_EOF;
+    while (true) {
+        /* a writer that stays ahead would never let the stream wait */
+        if (s->follow && follow_stop)
+            return AVERROR_EOF;
+        ssize_t n = read(s->fd, buf, buf_size);
+        if (n > 0) {
+            if (s->ifd >= 0)
+                s->last_data = budget_now();
+            return n;
+        }
+        if (n == 0 && s->ifd < 0)
+            return AVERROR_EOF;
+        if (n == 0) {
+            /* a write that raced the read is already queued as event */
+            int ret = ffio_wait(s);
+            if (ret < 0)
+                return ret;
+            continue;
+        }
+        if (errno != EINTR)
+            return AVERROR(errno);
+    }
+}
+
+ffio_stream *ffio_open(const char *path) {
+    int fd = STDIN_FILENO;
+    if (strcmp(path, "-")) {
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            md_error_custom(strerror(errno));
+            return NULL;
+        }
+    }
+    ffio_stream *s = md_calloc(1, sizeof(ffio_stream));
+    s->fd = fd;
+    s->ifd = -1;
+    unsigned char *buf = av_malloc(FFIO_BUFSIZE);
+    if (buf == NULL) {
+        free(s);
+        md_error_custom("Could not allocate ffmpeg I/O buffer");
+        return NULL;
+    }
+    /* no seek callback: the demuxer must get along with linear reads */
+    s->avio =
+        avio_alloc_context(buf, FFIO_BUFSIZE, 0, s, &ffio_read, NULL, NULL);
+    if (s->avio == NULL) {
+        av_free(buf);
+        free(s);
+        md_error_custom("Could not allocate ffmpeg I/O context");
+        return NULL;
+    }
+    s->avio->seekable = 0;
+    return s;
+}
+
+ffio_stream *ffio_follow(const char *path, double idle, int64_t deadline,
+                         void (*on_wait)(void *opaque), void *opaque) {
+    ffio_stream *s = ffio_open(path);
+    if (s == NULL)
+        return NULL;
+    /* the watch exists before the first read, so no append is missed */
+    s->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (s->ifd < 0 || inotify_add_watch(s->ifd, path, IN_MODIFY) < 0) {
+        md_error_custom(strerror(errno));
+        ffio_free(s);
+        return NULL;
+    }
+    s->idle = (int64_t)(idle * 1e9);
+    s->deadline = deadline;
+    s->last_data = budget_now();
+    s->on_wait = on_wait;
+    s->opaque = opaque;
+
+    /* no SA_RESTART: the blocking poll must return on a signal */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = &follow_signal;
+    sigemptyset(&sa.sa_mask);
+    follow_stop = 0;
+    sigaction(SIGINT, &sa, &s->old_sigint);
+    sigaction(SIGTERM, &sa, &s->old_sigterm);
+    s->follow = true;
+    return s;
+}
+
+void ffio_shutdown(ffio_stream *s) {
+    if (s->ifd >= 0) {
+        close(s->ifd);
+        s->ifd = -1;
+    }
+    if (s->fd < 0)
+        return;
+    close(s->fd);
+    s->fd = -1;
+}
+
+void ffio_free(ffio_stream *s) {
+    ffio_shutdown(s);
+    if (s->follow) {
+        sigaction(SIGINT, &s->old_sigint, NULL);
+        sigaction(SIGTERM, &s->old_sigterm, NULL);
+    }
+    if (s->avio) {
+        av_freep(&s->avio->buffer);
+        avio_context_free(&s->avio);
+    }
+    free(s);
+}
@@ -0,0 +1,53 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_FFIO
+#define _INCL_FFIO
+
+#include <libavformat/avio.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* non-seekable input stream read through a custom AVIOContext */
+typedef struct ffio_stream {
+    int fd; /* -1 after ffio_shutdown */
+    AVIOContext *avio;
+    /* state of ffio_follow, ifd is -1 for other streams */
+    int ifd;           /* inotify instance watching the file */
+    int64_t idle;      /* ns without new data that end the stream, 0: none */
+    int64_t deadline;  /* monotonic clock in ns, 0 means none */
+    int64_t last_data; /* monotonic clock in ns of the last successful read */
+    void (*on_wait)(void *opaque);
+    void *opaque;
+    bool follow;                 /* the signal actions below are saved */
+    struct sigaction old_sigint; /* restored by ffio_free */
+    struct sigaction old_sigterm;
+} ffio_stream;
+
+/* ffio_is_stream returns true if path denotes the standard input ("-") or a
+ * FIFO */
+bool ffio_is_stream(const char *path);
+
+/* ffio_open opens path for reading without ever seeking. Returns NULL and sets
+ * an error on failure. */
+ffio_stream *ffio_open(const char *path);
+
+/* ffio_follow opens the regular file at path like ffio_open, but reads at its
+ * end wait until data is appended instead of reporting end of file. The wait
+ * blocks on inotify and ends the stream after idle seconds without new data
+ * (0 means never), at deadline (monotonic clock in ns, 0 means none) or once
+ * SIGINT or SIGTERM is received, whose actions are replaced until ffio_free.
+ * on_wait, if not NULL, is called with opaque before each wait. Returns NULL
+ * and sets an error on failure. */
+ffio_stream *ffio_follow(const char *path, double idle, int64_t deadline,
+                         void (*on_wait)(void *opaque), void *opaque);
+
+/* ffio_shutdown closes the file descriptors of the stream so that the
+ * producer on the other end of the pipe receives SIGPIPE/EPIPE. Further reads
+ * report end of file. */
+void ffio_shutdown(ffio_stream *s);
+
+/* ffio_free shuts the stream down if necessary and frees it, the signal
+ * actions replaced by ffio_follow are restored */
+void ffio_free(ffio_stream *s);
+
+#endif
@@ -1,37 +1,71 @@
 /* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
 
 #include "ffmpeg.h"
+#include "av1.h"
+#include "bdmv.h"
+#include "checkpoint.h"
+#include "dynindex.h"
+#include "dynmeta.h"
 #include "errors.h"
+#include "ffio.h"
+#include "hdr10plus.h"
+#include "hevcsei.h"
 #include "mdinfo.h"
+#include "mpegts.h"
+#include "mxf.h"
+#include "package.h"
+#include "trace.h"
 #include "wrappers.h"
+#include <errno.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/frame.h>
+#include <libavutil/hdr_dynamic_metadata.h>
 #include <libavutil/mastering_display_metadata.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 
 typedef struct ffbucket {
     AVFormatContext *fmt_ctx;
     AVCodecContext *dec_ctx;
-    AVCodec *decoder;
     AVFrame *frame;
     AVPacket *pkt;
+    ffio_stream *stream; /* custom I/O for pipes, NULL for regular files */
+    ff_registry *reg;
+    uint64_t bytes_base; /* bytes read before the AVFormatContext was opened */
+    /* one demux span per probe, per packet spans would swamp the trace */
+    int64_t demux_start; /* 0 before the first traced read */
+    int64_t demux_ns;
+    int64_t demux_packets;
 } ffbucket;
 
 static ffbucket *ffbucket_alloc() {
     ffbucket *bucket = md_malloc(sizeof(ffbucket));
     bucket->fmt_ctx = NULL;
     bucket->dec_ctx = NULL;
-    bucket->decoder = NULL;
     bucket->frame = NULL;
     bucket->pkt = NULL;
+    bucket->stream = NULL;
+    bucket->reg = NULL;
+    bucket->bytes_base = 0;
+    bucket->demux_start = 0;
+    bucket->demux_ns = 0;
+    bucket->demux_packets = 0;
     return bucket;
 }
 
 static void ffbucket_free(ffbucket *bucket) {
+    if (bucket->demux_start != 0) {
+        AVIOContext *pb = bucket->fmt_ctx ? bucket->fmt_ctx->pb : NULL;
+        trace_span("demux", bucket->demux_start, bucket->demux_ns, "packets",
+                   bucket->demux_packets, "bytes", pb ? pb->bytes_read : 0);
+    }
+    /* close the pipe first so the producer does not wait for the teardown */
+    if (bucket->stream)
+        ffio_shutdown(bucket->stream);
     if (bucket->pkt) {
         av_packet_unref(bucket->pkt);
         av_packet_free(&bucket->pkt);
@@ -42,11 +76,15 @@ static void ffbucket_free(ffbucket *bucket) {
         avcodec_free_context(&bucket->dec_ctx);
     if (bucket->fmt_ctx)
         avformat_close_input(&bucket->fmt_ctx);
+    if (bucket->stream)
+        ffio_free(bucket->stream);
     free(bucket);
 }
 
+/* sets msg as error and frees bucket, a NULL msg keeps the current error */
 static int fferror(ffbucket *bucket, const char *msg) {
-    md_error_custom(msg);
+    if (msg)
+        md_error_custom(msg);
     if (bucket)
         ffbucket_free(bucket);
     return -1;
@@ -83,138 +121,1332 @@ static void conv_lum(disp_lum *lum, AVMasteringDisplayMetadata *ffmeta) {
     lum->max = av_q2d(ffmeta->max_luminance);
 }
 
-int ffmpeg_access_sidedata(const char *path, FILE *ostream,
-                           ff_return_t (*recv_func)(FILE *, AVFrameSideData *),
-                           uint64_t frame_limit) {
-    /* initialize */
-    ffbucket *bucket = ffbucket_alloc();
+ff_registry *ff_registry_alloc() {
+    ff_registry *reg = md_calloc(1, sizeof(ff_registry));
+    return reg;
+}
+
+void ff_registry_free(ff_registry *reg) { free(reg); }
+
+ff_consumer *ff_registry_add(ff_registry *reg, ff_recv_func recv_func,
+                             FILE *ostream, void *opaque,
+                             const enum AVFrameSideDataType *types,
+                             size_t ntypes, uint64_t frame_limit) {
+    if (reg->nb_consumers >= FF_MAX_CONSUMERS) {
+        md_error_custom("Too many side data consumers");
+        return NULL;
+    }
+    size_t id = reg->nb_consumers++;
+    uint64_t bit = UINT64_C(1) << id;
+    ff_consumer *c = &reg->consumers[id];
+    c->recv_func = recv_func;
+    c->ostream = ostream;
+    c->opaque = opaque;
+    c->frame_limit = frame_limit;
+    c->done = false;
+    c->until_eof = false;
+
+    /* precompute the lookup table for the dispatch loop */
+    if (types == NULL) {
+        for (size_t i = 0; i < FF_SIDEDATA_TYPES; i++)
+            reg->filter[i] |= bit;
+    } else {
+        for (size_t i = 0; i < ntypes; i++) {
+            if ((unsigned)types[i] >= FF_SIDEDATA_TYPES)
+                md_bug(__FILE__, __LINE__, true);
+            reg->filter[types[i]] |= bit;
+        }
+    }
+    reg->active |= bit;
+    return c;
+}
+
+void ff_registry_set_budget(ff_registry *reg, double seconds,
+                            uint64_t byte_limit) {
+    reg->deadline = seconds;
+    reg->byte_limit = byte_limit;
+}
+
+void ff_registry_set_follow(ff_registry *reg, double idle) {
+    reg->follow = true;
+    reg->follow_idle = idle;
+}
+
+const char *ff_probe_status_str(ff_probe_status status) {
+    switch (status) {
+    case FF_PROBE_FOUND:
+        return "Side data found";
+    case FF_PROBE_MISSING:
+        return "Video stream does not contain the desired side data";
+    case FF_PROBE_BYTES:
+        return "Byte budget exhausted before the desired side data was found";
+    case FF_PROBE_TIMEOUT:
+        return "Deadline reached before the desired side data was found";
+    }
+    return "Undefined probe status";
+}
+
+void ff_stats_print(FILE *ostream, const ff_stats *stats) {
+    fprintf(ostream,
+            "%s: %llu packets, %llu frames, %llu bytes read in %.3f s "
+            "(%.3f s CPU)\n",
+            ff_probe_status_str(stats->status),
+            (unsigned long long)stats->packets,
+            (unsigned long long)stats->frames,
+            (unsigned long long)stats->bytes, stats->elapsed, stats->cpu);
+}
+
+/* drops consumers from the active set whose frame budget is exhausted */
+static void registry_update_budget(ff_registry *reg, uint64_t fc) {
+    for (size_t i = 0; i < reg->nb_consumers; i++) {
+        ff_consumer *c = &reg->consumers[i];
+        if (c->frame_limit > 0 && fc >= c->frame_limit)
+            reg->active &= ~(UINT64_C(1) << i);
+    }
+}
+
+/* hands sd to the interested consumers, skip collects the consumers that
+ * returned FFRET_BREAK for the current frame. Returns -1 if a consumer
+ * reported an error. */
+static int registry_dispatch_sd(ff_registry *reg, AVFrameSideData *sd,
+                                uint64_t *skip) {
+    if ((unsigned)sd->type >= FF_SIDEDATA_TYPES)
+        return 0;
+    uint64_t mask = reg->filter[sd->type] & reg->active & ~*skip;
+    for (size_t id = 0; mask != 0 && id < reg->nb_consumers; id++) {
+        uint64_t bit = UINT64_C(1) << id;
+        if (!(mask & bit))
+            continue;
+        mask &= ~bit;
+        ff_consumer *c = &reg->consumers[id];
+        int64_t span = trace_begin("side-data");
+        ff_return_t ret = c->recv_func(c->ostream, sd, c->opaque);
+        trace_end("side-data", span);
+        switch (ret) {
+        case FFRET_ERROR:
+            return -1;
+        case FFRET_DONE:
+            c->done = true;
+            reg->active &= ~bit;
+            break;
+        case FFRET_BREAK:
+            *skip |= bit;
+            break;
+        case FFRET_CONTINUE:
+            break;
+        }
+    }
+    return 0;
+}
+
+/* hands the side data of frame to the interested consumers. Returns -1 if a
+ * consumer reported an error. */
+static int registry_dispatch(ff_registry *reg, AVFrame *frame) {
+    uint64_t skip = 0;
+    for (int i = 0; i < frame->nb_side_data; i++) {
+        if (registry_dispatch_sd(reg, frame->side_data[i], &skip) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* dispatches side data that was not attached to a decoded frame, e.g. data
+ * read from the container or parsed from the bitstream */
+static int dispatch_synthetic(ff_registry *reg, enum AVFrameSideDataType type,
+                              void *data, size_t size) {
+    AVFrameSideData sd = {.type = type, .data = data, .size = size};
+    uint64_t skip = 0;
+    return registry_dispatch_sd(reg, &sd, &skip);
+}
+
+static void conv_hdr10plus(AVDynamicHDRPlus *dst, const hdr10plus *src) {
+    memset(dst, 0, sizeof(AVDynamicHDRPlus));
+    dst->itu_t_t35_country_code = 0xB5;
+    dst->application_version = src->application_version;
+    dst->num_windows = src->num_windows;
+    dst->targeted_system_display_maximum_luminance =
+        av_make_q(src->targeted_max_luminance, 1);
+    dst->targeted_system_display_actual_peak_luminance_flag =
+        src->targeted_peak_flag;
+    dst->mastering_display_actual_peak_luminance_flag =
+        src->mastering_peak_flag;
+    for (int w = 0; w < src->num_windows; w++) {
+        const hdr10plus_window *win = &src->windows[w];
+        AVHDRPlusColorTransformParams *par = &dst->params[w];
+        par->window_upper_left_corner_x = av_make_q(win->upper_left_x, 1);
+        par->window_upper_left_corner_y = av_make_q(win->upper_left_y, 1);
+        par->window_lower_right_corner_x = av_make_q(win->lower_right_x, 1);
+        par->window_lower_right_corner_y = av_make_q(win->lower_right_y, 1);
+        par->center_of_ellipse_x = win->center_x;
+        par->center_of_ellipse_y = win->center_y;
+        par->rotation_angle = win->rotation_angle;
+        par->semimajor_axis_internal_ellipse = win->semimajor_internal;
+        par->semimajor_axis_external_ellipse = win->semimajor_external;
+        par->semiminor_axis_external_ellipse = win->semiminor_external;
+        par->overlap_process_option = win->overlap_process_option;
+        for (int c = 0; c < 3; c++)
+            par->maxscl[c] = av_make_q(win->maxscl[c], 100000);
+        par->average_maxrgb = av_make_q(win->average_maxrgb, 100000);
+        par->num_distribution_maxrgb_percentiles = win->num_percentiles;
+        for (int i = 0; i < win->num_percentiles; i++) {
+            par->distribution_maxrgb[i].percentage = win->percentages[i];
+            par->distribution_maxrgb[i].percentile =
+                av_make_q(win->percentiles[i], 100000);
+        }
+        par->fraction_bright_pixels =
+            av_make_q(win->fraction_bright_pixels, 1000);
+        par->tone_mapping_flag = win->tone_mapping_flag;
+        par->knee_point_x = av_make_q(win->knee_point_x, 4095);
+        par->knee_point_y = av_make_q(win->knee_point_y, 4095);
+        par->num_bezier_curve_anchors = win->num_anchors;
+        for (int i = 0; i < win->num_anchors; i++)
+            par->bezier_curve_anchors[i] = av_make_q(win->anchors[i], 1023);
+        par->color_saturation_mapping_flag =
+            win->color_saturation_mapping_flag;
+        par->color_saturation_weight =
+            av_make_q(win->color_saturation_weight, 8);
+    }
+}
+
+static int dispatch_mastering(ff_registry *reg,
+                              AVMasteringDisplayMetadata *ffmeta) {
+    ffmeta->has_primaries = 1;
+    ffmeta->has_luminance = 1;
+    return dispatch_synthetic(reg, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA,
+                              ffmeta, sizeof(AVMasteringDisplayMetadata));
+}
+
+static int dispatch_cll(ff_registry *reg, unsigned max_cll,
+                        unsigned max_fall) {
+    AVContentLightMetadata cll;
+    memset(&cll, 0, sizeof(cll));
+    cll.MaxCLL = max_cll;
+    cll.MaxFALL = max_fall;
+    return dispatch_synthetic(reg, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL, &cll,
+                              sizeof(cll));
+}
+
+static int dispatch_hdr10plus(ff_registry *reg, const hdr10plus *md) {
+    AVDynamicHDRPlus *hdrplus = md_malloc(sizeof(AVDynamicHDRPlus));
+    conv_hdr10plus(hdrplus, md);
+    int ret = dispatch_synthetic(reg, AV_FRAME_DATA_DYNAMIC_HDR_PLUS, hdrplus,
+                                 sizeof(AVDynamicHDRPlus));
+    free(hdrplus);
+    return ret;
+}
+
+/* dispatches the HDR metadata found in AV1 metadata OBUs */
+static int dispatch_av1(ff_registry *reg, const av1_metadata *md) {
+    if (md->has_mdcv) {
+        AVMasteringDisplayMetadata ffmeta;
+        memset(&ffmeta, 0, sizeof(ffmeta));
+        for (int i = 0; i < 3; i++) {
+            ffmeta.display_primaries[i][0] =
+                av_make_q(md->mdcv.primaries[i][0], 1 << 16);
+            ffmeta.display_primaries[i][1] =
+                av_make_q(md->mdcv.primaries[i][1], 1 << 16);
+        }
+        ffmeta.white_point[0] = av_make_q(md->mdcv.white_point[0], 1 << 16);
+        ffmeta.white_point[1] = av_make_q(md->mdcv.white_point[1], 1 << 16);
+        ffmeta.max_luminance = av_make_q(md->mdcv.max_luminance, 1 << 8);
+        ffmeta.min_luminance = av_make_q(md->mdcv.min_luminance, 1 << 14);
+        if (dispatch_mastering(reg, &ffmeta) < 0)
+            return -1;
+    }
+    if (md->has_cll && dispatch_cll(reg, md->max_cll, md->max_fall) < 0)
+        return -1;
+    if (md->has_hdr10plus && dispatch_hdr10plus(reg, &md->hdr10plus) < 0)
+        return -1;
+    return 0;
+}
+
+/* dispatches the HDR metadata found in HEVC SEI messages */
+static int dispatch_hevc_sei(ff_registry *reg, const hevc_sei *sei) {
+    if (sei->has_mdcv) {
+        /* SEI order is green, blue, red */
+        const int mapping[3] = {2, 0, 1};
+        AVMasteringDisplayMetadata ffmeta;
+        memset(&ffmeta, 0, sizeof(ffmeta));
+        for (int i = 0; i < 3; i++) {
+            const int j = mapping[i];
+            ffmeta.display_primaries[i][0] =
+                av_make_q(sei->mdcv.primaries[j][0], 50000);
+            ffmeta.display_primaries[i][1] =
+                av_make_q(sei->mdcv.primaries[j][1], 50000);
+        }
+        ffmeta.white_point[0] = av_make_q(sei->mdcv.white_point[0], 50000);
+        ffmeta.white_point[1] = av_make_q(sei->mdcv.white_point[1], 50000);
+        ffmeta.max_luminance = av_make_q(sei->mdcv.max_luminance, 10000);
+        ffmeta.min_luminance = av_make_q(sei->mdcv.min_luminance, 10000);
+        if (dispatch_mastering(reg, &ffmeta) < 0)
+            return -1;
+    }
+    /* HDR10+ is left to the decoder, it attaches the metadata to the frames
+     * in presentation order while packets arrive in decode order */
+    if (sei->has_cll && dispatch_cll(reg, sei->max_cll, sei->max_fall) < 0)
+        return -1;
+    return 0;
+}
+
+/* dispatches the colour metadata the container stores for stream st */
+static int dispatch_stream_sidedata(ff_registry *reg, AVStream *st) {
+    int size = 0;
+    uint8_t *data = av_stream_get_side_data(
+        st, AV_PKT_DATA_MASTERING_DISPLAY_METADATA, &size);
+    if (data != NULL &&
+        dispatch_synthetic(reg, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA, data,
+                           size) < 0)
+        return -1;
+    data = av_stream_get_side_data(st, AV_PKT_DATA_CONTENT_LIGHT_LEVEL, &size);
+    if (data != NULL &&
+        dispatch_synthetic(reg, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL, data,
+                           size) < 0)
+        return -1;
+    return 0;
+}
+
+/* accounts the bytes libavformat read so far to the probe budget */
+static void update_bytes(ffbucket *bucket) {
+    if (bucket->fmt_ctx && bucket->fmt_ctx->pb)
+        bucket->reg->budget.bytes =
+            bucket->bytes_base + bucket->fmt_ctx->pb->bytes_read;
+}
+
+/* AVIO interrupt callback, aborts blocking I/O once the budget is exhausted */
+static int ffinterrupt(void *opaque) {
+    ffbucket *bucket = opaque;
+    update_bytes(bucket);
+    return budget_expired(&bucket->reg->budget);
+}
+
+/* av_read_frame into bucket->pkt, the time is added to the demux span */
+static int demux_read(ffbucket *bucket) {
+    int64_t start = trace_now();
+    int ret = av_read_frame(bucket->fmt_ctx, bucket->pkt);
+    if (start != 0) {
+        if (bucket->demux_start == 0)
+            bucket->demux_start = start;
+        bucket->demux_ns += trace_now() - start;
+    }
+    if (ret >= 0)
+        bucket->demux_packets++;
+    return ret;
+}
+
+/* reads the next packet of stream video_id into bucket->pkt. Returns 0 if the
+ * demuxer is exhausted, every consumer of reg is done or out of budget or the
+ * probe budget is exhausted. */
+static int read_video_packet(ffbucket *bucket, ff_registry *reg, int video_id,
+                             uint64_t fc) {
+    while (true) {
+        av_packet_unref(bucket->pkt);
+        int read_status = demux_read(bucket);
+        if (read_status < 0)
+            return 0; /* end of stream, error or interrupt */
+        update_bytes(bucket);
+        if (budget_expired(&reg->budget))
+            return 0;
+        registry_update_budget(reg, fc);
+        if (reg->active == 0)
+            return 0; /* every consumer is done or out of budget */
+        if (bucket->pkt->stream_index == video_id) {
+            reg->stats.packets++;
+            return 1;
+        }
+    }
+}
+
+/* keyframes a resumed full scan could restart from, in decode order */
+#define KEYFRAME_LOG 8
+typedef struct keyframe_log {
+    int64_t pts[KEYFRAME_LOG];
+    int64_t pos[KEYFRAME_LOG];
+    unsigned n;
+} keyframe_log;
+
+static void keyframe_log_add(keyframe_log *log, const AVPacket *pkt) {
+    if (!(pkt->flags & AV_PKT_FLAG_KEY))
+        return;
+    int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    if (ts == AV_NOPTS_VALUE)
+        return;
+    unsigned i = log->n++ % KEYFRAME_LOG;
+    log->pts[i] = ts;
+    log->pos[i] = pkt->pos;
+}
+
+/* syncs a checkpoint after the frame presented at pts was dispatched, either
+ * if one is due or if force is true. frames is the number of frames
+ * dispatched so far. Returns -1 and sets an error if the frames have no
+ * timestamps, which a resumed scan could seek to. */
+static int fullscan_checkpoint(ff_registry *reg, const keyframe_log *log,
+                               int video_id, int64_t pts, uint64_t frames,
+                               bool force) {
+    ff_fullscan *fs = reg->fullscan;
+    if (fs == NULL || fs->ckpt == NULL)
+        return 0;
+    if (pts == AV_NOPTS_VALUE) {
+        if (force)
+            return 0; /* no frame was dispatched */
+        return fferror(NULL, "Checkpoints need a video stream with "
+                             "timestamps, e.g. not a raw HEVC stream");
+    }
+    checkpoint *c = fs->ckpt;
+    if (!force && !ckpt_due(c))
+        return 0;
+
+    /* every frame presented after a keyframe follows it in decode order, so
+     * the latest keyframe that was already presented is a safe restart */
+    unsigned n = log->n < KEYFRAME_LOG ? log->n : KEYFRAME_LOG;
+    unsigned k = 0;
+    for (; k < n; k++) {
+        unsigned i = (log->n - 1 - k) % KEYFRAME_LOG;
+        if (log->pts[i] <= pts) {
+            c->rec.keyframe_pts = log->pts[i];
+            c->rec.keyframe_pos = log->pos[i];
+            break;
+        }
+    }
+    if (k == n)
+        return 0; /* retry after the next frame */
+
+    if (fflush(fs->ostream) == EOF)
+        return fferror(NULL, "Could not flush output for checkpoint");
+    off_t offset = ftello(fs->ostream);
+    if (offset < 0)
+        return fferror(NULL, "Output of a checkpointed scan must be a file");
+    c->rec.last_pts = pts;
+    c->rec.frames = frames;
+    c->rec.records = *fs->records;
+    c->rec.output_offset = (uint64_t)offset;
+    c->rec.stream_index = video_id;
+    if (ckpt_sync(c) < 0)
+        return fferror(NULL, "Could not write checkpoint");
+    return 0;
+}
+
+/* seeks to the keyframe of the checkpoint reg resumes from, if any */
+static int fullscan_seek(ffbucket *bucket, ff_registry *reg, int video_id) {
+    if (reg->fullscan == NULL || reg->fullscan->resume == NULL)
+        return 0;
+    const ckpt_record *rec = reg->fullscan->resume;
+    if (rec->stream_index != video_id)
+        return fferror(NULL, "Checkpoint does not match the input");
+    if (av_seek_frame(bucket->fmt_ctx, video_id, rec->keyframe_pts,
+                      AVSEEK_FLAG_BACKWARD) < 0 &&
+        (rec->keyframe_pos < 0 ||
+         av_seek_frame(bucket->fmt_ctx, video_id, rec->keyframe_pos,
+                       AVSEEK_FLAG_BYTE) < 0))
+        return fferror(NULL, "Could not seek to the checkpoint");
+    reg->stats.frames = rec->frames;
+    return 0;
+}
+
+/* returns true if the frame presented at pts was dispatched before the
+ * checkpoint reg resumes from */
+static bool fullscan_seen(const ff_registry *reg, int64_t pts) {
+    if (reg->fullscan == NULL || reg->fullscan->resume == NULL)
+        return false;
+    return pts != AV_NOPTS_VALUE && pts <= reg->fullscan->resume->last_pts;
+}
+
+/* walks the OBUs of the demuxed AV1 stream without decoding it */
+static int av1_loop(ffbucket *bucket, ff_registry *reg, int video_id) {
+    AVCodecParameters *codec_par = bucket->fmt_ctx->streams[video_id]->codecpar;
+    av1_metadata md;
+
+    /* metadata OBUs may be stored as configOBUs in the av1C record */
+    memset(&md, 0, sizeof(md));
+    if (codec_par->extradata_size > 0)
+        av1_parse_config(codec_par->extradata, codec_par->extradata_size, &md);
+    if (dispatch_av1(reg, &md) < 0)
+        return -1;
+
+    if (fullscan_seek(bucket, reg, video_id) < 0)
+        return -1;
+
+    /* temporal units are in presentation order */
+    bucket->pkt = av_packet_alloc();
+    keyframe_log log = {.n = 0};
+    int64_t pts = AV_NOPTS_VALUE; /* of the last dispatched temporal unit */
+    uint64_t fc = 0;              /* frame counter */
+    while (reg->active != 0 && read_video_packet(bucket, reg, video_id, fc)) {
+        fc++;
+        keyframe_log_add(&log, bucket->pkt);
+        if (fullscan_seen(reg, bucket->pkt->pts))
+            continue;
+        memset(&md, 0, sizeof(md));
+        if (av1_parse_obus(bucket->pkt->data, bucket->pkt->size, &md) < 0)
+            return fferror(NULL, "Malformed AV1 temporal unit");
+        if (dispatch_av1(reg, &md) < 0)
+            return -1;
+        pts = bucket->pkt->pts;
+        reg->stats.frames++;
+        if (fullscan_checkpoint(reg, &log, video_id, pts, reg->stats.frames,
+                                false) < 0)
+            return -1;
+    }
+    /* record how far an interrupted scan got */
+    if (budget_expired(&reg->budget))
+        return fullscan_checkpoint(reg, &log, video_id, pts,
+                                   reg->stats.frames, true);
+    return 0;
+}
+
+/* hands the frames the decoder has ready to the consumers of reg, pts is
+ * updated to the timestamp of the last dispatched frame */
+static int receive_frames(AVCodecContext *dec_ctx, AVFrame *frame,
+                          ff_registry *reg, int video_id,
+                          const keyframe_log *log, int64_t *pts,
+                          int send_status) {
+    while (reg->active != 0) {
+        int frame_status = avcodec_receive_frame(dec_ctx, frame);
+        if (frame_status != 0) {
+            if (frame_status == AVERROR(EAGAIN)) {
+                if (send_status == AVERROR(EAGAIN)) {
+                    /* this condition leads to undefined behaviour in ffmpeg
+                     * if not catched */
+                    return fferror(NULL, "avcodec_send_packet and "
+                                         "avcodec_receive_frame both "
+                                         "returned EAGAIN");
+                }
+                break;
+            } else if (frame_status == AVERROR_EOF)
+                break;
+            else if (frame_status < 0) {
+                return fferror(NULL,
+                               "avcodec_receive_frame returned decoding error");
+            } else
+                md_bug(__FILE__, __LINE__, true);
+        }
+        int64_t frame_pts = frame->best_effort_timestamp;
+        if (fullscan_seen(reg, frame_pts)) {
+            av_frame_unref(frame);
+            continue;
+        }
+        reg->stats.frames++;
+        int dispatch_status = registry_dispatch(reg, frame);
+        av_frame_unref(frame);
+        if (dispatch_status < 0)
+            return -1; /* error was set by the consumer */
+        *pts = frame_pts;
+        if (fullscan_checkpoint(reg, log, video_id, *pts, reg->stats.frames,
+                                false) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* sends pkt to the decoder, send_status receives the result for
+ * receive_frames. Returns -1 and sets an error on a decoding error. */
+static int send_packet(AVCodecContext *dec_ctx, const AVPacket *pkt,
+                       int *send_status) {
+    *send_status = avcodec_send_packet(dec_ctx, pkt);
+    if (*send_status != 0) {
+        if (*send_status == AVERROR(ENOMEM))
+            md_bug(__FILE__, __LINE__, true);
+        else if (*send_status == AVERROR(EINVAL))
+            md_bug(__FILE__, __LINE__, true);
+        else if (*send_status == AVERROR(EAGAIN))
+            md_bug(__FILE__, __LINE__, true);
+        else if (*send_status == AVERROR_EOF)
+            md_bug(__FILE__, __LINE__, true);
+        else {
+            /* legitimate decoding error */
+            return fferror(NULL, "avcodec_send_packet returned decoding error");
+        }
+    }
+    return 0;
+}
+
+/* sets up the decoder for the decode mode of reg, before it is opened */
+static void configure_decoder(AVCodecContext *dec_ctx, const ff_registry *reg) {
+    if (reg->decode == FF_DECODE_FULL)
+        return;
+    dec_ctx->thread_count = 0; /* one per CPU */
+    if (reg->fullscan != NULL) {
+        /* every frame is needed, frame threads give the best throughput */
+        dec_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+        return;
+    }
+    /* mastering display and content light level SEIs are sent with IRAP
+     * pictures and attached to the frame regardless of how it is
+     * reconstructed. Frame threads would hold back the first frame until
+     * thread_count keyframes were sent, so only slices are threaded. */
+    dec_ctx->skip_frame = AVDISCARD_NONKEY;
+    dec_ctx->skip_loop_filter = AVDISCARD_ALL;
+    dec_ctx->skip_idct = AVDISCARD_ALL;
+    dec_ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+    dec_ctx->thread_type = FF_THREAD_SLICE;
+}
+
+/* opens a decoder for codec_par that is set up for the decode mode of reg.
+ * Returns NULL and sets an error on failure. */
+static AVCodecContext *open_decoder(const AVCodecParameters *codec_par,
+                                    const ff_registry *reg) {
+    const AVCodec *decoder = avcodec_find_decoder(codec_par->codec_id);
+    if (decoder == NULL) {
+        md_error_custom("Could not open ffmpeg HEVC decoder");
+        return NULL;
+    }
+    AVCodecContext *dec_ctx = avcodec_alloc_context3(decoder);
+    /* copy stream header information to codec context */
+    if (avcodec_parameters_to_context(dec_ctx, codec_par) < 0) {
+        avcodec_free_context(&dec_ctx);
+        md_error_custom("Could not copy codec parameters to codec context");
+        return NULL;
+    }
+    /* open AVCodecContext */
+    configure_decoder(dec_ctx, reg);
+    if (avcodec_open2(dec_ctx, decoder, NULL) < 0) {
+        avcodec_free_context(&dec_ctx);
+        md_error_custom("Could not initialize ffmpeg AVCodecContext");
+        return NULL;
+    }
+    return dec_ctx;
+}
+
+/* parses the SEI NAL units the hvcC record or Annex B extradata of codec_par
+ * carries. Returns the NAL unit length size of the stream, 0 for Annex B. */
+static int parse_config_sei(const AVCodecParameters *codec_par,
+                            hevc_sei *sei) {
+    memset(sei, 0, sizeof(hevc_sei));
+    if (codec_par->extradata_size <= 0)
+        return 0;
+    int length_size = hevc_parse_config(codec_par->extradata,
+                                        codec_par->extradata_size, sei);
+    if (length_size < 0) {
+        length_size = 0;
+        hevc_parse_annexb(codec_par->extradata, codec_par->extradata_size,
+                          sei);
+    }
+    return length_size;
+}
+
+/* parses the SEI messages of pkt */
+static void parse_packet_sei(const AVPacket *pkt, int length_size,
+                             hevc_sei *sei) {
+    memset(sei, 0, sizeof(hevc_sei));
+    if (length_size > 0)
+        hevc_parse_lp(pkt->data, pkt->size, length_size, sei);
+    else
+        hevc_parse_annexb(pkt->data, pkt->size, sei);
+}
+
+/* returns true if pkt starts a picture the decoder can begin with */
+static bool is_irap(const AVPacket *pkt, const hevc_sei *sei) {
+    return sei->has_irap || (pkt->flags & AV_PKT_FLAG_KEY);
+}
+
+/* dispatches the side data of the HEVC stream. The SEI messages of every
+ * packet are parsed before it is handed to the decoder, the decoder only
+ * sees packets as long as a consumer is left that the SEI messages could not
+ * satisfy. */
+static int decode_loop(ffbucket *bucket, ff_registry *reg, int video_id) {
+    AVCodecParameters *codec_par = bucket->fmt_ctx->streams[video_id]->codecpar;
+    hevc_sei sei;
+
+    /* hvcC records may carry SEI NAL units, too */
+    int length_size = parse_config_sei(codec_par, &sei);
+    if (dispatch_hevc_sei(reg, &sei) < 0)
+        return -1;
+    if (reg->active == 0)
+        return 0;
+
+    bucket->dec_ctx = open_decoder(codec_par, reg);
+    if (bucket->dec_ctx == NULL)
+        return -1;
+
+    if (fullscan_seek(bucket, reg, video_id) < 0)
+        return -1;
+
+    bucket->pkt = av_packet_alloc();
+    bucket->frame = av_frame_alloc();
+    keyframe_log log = {.n = 0};
+    int64_t pts = AV_NOPTS_VALUE; /* of the last dispatched frame */
+    uint64_t fc = 0;              /* frame counter */
+    /* packets before the first IRAP cannot be decoded */
+    bool skip_leading = reg->decode == FF_DECODE_REDUCED;
+    while (reg->active != 0 && read_video_packet(bucket, reg, video_id, fc)) {
+        fc++;
+        keyframe_log_add(&log, bucket->pkt);
+        parse_packet_sei(bucket->pkt, length_size, &sei);
+        if (dispatch_hevc_sei(reg, &sei) < 0)
+            return -1;
+        if (reg->active == 0)
+            break; /* satisfied without decoding */
+        if (skip_leading && !is_irap(bucket->pkt, &sei))
+            continue;
+        skip_leading = false;
+
+        /* send packet to decoder */
+        int64_t span = trace_begin("decode");
+        int send_status;
+        if (send_packet(bucket->dec_ctx, bucket->pkt, &send_status) < 0)
+            return -1;
+        int recv_status = receive_frames(bucket->dec_ctx, bucket->frame, reg,
+                                         video_id, &log, &pts, send_status);
+        trace_end("decode", span);
+        if (recv_status < 0)
+            return -1;
+    }
+    /* record how far an interrupted scan got */
+    if (budget_expired(&reg->budget))
+        return fullscan_checkpoint(reg, &log, video_id, pts,
+                                   reg->stats.frames, true);
+    /* drain the frames the decoder still holds at the end of stream */
+    int ret = 0;
+    int64_t span = trace_begin("decode");
+    if (reg->active != 0 && avcodec_send_packet(bucket->dec_ctx, NULL) == 0)
+        ret = receive_frames(bucket->dec_ctx, bucket->frame, reg, video_id,
+                             &log, &pts, 0);
+    trace_end("decode", span);
+    return ret;
+}
 
+/* sets the probe status, returns -1 and sets an error if a consumer of reg is
+ * not done */
+static int registry_finish(ff_registry *reg) {
+    reg->stats.status = FF_PROBE_FOUND;
+    for (size_t i = 0; i < reg->nb_consumers; i++) {
+        const ff_consumer *c = &reg->consumers[i];
+        if (c->until_eof && !budget_expired(&reg->budget))
+            continue; /* the stream ended */
+        if (!c->done) {
+            if (budget_timed_out(&reg->budget))
+                reg->stats.status = FF_PROBE_TIMEOUT;
+            else if (budget_bytes_exhausted(&reg->budget))
+                reg->stats.status = FF_PROBE_BYTES;
+            else
+                reg->stats.status = FF_PROBE_MISSING;
+            md_error_custom(ff_probe_status_str(reg->stats.status));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* like fferror, but reports the exhausted budget instead of msg if that is
+ * what made libavformat fail */
+static int fferror_budget(ffbucket *bucket, const char *msg) {
+    if (!budget_expired(&bucket->reg->budget))
+        return fferror(bucket, msg);
+    ff_registry *reg = bucket->reg;
+    ffbucket_free(bucket);
+    return registry_finish(reg);
+}
+
+/* returns true if every active consumer of reg only waits for side data
+ * that HEVC carries in the SEI messages of IRAP access units */
+static bool irap_sei_only(const ff_registry *reg) {
+    for (size_t i = 0; i < reg->nb_consumers; i++) {
+        uint64_t bit = UINT64_C(1) << i;
+        if (!(reg->active & bit))
+            continue;
+        if (reg->consumers[i].until_eof)
+            return false;
+        for (int t = 0; t < FF_SIDEDATA_TYPES; t++) {
+            if (t != AV_FRAME_DATA_MASTERING_DISPLAY_METADATA &&
+                t != AV_FRAME_DATA_CONTENT_LIGHT_LEVEL &&
+                (reg->filter[t] & bit))
+                return false;
+        }
+    }
+    return true;
+}
+
+/* scans a transport stream without libavformat. Returns 1 if the IRAP access
+ * units that were scanned show that libavformat would not find more, -1 if a
+ * consumer reported an error and 0 otherwise. */
+static int ts_fast_path(const char *path, ff_registry *reg) {
+    hevc_sei sei;
+    unsigned iraps;
+    int found =
+        ts_scan_hevc(path, -1, TS_SCAN_LIMIT, &reg->budget, &sei, &iraps);
+    if (found < 0) {
+        /* let libavformat have a try */
+        clear_global_md_error();
+        return 0;
+    }
+    if (found > 0)
+        return dispatch_hevc_sei(reg, &sei);
+    return iraps >= TS_SCAN_IRAPS && irap_sei_only(reg) ? 1 : 0;
+}
+
+/* reads the mastering display items of the header metadata of an MXF file,
+ * returns like ts_fast_path */
+static int mxf_fast_path(const char *path, ff_registry *reg) {
+    hevc_sei sei;
+    int found = mxf_probe(path, &reg->budget, &sei);
+    if (found < 0) {
+        /* let libavformat have a try */
+        clear_global_md_error();
+        return 0;
+    }
+    if (found > 0)
+        return dispatch_hevc_sei(reg, &sei);
+    return 0;
+}
+
+/* writes out what the consumers of the registry opaque printed so far, a
+ * followed input calls this before it waits for data */
+static void flush_consumers(void *opaque) {
+    ff_registry *reg = opaque;
+    for (size_t i = 0; i < reg->nb_consumers; i++) {
+        if (reg->consumers[i].ostream)
+            fflush(reg->consumers[i].ostream);
+    }
+}
+
+/* opens path as bucket->fmt_ctx. Returns -1 and sets an error on failure,
+ * bucket is left to the caller. */
+static int open_format(ffbucket *bucket, const char *path) {
     /* enable for debugging */
     // av_log_set_level(AV_LOG_DEBUG);
 
+    bucket->fmt_ctx = avformat_alloc_context();
+    if (bucket->fmt_ctx == NULL) {
+        md_error_custom("Could not allocate AVFormatContext");
+        return -1;
+    }
+    bucket->fmt_ctx->interrupt_callback.callback = &ffinterrupt;
+    bucket->fmt_ctx->interrupt_callback.opaque = bucket;
+
+    /* pipes and followed files are read through a custom AVIOContext that
+     * never seeks */
+    const ff_registry *reg = bucket->reg;
+    if (reg->follow || ffio_is_stream(path)) {
+        bucket->stream = reg->follow
+                             ? ffio_follow(path, reg->follow_idle,
+                                           reg->budget.deadline,
+                                           &flush_consumers, bucket->reg)
+                             : ffio_open(path);
+        if (bucket->stream == NULL)
+            return -1;
+        bucket->fmt_ctx->pb = bucket->stream->avio;
+        bucket->fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+
     /* open file */
-    if (avformat_open_input(&bucket->fmt_ctx, path, NULL, NULL) != 0)
-        return fferror(bucket, "ffmpeg could not open file");
+    int64_t span = trace_begin("open");
+    int open_status = avformat_open_input(&bucket->fmt_ctx, path, NULL, NULL);
+    trace_end("open", span);
+    if (open_status != 0) {
+        md_error_custom("ffmpeg could not open file");
+        return -1;
+    }
+    return 0;
+}
 
-    if (avformat_find_stream_info(bucket->fmt_ctx, NULL) < 0)
-        return fferror(bucket, "ffmpeg could not retreive stream info");
+/* demuxes path with libavformat */
+static int dispatch_libav(const char *path, ff_registry *reg) {
+    /* initialize */
+    ffbucket *bucket = ffbucket_alloc();
+    bucket->reg = reg;
+    bucket->bytes_base = reg->budget.bytes;
+    if (open_format(bucket, path) < 0)
+        return fferror_budget(bucket, NULL);
 
     /* find video stream */
     int video_id = av_find_best_stream(bucket->fmt_ctx, AVMEDIA_TYPE_VIDEO, 0,
                                        -1, NULL, 0);
+
+    /* on pipes the stream info is only probed if the container header does
+     * not identify the video codec, otherwise the first access unit carrying
+     * the metadata would be delayed by the probe */
+    if (bucket->stream == NULL || video_id < 0 ||
+        bucket->fmt_ctx->streams[video_id]->codecpar->codec_id ==
+            AV_CODEC_ID_NONE) {
+        int64_t span = trace_begin("stream-info");
+        int info_status = avformat_find_stream_info(bucket->fmt_ctx, NULL);
+        trace_end("stream-info", span);
+        if (info_status < 0)
+            return fferror_budget(bucket,
+                                  "ffmpeg could not retreive stream info");
+        video_id = av_find_best_stream(bucket->fmt_ctx, AVMEDIA_TYPE_VIDEO, 0,
+                                       -1, NULL, 0);
+    }
     if (video_id < 0)
         return fferror(bucket, "No video stream in input file");
 
-    /* verify hevc codec */
-    AVCodecParameters *codec_par = bucket->fmt_ctx->streams[video_id]->codecpar;
-    if (codec_par->codec_id != AV_CODEC_ID_HEVC)
-        return fferror(bucket,
-                       "Video stream in input file is not an HEVC stream");
+    AVStream *st = bucket->fmt_ctx->streams[video_id];
+    int ret = 0;
+    switch (st->codecpar->codec_id) {
+    case AV_CODEC_ID_HEVC:
+        ret = decode_loop(bucket, reg, video_id);
+        break;
+    case AV_CODEC_ID_AV1:
+        ret = dispatch_stream_sidedata(reg, st);
+        if (ret == 0)
+            ret = av1_loop(bucket, reg, video_id);
+        break;
+    case AV_CODEC_ID_VP9:
+        /* VP9 has no in-band HDR metadata, use the container's */
+        ret = dispatch_stream_sidedata(reg, st);
+        break;
+    default:
+        return fferror(bucket, "Video stream in input file is not an HEVC, "
+                               "AV1 or VP9 stream");
+    }
+    ffbucket_free(bucket);
+    if (ret < 0)
+        return -1;
+    return registry_finish(reg);
+}
 
-    bucket->decoder = avcodec_find_decoder(codec_par->codec_id);
-    if (bucket->decoder == NULL)
-        return fferror(bucket, "Could not open ffmpeg HEVC decoder");
+/* probes the main title of a Blu-ray disc. Only the beginning of its first
+ * clips is scanned, libavformat only sees the first clip if that does not
+ * satisfy every consumer. */
+static int dispatch_bdmv(const char *path, ff_registry *reg) {
+    bdmv_title *title = bdmv_title_open(path);
+    if (title == NULL)
+        return -1;
+    if (reg->fullscan == NULL) {
+        hevc_sei sei;
+        int found = bdmv_scan(title, &reg->budget, &sei);
+        if (found < 0)
+            clear_global_md_error(); /* let libavformat have a try */
+        if (found > 0 && dispatch_hevc_sei(reg, &sei) < 0) {
+            bdmv_title_free(title);
+            return -1;
+        }
+        if (reg->active == 0 || budget_expired(&reg->budget)) {
+            bdmv_title_free(title);
+            return registry_finish(reg);
+        }
+    }
+    char *clip = bdmv_clip_path(title, title->playlist->items[0].clips[0]);
+    bdmv_title_free(title);
+    int ret = dispatch_libav(clip, reg);
+    free(clip);
+    return ret;
+}
 
-    bucket->dec_ctx = avcodec_alloc_context3(bucket->decoder);
-    /* copy stream header information to codec context */
-    if (avcodec_parameters_to_context(bucket->dec_ctx, codec_par) < 0)
-        return fferror(bucket,
-                       "Could not copy codec parameters to codec context");
+static int dispatch_input(const char *path, ff_registry *reg) {
+    /* the fast paths stop at the current end of a followed file */
+    if (reg->follow)
+        return dispatch_libav(path, reg);
+    if (!ffio_is_stream(path) && bdmv_is_input(path))
+        return dispatch_bdmv(path, reg);
 
-    /* open AVCodecContext */
-    if (avcodec_open2(bucket->dec_ctx, bucket->decoder, NULL) < 0)
-        return fferror(bucket, "Could not initialize ffmpeg AVCodecContext");
+    /* transport streams are scanned packet by packet first, libavformat is
+     * only needed if that does not satisfy every consumer and the scan did
+     * not already show the SEI messages to be missing. A full scan needs
+     * libavformat anyway. */
+    if (reg->fullscan == NULL && !ffio_is_stream(path) && ts_probe(path) > 0) {
+        int fast = ts_fast_path(path, reg);
+        if (fast < 0)
+            return -1;
+        if (fast > 0 || reg->active == 0 || budget_expired(&reg->budget))
+            return registry_finish(reg);
+    }
 
-    bucket->pkt = av_packet_alloc();
-    av_init_packet(bucket->pkt);
-    bucket->pkt->data = NULL;
-    bucket->pkt->size = 0;
-    bucket->pkt->stream_index = video_id;
-    bucket->frame = av_frame_alloc();
-    bool ffabort = false;
-    uint64_t fc = 0; /* frame counter */
-    while (true) {
-        if (av_read_frame(bucket->fmt_ctx, bucket->pkt) < 0) {
-            break; /* end of stream or error */
+    /* the same holds for the header metadata of MXF files */
+    if (reg->fullscan == NULL && !ffio_is_stream(path) && mxf_is_input(path)) {
+        if (mxf_fast_path(path, reg) < 0)
+            return -1;
+        if (reg->active == 0 || budget_expired(&reg->budget))
+            return registry_finish(reg);
+    }
+    return dispatch_libav(path, reg);
+}
+
+int ffmpeg_dispatch_sidedata(const char *path, ff_registry *reg) {
+    memset(&reg->stats, 0, sizeof(ff_stats));
+    reg->stats.status = FF_PROBE_MISSING;
+    budget_start(&reg->budget, reg->deadline, reg->byte_limit);
+    trace_file(path);
+    int64_t span = trace_begin("probe");
+    int ret = dispatch_input(path, reg);
+    trace_end("probe", span);
+    reg->stats.bytes = reg->budget.bytes;
+    reg->stats.elapsed = budget_elapsed(&reg->budget);
+    reg->stats.cpu = budget_cpu(&reg->budget);
+    return ret;
+}
+
+/* state of a track of ffmpeg_dispatch_tracks */
+typedef struct track_state {
+    ff_track *track;
+    ff_registry *reg; /* copy of the consumers writing to mem */
+    FILE *mem;
+    size_t size;
+    AVCodecContext *dec_ctx; /* opened once SEI parsing is not enough */
+    int length_size;
+    bool skip_leading;
+    uint64_t fc; /* frame counter */
+} track_state;
+
+/* copies the consumers of reg to a new registry whose consumers write to
+ * ostream, the opaque pointers are shared */
+static ff_registry *registry_clone(const ff_registry *reg, FILE *ostream) {
+    ff_registry *copy = ff_registry_alloc();
+    *copy = *reg;
+    for (size_t i = 0; i < copy->nb_consumers; i++)
+        copy->consumers[i].ostream = ostream;
+    return copy;
+}
+
+/* sets up the state of track, whose consumers are copies of those of reg.
+ * Returns -1 and sets an error if the output buffer cannot be opened. */
+static int track_open(track_state *t, ff_track *track, const ff_registry *reg) {
+    t->track = track;
+    t->mem = open_memstream(&track->output, &t->size);
+    if (t->mem == NULL) {
+        md_error_custom(strerror(errno));
+        return -1;
+    }
+    t->reg = registry_clone(reg, t->mem);
+    return 0;
+}
+
+/* sets the status of every track and sums them up in reg->stats if ret is 0,
+ * frees the track states. The tracks are freed as well if ret is -1. */
+static void tracks_finish(ff_registry *reg, track_state *ts, ff_track **tracks,
+                          size_t *nb_tracks, int ret) {
+    if (ret == 0)
+        reg->stats.status = FF_PROBE_FOUND;
+    else if (budget_expired(&reg->budget))
+        registry_finish(reg); /* report the exhausted budget */
+
+    /* every track shares the budget of the input */
+    for (size_t i = 0; i < *nb_tracks; i++) {
+        track_state *t = &ts[i];
+        if (ret == 0) {
+            t->reg->budget = reg->budget;
+            if (registry_finish(t->reg) < 0)
+                clear_global_md_error(); /* the status tells */
+            if (t->reg->stats.status != FF_PROBE_FOUND)
+                reg->stats.status = t->reg->stats.status;
+            reg->stats.frames += t->reg->stats.frames;
         }
-        if (frame_limit > 0) {
-            if (fc >= frame_limit)
-                break; /* frame limit reached */
+        t->track->stats = t->reg->stats;
+        fclose(t->mem);
+        if (t->dec_ctx)
+            avcodec_free_context(&t->dec_ctx);
+        ff_registry_free(t->reg);
+    }
+    free(ts);
+    reg->stats.bytes = reg->budget.bytes;
+    reg->stats.elapsed = budget_elapsed(&reg->budget);
+    reg->stats.cpu = budget_cpu(&reg->budget);
+    if (ret < 0) {
+        ff_tracks_free(*tracks, *nb_tracks);
+        *tracks = NULL;
+        *nb_tracks = 0;
+    }
+}
+
+/* hands pkt to the track t, AVFrame is shared by every track */
+static int track_packet(track_state *t, const AVPacket *pkt,
+                        const AVCodecParameters *codec_par, AVFrame *frame) {
+    ff_registry *reg = t->reg;
+    registry_update_budget(reg, t->fc);
+    if (reg->active == 0)
+        return 0;
+    t->fc++;
+    reg->stats.packets++;
+    hevc_sei sei;
+    parse_packet_sei(pkt, t->length_size, &sei);
+    if (dispatch_hevc_sei(reg, &sei) < 0)
+        return -1;
+    if (reg->active == 0)
+        return 0; /* satisfied without decoding */
+    if (t->skip_leading && !is_irap(pkt, &sei))
+        return 0;
+    t->skip_leading = false;
+    if (t->dec_ctx == NULL) {
+        t->dec_ctx = open_decoder(codec_par, reg);
+        if (t->dec_ctx == NULL)
+            return -1;
+    }
+
+    int64_t span = trace_begin("decode");
+    keyframe_log log = {.n = 0};
+    int64_t pts = AV_NOPTS_VALUE;
+    int send_status;
+    if (send_packet(t->dec_ctx, pkt, &send_status) < 0)
+        return -1;
+    int ret = receive_frames(t->dec_ctx, frame, reg, t->track->index, &log,
+                             &pts, send_status);
+    trace_end("decode", span);
+    return ret;
+}
+
+/* drains the decoder of t at the end of stream */
+static int track_drain(track_state *t, AVFrame *frame) {
+    if (t->dec_ctx == NULL || t->reg->active == 0)
+        return 0;
+    keyframe_log log = {.n = 0};
+    int64_t pts = AV_NOPTS_VALUE;
+    if (avcodec_send_packet(t->dec_ctx, NULL) != 0)
+        return 0;
+    return receive_frames(t->dec_ctx, frame, t->reg, t->track->index, &log,
+                          &pts, 0);
+}
+
+/* demuxes the file of bucket once and routes the packets of every HEVC
+ * stream to its track */
+static int tracks_loop(ffbucket *bucket, ff_registry *reg, track_state *ts,
+                       size_t nb_tracks) {
+    AVFormatContext *fmt_ctx = bucket->fmt_ctx;
+    /* tracks by stream index, streams that show up later are ignored */
+    unsigned nb_streams = fmt_ctx->nb_streams;
+    track_state **route = md_calloc(nb_streams, sizeof(track_state *));
+    size_t pending = 0;
+    for (size_t i = 0; i < nb_tracks; i++) {
+        track_state *t = &ts[i];
+        route[t->track->index] = t;
+        hevc_sei sei;
+        t->length_size = parse_config_sei(
+            fmt_ctx->streams[t->track->index]->codecpar, &sei);
+        if (dispatch_hevc_sei(t->reg, &sei) < 0) {
+            free(route);
+            return -1;
         }
-        if (bucket->pkt->stream_index != video_id) {
-            av_packet_unref(bucket->pkt);
+        if (t->reg->active != 0)
+            pending++;
+    }
+
+    int ret = 0;
+    bucket->pkt = av_packet_alloc();
+    bucket->frame = av_frame_alloc();
+    while (pending > 0) {
+        av_packet_unref(bucket->pkt);
+        int read_status = demux_read(bucket);
+        if (read_status < 0)
+            break; /* end of stream, error or interrupt */
+        update_bytes(bucket);
+        if (budget_expired(&reg->budget))
+            break;
+        unsigned index = bucket->pkt->stream_index;
+        track_state *t = index < nb_streams ? route[index] : NULL;
+        if (t == NULL || t->reg->active == 0)
             continue;
-        }
-        fc++;
-        /* send packet to decoder */
-        int send_status = avcodec_send_packet(bucket->dec_ctx, bucket->pkt);
-        if (send_status != 0) {
-            if (send_status == AVERROR(ENOMEM))
-                md_bug(__FILE__, __LINE__, true);
-            else if (send_status == AVERROR(EINVAL))
-                md_bug(__FILE__, __LINE__, true);
-            else if (send_status == AVERROR(EAGAIN))
-                md_bug(__FILE__, __LINE__, true);
-            else if (send_status == AVERROR_EOF)
-                md_bug(__FILE__, __LINE__, true);
-            else {
-                /* legitimate decoding error */
-                return fferror(bucket,
-                               "avcodec_send_packet returned decoding error");
+        reg->stats.packets++;
+        ret = track_packet(t, bucket->pkt, fmt_ctx->streams[index]->codecpar,
+                           bucket->frame);
+        if (ret < 0)
+            break;
+        if (t->reg->active == 0)
+            pending--; /* resolved */
+    }
+    /* drain the decoders at the end of stream */
+    if (ret == 0 && !budget_expired(&reg->budget)) {
+        for (size_t i = 0; ret == 0 && i < nb_tracks; i++)
+            ret = track_drain(&ts[i], bucket->frame);
+    }
+    free(route);
+    return ret;
+}
+
+int ffmpeg_dispatch_tracks(const char *path, ff_registry *reg,
+                           ff_track **tracks, size_t *nb_tracks) {
+    *tracks = NULL;
+    *nb_tracks = 0;
+    if (reg->fullscan != NULL)
+        md_bug(__FILE__, __LINE__, true);
+    memset(&reg->stats, 0, sizeof(ff_stats));
+    reg->stats.status = FF_PROBE_MISSING;
+    budget_start(&reg->budget, reg->deadline, reg->byte_limit);
+    trace_file(path);
+    int64_t span = trace_begin("probe");
+
+    ffbucket *bucket = ffbucket_alloc();
+    bucket->reg = reg;
+    int ret = open_format(bucket, path);
+    if (ret == 0) {
+        int64_t info_span = trace_begin("stream-info");
+        ret = avformat_find_stream_info(bucket->fmt_ctx, NULL) < 0 ? -1 : 0;
+        trace_end("stream-info", info_span);
+        if (ret < 0)
+            md_error_custom("ffmpeg could not retreive stream info");
+    }
+
+    size_t n = 0;
+    for (unsigned i = 0; ret == 0 && i < bucket->fmt_ctx->nb_streams; i++) {
+        if (bucket->fmt_ctx->streams[i]->codecpar->codec_id == AV_CODEC_ID_HEVC)
+            n++;
+    }
+    if (ret == 0 && n == 0) {
+        md_error_custom("No HEVC video stream in input file");
+        ret = -1;
+    }
+
+    track_state *ts = NULL;
+    if (ret == 0) {
+        *tracks = md_calloc(n, sizeof(ff_track));
+        ts = md_calloc(n, sizeof(track_state));
+        for (unsigned i = 0; i < bucket->fmt_ctx->nb_streams; i++) {
+            AVStream *st = bucket->fmt_ctx->streams[i];
+            if (st->codecpar->codec_id != AV_CODEC_ID_HEVC)
+                continue;
+            ff_track *track = &(*tracks)[*nb_tracks];
+            track_state *t = &ts[*nb_tracks];
+            track->index = st->index;
+            track->id = st->id;
+            if (track_open(t, track, reg) < 0) {
+                ret = -1;
+                break;
             }
+            t->skip_leading = reg->decode == FF_DECODE_REDUCED;
+            (*nb_tracks)++;
         }
-        while (true) {
-            int frame_status =
-                avcodec_receive_frame(bucket->dec_ctx, bucket->frame);
-            if (frame_status != 0) {
-                if (frame_status == AVERROR(EAGAIN)) {
-                    if (send_status == AVERROR(EAGAIN)) {
-                        /* this condition leads to undefined behaviour in ffmpeg
-                         * if not catched */
-                        return fferror(
-                            bucket,
-                            "avcodec_send_packet and avcodec_receive_frame "
-                            "both returned EAGAIN");
-                    }
-                    break;
-                } else if (frame_status == AVERROR_EOF)
-                    break;
-                else if (frame_status < 0) {
-                    return fferror(
-                        bucket,
-                        "avcodec_receive_frame returned decoding error");
-                    return -1;
-                } else
-                    md_bug(__FILE__, __LINE__, true);
-            }
-            for (int i = 0; i < bucket->frame->nb_side_data; i++) {
-                AVFrameSideData *sd = bucket->frame->side_data[i];
-                ff_return_t ret = recv_func(ostream, sd);
-                if (ret == FFRET_ERROR || ret == FFRET_DONE) {
-                    ffabort = true;
-                    break;
-                } else if (ret == FFRET_BREAK)
-                    break;
+        if (ret == 0)
+            ret = tracks_loop(bucket, reg, ts, n);
+    }
+    tracks_finish(reg, ts, tracks, nb_tracks, ret);
+    ffbucket_free(bucket);
+    trace_end("probe", span);
+    return ret;
+}
+
+int ffmpeg_dispatch_package(const char *path, ff_registry *reg,
+                            ff_track **tracks, size_t *nb_tracks) {
+    *tracks = NULL;
+    *nb_tracks = 0;
+    if (reg->fullscan != NULL)
+        md_bug(__FILE__, __LINE__, true);
+    memset(&reg->stats, 0, sizeof(ff_stats));
+    reg->stats.status = FF_PROBE_MISSING;
+    budget_start(&reg->budget, reg->deadline, reg->byte_limit);
+    trace_file(path);
+    int64_t span = trace_begin("probe");
+
+    pkg_package *pkg = pkg_open(path);
+    int ret = pkg ? 0 : -1;
+    size_t n = pkg ? pkg->nb_variants : 0;
+    track_state *ts = NULL;
+    pkg_result *results = NULL;
+    bool *todo = NULL;
+    if (ret == 0) {
+        *tracks = md_calloc(n, sizeof(ff_track));
+        ts = md_calloc(n, sizeof(track_state));
+        results = md_calloc(n, sizeof(pkg_result));
+        todo = md_calloc(n, sizeof(bool));
+        for (size_t i = 0; i < n; i++) {
+            ff_track *track = &(*tracks)[i];
+            track->index = (int)i;
+            track->id = -1;
+            track->name = md_strdup(pkg->variants[i].name);
+            if (track_open(&ts[i], track, reg) < 0) {
+                free(track->name);
+                ret = -1;
+                break;
             }
-            if (ffabort)
+            todo[i] = true;
+            (*nb_tracks)++;
+        }
+    }
+
+    /* the first media segment is only read for the variants whose init
+     * segment does not satisfy every consumer */
+    for (int pass = 0; ret == 0 && pass < 2; pass++) {
+        pkg_scan(pkg, pass == 1, todo, &reg->budget, results);
+        for (size_t i = 0; ret == 0 && i < n; i++) {
+            if (!todo[i])
+                continue;
+            if (results[i].ret > 0)
+                ret = dispatch_hevc_sei(ts[i].reg, &results[i].sei);
+            todo[i] = results[i].ret >= 0 && ts[i].reg->active != 0;
+        }
+    }
+    /* variants that could not be read keep the reason */
+    for (size_t i = 0; i < *nb_tracks; i++)
+        (*tracks)[i].error = results[i].error;
+
+    tracks_finish(reg, ts, tracks, nb_tracks, ret);
+    free(results);
+    free(todo);
+    if (pkg != NULL)
+        pkg_free(pkg);
+    trace_end("probe", span);
+    return ret;
+}
+
+int ffmpeg_dispatch_imf(const char *path, ff_registry *reg,
+                        ff_track **tracks, size_t *nb_tracks) {
+    *tracks = NULL;
+    *nb_tracks = 0;
+    if (reg->fullscan != NULL)
+        md_bug(__FILE__, __LINE__, true);
+    memset(&reg->stats, 0, sizeof(ff_stats));
+    reg->stats.status = FF_PROBE_MISSING;
+    budget_start(&reg->budget, reg->deadline, reg->byte_limit);
+    trace_file(path);
+    int64_t span = trace_begin("probe");
+
+    size_t n = 0;
+    char **files = imf_track_files(path, &n);
+    int ret = files ? 0 : -1;
+    track_state *ts = NULL;
+    mxf_result *results = NULL;
+    if (ret == 0) {
+        *tracks = md_calloc(n, sizeof(ff_track));
+        ts = md_calloc(n, sizeof(track_state));
+        results = md_calloc(n, sizeof(mxf_result));
+        for (size_t i = 0; i < n; i++) {
+            ff_track *track = &(*tracks)[i];
+            const char *base = strrchr(files[i], '/');
+            track->index = (int)i;
+            track->id = -1;
+            track->name = md_strdup(base ? base + 1 : files[i]);
+            if (track_open(&ts[i], track, reg) < 0) {
+                free(track->name);
+                ret = -1;
                 break;
-            av_frame_unref(bucket->frame);
+            }
+            (*nb_tracks)++;
         }
-        if (ffabort)
-            break;
-        av_packet_unref(bucket->pkt);
-        av_init_packet(bucket->pkt);
     }
 
-    if (!ffabort)
-        return fferror(bucket,
-                       "Video stream does not contain the desired side data");
+    /* only the header metadata of the track files is read, the essence is
+     * left alone */
+    if (ret == 0) {
+        mxf_scan(files, n, &reg->budget, results);
+        for (size_t i = 0; ret == 0 && i < n; i++) {
+            if (results[i].ret > 0)
+                ret = dispatch_hevc_sei(ts[i].reg, &results[i].sei);
+        }
+    }
+    /* track files that could not be read keep the reason */
+    for (size_t i = 0; i < *nb_tracks; i++)
+        (*tracks)[i].error = results[i].error;
 
-    ffbucket_free(bucket);
-    return 0;
+    tracks_finish(reg, ts, tracks, nb_tracks, ret);
+    free(results);
+    for (size_t i = 0; i < n; i++)
+        free(files[i]);
+    free(files);
+    trace_end("probe", span);
+    return ret;
 }
 
-ff_return_t ffmpeg_disp_meta(FILE *ostream, AVFrameSideData *sd) {
+void ff_tracks_free(ff_track *tracks, size_t nb_tracks) {
+    for (size_t i = 0; i < nb_tracks; i++) {
+        free(tracks[i].name);
+        free(tracks[i].error);
+        free(tracks[i].output);
+    }
+    free(tracks);
+}
+
+int ffmpeg_access_sidedata(const char *path, FILE *ostream,
+                           ff_recv_func recv_func, uint64_t frame_limit) {
+    ff_registry *reg = ff_registry_alloc();
+    if (ff_registry_add(reg, recv_func, ostream, NULL, NULL, 0,
+                        frame_limit) == NULL) {
+        ff_registry_free(reg);
+        return -1;
+    }
+    int ret = ffmpeg_dispatch_sidedata(path, reg);
+    ff_registry_free(reg);
+    return ret;
+}
+
+ff_return_t ffmpeg_disp_meta(FILE *ostream, AVFrameSideData *sd,
+                             void *opaque) {
+    (void)opaque;
     if (sd->type == AV_FRAME_DATA_MASTERING_DISPLAY_METADATA) {
         /* these are the droids we are looking for */
         AVMasteringDisplayMetadata *ffmeta =
@@ -225,15 +1457,14 @@ ff_return_t ffmpeg_disp_meta(FILE *ostream, AVFrameSideData *sd) {
             conv_meta(col, ffmeta);
             conv_lum(lum, ffmeta);
             disp_meta_x265 *x265 = meta_to_x265(col, lum);
-            if (x265 == NULL) {
-                free(col);
-                free(lum);
+            disp_meta_free(col);
+            disp_lum_free(lum);
+            if (x265 == NULL)
                 return FFRET_ERROR;
-            }
-            fprintf(ostream, "%s\n", x265_str(x265));
-            free(x265);
-            free(col);
-            free(lum);
+            char *str = x265_str(x265);
+            fprintf(ostream, "%s\n", str);
+            free(str);
+            disp_meta_x265_free(x265);
             return FFRET_DONE;
         } else {
             md_error_custom("Incomplete mastering display metadata");
@@ -242,3 +1473,93 @@ ff_return_t ffmpeg_disp_meta(FILE *ostream, AVFrameSideData *sd) {
     }
     return FFRET_CONTINUE;
 }
+
+/* rescales q to an integer in units of 1/den */
+static uint32_t conv_q(AVRational q, int64_t den) {
+    if (q.den <= 0 || q.num <= 0)
+        return 0;
+    return (uint32_t)(((int64_t)q.num * den + q.den / 2) / q.den);
+}
+
+void ffmpeg_conv_hdrplus(hdr10plus *dst, const AVDynamicHDRPlus *src) {
+    memset(dst, 0, sizeof(hdr10plus));
+    dst->application_version = src->application_version;
+    dst->num_windows = src->num_windows;
+    dst->targeted_max_luminance =
+        conv_q(src->targeted_system_display_maximum_luminance, 1);
+    dst->targeted_peak_flag =
+        src->targeted_system_display_actual_peak_luminance_flag;
+    dst->mastering_peak_flag =
+        src->mastering_display_actual_peak_luminance_flag;
+    for (int w = 0; w < src->num_windows && w < 3; w++) {
+        const AVHDRPlusColorTransformParams *par = &src->params[w];
+        hdr10plus_window *win = &dst->windows[w];
+        if (w > 0) {
+            win->upper_left_x = conv_q(par->window_upper_left_corner_x, 1);
+            win->upper_left_y = conv_q(par->window_upper_left_corner_y, 1);
+            win->lower_right_x = conv_q(par->window_lower_right_corner_x, 1);
+            win->lower_right_y = conv_q(par->window_lower_right_corner_y, 1);
+            win->center_x = par->center_of_ellipse_x;
+            win->center_y = par->center_of_ellipse_y;
+            win->rotation_angle = par->rotation_angle;
+            win->semimajor_internal = par->semimajor_axis_internal_ellipse;
+            win->semimajor_external = par->semimajor_axis_external_ellipse;
+            win->semiminor_external = par->semiminor_axis_external_ellipse;
+            win->overlap_process_option = par->overlap_process_option;
+        }
+        for (int c = 0; c < 3; c++)
+            win->maxscl[c] = conv_q(par->maxscl[c], 100000);
+        win->average_maxrgb = conv_q(par->average_maxrgb, 100000);
+        win->num_percentiles = par->num_distribution_maxrgb_percentiles;
+        if (win->num_percentiles > 15)
+            win->num_percentiles = 15;
+        for (int i = 0; i < win->num_percentiles; i++) {
+            win->percentages[i] = par->distribution_maxrgb[i].percentage;
+            win->percentiles[i] =
+                conv_q(par->distribution_maxrgb[i].percentile, 100000);
+        }
+        win->fraction_bright_pixels = conv_q(par->fraction_bright_pixels, 1000);
+        win->tone_mapping_flag = par->tone_mapping_flag;
+        win->knee_point_x = conv_q(par->knee_point_x, 4095);
+        win->knee_point_y = conv_q(par->knee_point_y, 4095);
+        win->num_anchors = par->num_bezier_curve_anchors;
+        if (win->num_anchors > 15)
+            win->num_anchors = 15;
+        for (int i = 0; i < win->num_anchors; i++)
+            win->anchors[i] = conv_q(par->bezier_curve_anchors[i], 1023);
+        win->color_saturation_mapping_flag = par->color_saturation_mapping_flag;
+        win->color_saturation_weight = conv_q(par->color_saturation_weight, 8);
+    }
+}
+
+ff_return_t ffmpeg_dynamic_json(FILE *ostream, AVFrameSideData *sd,
+                                void *opaque) {
+    ff_dynamic *dyn = opaque;
+    if (sd->type == AV_FRAME_DATA_DYNAMIC_HDR_PLUS) {
+        hdr10plus md;
+        ffmpeg_conv_hdrplus(&md, (AVDynamicHDRPlus *)sd->data);
+        if (md.num_windows == 0) {
+            md_error_custom("HDR10+ metadata without processing window");
+            return FFRET_ERROR;
+        }
+        if (dyn->index != NULL) {
+            if (dynidx_write(dyn->index, &md) < 0)
+                return FFRET_ERROR;
+            dyn->records++;
+        } else
+            dyn_json_frame(ostream, &md, dyn->records++);
+        return FFRET_BREAK; /* one record per frame */
+    }
+    return FFRET_CONTINUE;
+}
+
+ff_return_t ffmpeg_content_light(FILE *ostream, AVFrameSideData *sd,
+                                 void *opaque) {
+    (void)opaque;
+    if (sd->type == AV_FRAME_DATA_CONTENT_LIGHT_LEVEL) {
+        AVContentLightMetadata *cll = (AVContentLightMetadata *)sd->data;
+        fprintf(ostream, "%u,%u\n", cll->MaxCLL, cll->MaxFALL);
+        return FFRET_DONE;
+    }
+    return FFRET_CONTINUE;
+}
@@ -2,8 +2,15 @@
 #ifndef _INCL_FFMPEG
 #define _INCL_FFMPEG
 
+#include "budget.h"
+#include "checkpoint.h"
+#include "dynindex.h"
+#include "hdr10plus.h"
 #include "mdinfo.h"
 #include <libavutil/frame.h>
+#include <libavutil/hdr_dynamic_metadata.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 typedef enum {
@@ -14,11 +21,187 @@ typedef enum {
     FFRET_DONE,     /* do not decode further frames, gleaned all information */
 } ff_return_t;
 
+/* outcome of ffmpeg_dispatch_sidedata */
+typedef enum {
+    FF_PROBE_FOUND,   /* every consumer is done */
+    FF_PROBE_MISSING, /* side data not present in the stream or within the
+                         frame budget */
+    FF_PROBE_BYTES,   /* byte budget exhausted */
+    FF_PROBE_TIMEOUT, /* deadline reached */
+} ff_probe_status;
+
+typedef struct ff_stats {
+    ff_probe_status status;
+    uint64_t packets; /* video packets read */
+    uint64_t frames;  /* frames decoded */
+    uint64_t bytes;   /* bytes read from the input */
+    double elapsed;   /* seconds */
+    double cpu;       /* CPU seconds of the process */
+} ff_stats;
+
+/* how much work the decoder does when SEI parsing was not enough */
+typedef enum {
+    FF_DECODE_REDUCED, /* keyframes only, no loop filter, threaded */
+    FF_DECODE_FULL,    /* every frame with the decoder defaults */
+} ff_decode_mode;
+
+/* side data consumer, opaque is the pointer that was passed to
+ * ff_registry_add */
+typedef ff_return_t (*ff_recv_func)(FILE *ostream, AVFrameSideData *sd,
+                                    void *opaque);
+
+/* upper bound for AVFrameSideDataType values the registry can filter */
+#define FF_SIDEDATA_TYPES 64
+/* maximum amount of consumers per registry, one bit per consumer */
+#define FF_MAX_CONSUMERS 64
+
+typedef struct ff_consumer {
+    ff_recv_func recv_func;
+    FILE *ostream;
+    void *opaque;
+    uint64_t frame_limit; /* budget in video frames, 0 means no limit */
+    bool done;            /* consumer returned FFRET_DONE */
+    bool until_eof; /* full scan, the consumer is done at the end of stream */
+} ff_consumer;
+
+/* state of a full scan that can be checkpointed and resumed */
+typedef struct ff_fullscan {
+    checkpoint *ckpt;          /* NULL disables checkpoints */
+    FILE *ostream;             /* output whose flushed offset is recorded */
+    const uint64_t *records;   /* records written by the consumer */
+    const ckpt_record *resume; /* position to resume from, NULL if none */
+} ff_fullscan;
+
+typedef struct ff_registry {
+    ff_consumer consumers[FF_MAX_CONSUMERS];
+    size_t nb_consumers;
+    /* bitmask of interested consumers, indexed by AVFrameSideDataType */
+    uint64_t filter[FF_SIDEDATA_TYPES];
+    /* bitmask of consumers that are neither done nor out of budget */
+    uint64_t active;
+    /* limits of the whole probe, see ff_registry_set_budget */
+    double deadline;
+    uint64_t byte_limit;
+    probe_budget budget;
+    ff_stats stats; /* filled by ffmpeg_dispatch_sidedata */
+    ff_fullscan *fullscan; /* NULL unless the whole stream is scanned */
+    ff_decode_mode decode;
+    bool follow;        /* wait for data appended to the input */
+    double follow_idle; /* seconds without new data that end the wait */
+} ff_registry;
+
+/* constructor for ff_registry */
+ff_registry *ff_registry_alloc();
+
+/* destructor for ff_registry */
+void ff_registry_free(ff_registry *reg);
+
+/* ff_registry_add registers recv_func for the ntypes side data types in
+ * types. If types is NULL the consumer receives side data of every type.
+ * Returns NULL and sets an error if the registry is full. */
+ff_consumer *ff_registry_add(ff_registry *reg, ff_recv_func recv_func,
+                             FILE *ostream, void *opaque,
+                             const enum AVFrameSideDataType *types,
+                             size_t ntypes, uint64_t frame_limit);
+
+/* ff_registry_set_budget limits the probe to seconds of wall-clock time and
+ * byte_limit bytes read from the input, 0 means no limit. The limits are
+ * enforced in the dispatch loop and through the AVIO interrupt callback. */
+void ff_registry_set_budget(ff_registry *reg, double seconds,
+                            uint64_t byte_limit);
+
+/* ff_registry_set_follow makes ffmpeg_dispatch_sidedata follow an input that
+ * is still being written: at its end the demuxer waits for appended data
+ * instead of stopping, the output of the consumers is flushed before each
+ * wait. The input ends after idle seconds without new data (0 means never),
+ * at the deadline of the budget or on SIGINT or SIGTERM. */
+void ff_registry_set_follow(ff_registry *reg, double idle);
+
+/* returns a description of status */
+const char *ff_probe_status_str(ff_probe_status status);
+
+/* prints stats as a single line to ostream */
+void ff_stats_print(FILE *ostream, const ff_stats *stats);
+
+/* ffmpeg_dispatch_sidedata decodes the video stream of path once and hands
+ * the side data of every frame to the registered consumers. The loop ends
+ * when every consumer is either done or out of budget, or when the budget of
+ * the probe is exhausted. Returns -1 and sets an error if a consumer did not
+ * finish, reg->stats tells why. */
+int ffmpeg_dispatch_sidedata(const char *path, ff_registry *reg);
+
+/* result of a video track of ffmpeg_dispatch_tracks, a variant of
+ * ffmpeg_dispatch_package or a track file of ffmpeg_dispatch_imf */
+typedef struct ff_track {
+    int index;      /* of the stream in the container or of the variant */
+    int id;         /* format-specific stream ID, e.g. the PID in a TS */
+    char *name;     /* of the variant, NULL for streams */
+    ff_stats stats; /* status tells whether the track was resolved */
+    char *output;   /* what the consumers wrote for this track */
+    char *error;    /* why the variant could not be read, NULL if it was */
+} ff_track;
+
+/* ffmpeg_dispatch_tracks demuxes path once and hands the side data of every
+ * HEVC video stream to its own copy of the consumers of reg, which write to
+ * the output of the track instead of their stream. Demuxing stops once every
+ * track is resolved or the budget of reg is exhausted, reg->stats sums up the
+ * whole file. The tracks are returned in *tracks and freed with
+ * ff_tracks_free. Returns -1 and sets an error if path cannot be demuxed or
+ * a consumer reported an error. */
+int ffmpeg_dispatch_tracks(const char *path, ff_registry *reg,
+                           ff_track **tracks, size_t *nb_tracks);
+
+/* ffmpeg_dispatch_package probes every video variant of the local HLS
+ * playlist or DASH manifest at path like ffmpeg_dispatch_tracks probes
+ * streams. Only the init segments are read, the first media segment of a
+ * variant only if its init segment does not satisfy every consumer. The
+ * segments of the variants are read in parallel and without libavformat.
+ * Returns -1 and sets an error if the playlist cannot be read or a consumer
+ * reported an error, a variant that cannot be read gets an error. */
+int ffmpeg_dispatch_package(const char *path, ff_registry *reg,
+                            ff_track **tracks, size_t *nb_tracks);
+
+/* ffmpeg_dispatch_imf probes the track files of the main image sequences of
+ * the IMF composition playlist at path like ffmpeg_dispatch_package probes
+ * variants. Only the header metadata of the MXF track files is read, on
+ * parallel threads and without libavformat, so the content light level is
+ * never found. Returns -1 and sets an error if the CPL or its asset map
+ * cannot be read or a consumer reported an error, a track file that cannot
+ * be read gets an error. */
+int ffmpeg_dispatch_imf(const char *path, ff_registry *reg, ff_track **tracks,
+                        size_t *nb_tracks);
+
+/* destructor for the tracks of ffmpeg_dispatch_tracks,
+ * ffmpeg_dispatch_package and ffmpeg_dispatch_imf */
+void ff_tracks_free(ff_track *tracks, size_t nb_tracks);
+
+/* convenience wrapper around ffmpeg_dispatch_sidedata for a single consumer
+ * that receives all side data types */
 int ffmpeg_access_sidedata(const char *path, FILE *ostream,
-                           ff_return_t (*recv_func)(FILE *, AVFrameSideData *),
-                           uint64_t frame_limit);
+                           ff_recv_func recv_func, uint64_t frame_limit);
 
 int ffmpeg_recv_meta(const char *path, disp_meta *meta, disp_lum *lum);
 
-ff_return_t ffmpeg_disp_meta(FILE *ostream, AVFrameSideData *sd);
+/* prints the mastering display metadata as x265 --master-display string */
+ff_return_t ffmpeg_disp_meta(FILE *ostream, AVFrameSideData *sd, void *opaque);
+
+/* state of ffmpeg_dynamic_json */
+typedef struct ff_dynamic {
+    uint64_t records;     /* frames written so far */
+    dynidx_writer *index; /* binary output instead of JSON if set */
+} ff_dynamic;
+
+/* streams the HDR10+ metadata of every frame as x265 --dhdr10-info JSON,
+ * opaque must point to an ff_dynamic. The document is finished with
+ * dyn_json_end, or dynidx_finish for binary output. */
+ff_return_t ffmpeg_dynamic_json(FILE *ostream, AVFrameSideData *sd,
+                                void *opaque);
+
+/* ffmpeg_conv_hdrplus converts the HDR10+ side data of a frame back to the
+ * values as coded in the bitstream */
+void ffmpeg_conv_hdrplus(hdr10plus *dst, const AVDynamicHDRPlus *src);
+
+/* prints the content light level as x265 --max-cll string */
+ff_return_t ffmpeg_content_light(FILE *ostream, AVFrameSideData *sd,
+                                 void *opaque);
 #endif
@@ -0,0 +1,157 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "hdr10plus.h"
+#include "bitreader.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* ITU-T T.35 header of HDR10+ messages: country code United States,
+ * terminal provider Samsung, provider oriented code 1, application id 4 */
+static const uint8_t hdr10plus_t35_header[] = {0xB5, 0x00, 0x3C,
+                                               0x00, 0x01, 0x04};
+
+int hdr10plus_is_t35(const uint8_t *buf, size_t size) {
+    if (size < sizeof(hdr10plus_t35_header) + 1)
+        return 0;
+    return memcmp(buf, hdr10plus_t35_header, sizeof(hdr10plus_t35_header)) ==
+           0;
+}
+
+/* skips the actual peak luminance matrix */
+static void skip_peak_luminance(bitreader *br) {
+    uint32_t rows = br_read(br, 5);
+    uint32_t cols = br_read(br, 5);
+    br_skip(br, (size_t)rows * cols * 4);
+}
+
+int hdr10plus_parse_t35(const uint8_t *buf, size_t size, hdr10plus *out) {
+    if (!hdr10plus_is_t35(buf, size))
+        return -1;
+    bitreader br;
+    br_init(&br, buf + sizeof(hdr10plus_t35_header),
+            size - sizeof(hdr10plus_t35_header));
+    memset(out, 0, sizeof(hdr10plus));
+
+    out->application_version = br_read(&br, 8);
+    if (out->application_version > 1)
+        return -1;
+    out->num_windows = br_read(&br, 2);
+    if (out->num_windows < 1 || out->num_windows > 3)
+        return -1;
+    for (int w = 1; w < out->num_windows; w++) {
+        hdr10plus_window *win = &out->windows[w];
+        win->upper_left_x = br_read(&br, 16);
+        win->upper_left_y = br_read(&br, 16);
+        win->lower_right_x = br_read(&br, 16);
+        win->lower_right_y = br_read(&br, 16);
+        win->center_x = br_read(&br, 16);
+        win->center_y = br_read(&br, 16);
+        win->rotation_angle = br_read(&br, 8);
+        win->semimajor_internal = br_read(&br, 16);
+        win->semimajor_external = br_read(&br, 16);
+        win->semiminor_external = br_read(&br, 16);
+        win->overlap_process_option = br_read(&br, 1);
+    }
+    out->targeted_max_luminance = br_read(&br, 27);
+    out->targeted_peak_flag = br_read(&br, 1);
+    if (out->targeted_peak_flag)
+        skip_peak_luminance(&br);
+    for (int w = 0; w < out->num_windows; w++) {
+        hdr10plus_window *win = &out->windows[w];
+        for (int c = 0; c < 3; c++)
+            win->maxscl[c] = br_read(&br, 17);
+        win->average_maxrgb = br_read(&br, 17);
+        win->num_percentiles = br_read(&br, 4);
+        if (win->num_percentiles > 15)
+            return -1;
+        for (int i = 0; i < win->num_percentiles; i++) {
+            win->percentages[i] = br_read(&br, 7);
+            win->percentiles[i] = br_read(&br, 17);
+        }
+        win->fraction_bright_pixels = br_read(&br, 10);
+    }
+    out->mastering_peak_flag = br_read(&br, 1);
+    if (out->mastering_peak_flag)
+        skip_peak_luminance(&br);
+    for (int w = 0; w < out->num_windows; w++) {
+        hdr10plus_window *win = &out->windows[w];
+        win->tone_mapping_flag = br_read(&br, 1);
+        if (win->tone_mapping_flag) {
+            win->knee_point_x = br_read(&br, 12);
+            win->knee_point_y = br_read(&br, 12);
+            win->num_anchors = br_read(&br, 4);
+            for (int i = 0; i < win->num_anchors; i++)
+                win->anchors[i] = br_read(&br, 10);
+        }
+        win->color_saturation_mapping_flag = br_read(&br, 1);
+        if (win->color_saturation_mapping_flag)
+            win->color_saturation_weight = br_read(&br, 6);
+    }
+    if (br.overrun)
+        return -1;
+    return 0;
+}
+
+#define DIFF(a, b, field)                                                      \
+    if ((a)->field != (b)->field)                                              \
+    return #field
+#define DIFF_AT(a, b, field, i)                                                \
+    if ((a)->field[i] != (b)->field[i])                                        \
+    return #field
+
+/* compares the fields of a window that are coded for it */
+static const char *window_diff(const hdr10plus_window *a,
+                               const hdr10plus_window *b, bool geometry) {
+    if (geometry) {
+        DIFF(a, b, upper_left_x);
+        DIFF(a, b, upper_left_y);
+        DIFF(a, b, lower_right_x);
+        DIFF(a, b, lower_right_y);
+        DIFF(a, b, center_x);
+        DIFF(a, b, center_y);
+        DIFF(a, b, rotation_angle);
+        DIFF(a, b, semimajor_internal);
+        DIFF(a, b, semimajor_external);
+        DIFF(a, b, semiminor_external);
+        DIFF(a, b, overlap_process_option);
+    }
+    for (int i = 0; i < 3; i++)
+        DIFF_AT(a, b, maxscl, i);
+    DIFF(a, b, average_maxrgb);
+    DIFF(a, b, num_percentiles);
+    for (int i = 0; i < a->num_percentiles && i < 15; i++) {
+        DIFF_AT(a, b, percentages, i);
+        DIFF_AT(a, b, percentiles, i);
+    }
+    DIFF(a, b, fraction_bright_pixels);
+    DIFF(a, b, tone_mapping_flag);
+    if (a->tone_mapping_flag) {
+        DIFF(a, b, knee_point_x);
+        DIFF(a, b, knee_point_y);
+        DIFF(a, b, num_anchors);
+        for (int i = 0; i < a->num_anchors && i < 15; i++)
+            DIFF_AT(a, b, anchors, i);
+    }
+    DIFF(a, b, color_saturation_mapping_flag);
+    DIFF(a, b, color_saturation_weight);
+    return NULL;
+}
+
+const char *hdr10plus_diff(const hdr10plus *a, const hdr10plus *b,
+                           int *window) {
+    *window = -1;
+    DIFF(a, b, application_version);
+    DIFF(a, b, num_windows);
+    DIFF(a, b, targeted_max_luminance);
+    DIFF(a, b, targeted_peak_flag);
+    DIFF(a, b, mastering_peak_flag);
+    for (int w = 0; w < a->num_windows && w < 3; w++) {
+        const char *field = window_diff(&a->windows[w], &b->windows[w], w > 0);
+        if (field != NULL) {
+            *window = w;
+            return field;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,63 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_HDR10PLUS
+#define _INCL_HDR10PLUS
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* SMPTE ST 2094-40 dynamic metadata as carried in ITU-T T.35 messages. All
+ * values are stored as coded in the bitstream. */
+typedef struct hdr10plus_window {
+    /* window geometry, only coded for the second and third window */
+    uint16_t upper_left_x;
+    uint16_t upper_left_y;
+    uint16_t lower_right_x;
+    uint16_t lower_right_y;
+    uint16_t center_x;
+    uint16_t center_y;
+    uint8_t rotation_angle;
+    uint16_t semimajor_internal;
+    uint16_t semimajor_external;
+    uint16_t semiminor_external;
+    uint8_t overlap_process_option;
+    /* luminance parameters in units of 0.00001 */
+    uint32_t maxscl[3];
+    uint32_t average_maxrgb;
+    uint8_t num_percentiles;
+    uint8_t percentages[15];
+    uint32_t percentiles[15];
+    uint16_t fraction_bright_pixels;
+    /* tone mapping */
+    uint8_t tone_mapping_flag;
+    uint16_t knee_point_x;
+    uint16_t knee_point_y;
+    uint8_t num_anchors;
+    uint16_t anchors[15];
+    uint8_t color_saturation_mapping_flag;
+    uint8_t color_saturation_weight;
+} hdr10plus_window;
+
+typedef struct hdr10plus {
+    uint8_t application_version;
+    uint8_t num_windows;
+    uint32_t targeted_max_luminance;
+    uint8_t targeted_peak_flag;
+    uint8_t mastering_peak_flag;
+    hdr10plus_window windows[3];
+} hdr10plus;
+
+/* hdr10plus_is_t35 returns 1 if the ITU-T T.35 message in buf (starting at
+ * the country code) is an HDR10+ message */
+int hdr10plus_is_t35(const uint8_t *buf, size_t size);
+
+/* hdr10plus_parse_t35 parses the ITU-T T.35 message in buf (starting at the
+ * country code). Returns -1 if the message is not valid HDR10+ metadata. */
+int hdr10plus_parse_t35(const uint8_t *buf, size_t size, hdr10plus *out);
+
+/* hdr10plus_diff returns the name of the first field that differs between a
+ * and b, NULL if they are equal. Only fields that are coded are compared.
+ * *window is set to the window of the field, -1 for fields of the frame. */
+const char *hdr10plus_diff(const hdr10plus *a, const hdr10plus *b,
+                           int *window);
+
+#endif
@@ -0,0 +1,189 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "hevcsei.h"
+#include "bitreader.h"
+#include "hdr10plus.h"
+#include "wrappers.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NAL_IRAP_FIRST 16
+#define NAL_IRAP_LAST 23
+#define NAL_SEI_PREFIX 39
+#define NAL_SEI_SUFFIX 40
+
+#define SEI_USER_DATA_REGISTERED_ITU_T_T35 4
+#define SEI_MASTERING_DISPLAY_COLOUR_VOLUME 137
+#define SEI_CONTENT_LIGHT_LEVEL_INFO 144
+
+/* copies src to dst without emulation prevention bytes, returns the size of
+ * the resulting rbsp */
+static size_t unescape_rbsp(const uint8_t *src, size_t size, uint8_t *dst) {
+    size_t n = 0;
+    int zeros = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (zeros >= 2 && src[i] == 0x03) {
+            zeros = 0;
+            continue;
+        }
+        zeros = src[i] == 0 ? zeros + 1 : 0;
+        dst[n++] = src[i];
+    }
+    return n;
+}
+
+static void parse_mdcv(const uint8_t *buf, size_t size, hevc_sei *sei) {
+    bitreader br;
+    br_init(&br, buf, size);
+    hevc_mdcv mdcv;
+    for (int c = 0; c < 3; c++) {
+        mdcv.primaries[c][0] = br_read(&br, 16);
+        mdcv.primaries[c][1] = br_read(&br, 16);
+    }
+    mdcv.white_point[0] = br_read(&br, 16);
+    mdcv.white_point[1] = br_read(&br, 16);
+    mdcv.max_luminance = br_read(&br, 32);
+    mdcv.min_luminance = br_read(&br, 32);
+    if (br.overrun)
+        return;
+    sei->mdcv = mdcv;
+    sei->has_mdcv = true;
+}
+
+static void parse_cll(const uint8_t *buf, size_t size, hevc_sei *sei) {
+    if (size < 4)
+        return;
+    sei->max_cll = (buf[0] << 8) | buf[1];
+    sei->max_fall = (buf[2] << 8) | buf[3];
+    sei->has_cll = true;
+}
+
+static void parse_sei_rbsp(const uint8_t *buf, size_t size, hevc_sei *sei) {
+    size_t pos = 0;
+    /* stop at the rbsp trailing bits */
+    while (pos + 1 < size) {
+        uint32_t type = 0;
+        while (pos < size && buf[pos] == 0xFF)
+            type += buf[pos++];
+        if (pos >= size)
+            return;
+        type += buf[pos++];
+        size_t payload_size = 0;
+        while (pos < size && buf[pos] == 0xFF)
+            payload_size += buf[pos++];
+        if (pos >= size)
+            return;
+        payload_size += buf[pos++];
+        if (payload_size > size - pos)
+            return; /* truncated */
+        const uint8_t *payload = buf + pos;
+        switch (type) {
+        case SEI_MASTERING_DISPLAY_COLOUR_VOLUME:
+            parse_mdcv(payload, payload_size, sei);
+            break;
+        case SEI_CONTENT_LIGHT_LEVEL_INFO:
+            parse_cll(payload, payload_size, sei);
+            break;
+        case SEI_USER_DATA_REGISTERED_ITU_T_T35:
+            if (hdr10plus_parse_t35(payload, payload_size, &sei->hdr10plus) ==
+                0)
+                sei->has_hdr10plus = true;
+            break;
+        }
+        pos += payload_size;
+    }
+}
+
+void hevc_parse_nal(const uint8_t *nal, size_t size, hevc_sei *sei) {
+    if (size < 3)
+        return;
+    int type = (nal[0] >> 1) & 0x3f;
+    if (type >= NAL_IRAP_FIRST && type <= NAL_IRAP_LAST) {
+        sei->has_irap = true;
+        return;
+    }
+    if (type != NAL_SEI_PREFIX && type != NAL_SEI_SUFFIX)
+        return;
+    uint8_t stackbuf[1024];
+    uint8_t *rbsp = stackbuf;
+    if (size - 2 > sizeof(stackbuf))
+        rbsp = md_malloc(size - 2);
+    size_t rbsp_size = unescape_rbsp(nal + 2, size - 2, rbsp);
+    parse_sei_rbsp(rbsp, rbsp_size, sei);
+    if (rbsp != stackbuf)
+        free(rbsp);
+}
+
+/* returns the position of the next 00 00 01 start code at or after pos, or
+ * size if there is none */
+static size_t find_start_code(const uint8_t *buf, size_t size, size_t pos) {
+    while (pos + 3 <= size) {
+        const uint8_t *p = memchr(buf + pos + 2, 0x01, size - pos - 2);
+        if (p == NULL)
+            return size;
+        size_t one = p - buf;
+        if (buf[one - 1] == 0 && buf[one - 2] == 0)
+            return one - 2;
+        pos = one - 1;
+    }
+    return size;
+}
+
+void hevc_parse_annexb(const uint8_t *buf, size_t size, hevc_sei *sei) {
+    size_t start = find_start_code(buf, size, 0);
+    while (start < size) {
+        size_t nal = start + 3;
+        size_t next = find_start_code(buf, size, nal);
+        size_t end = next;
+        /* trailing zero bytes belong to the next start code */
+        while (end > nal && buf[end - 1] == 0)
+            end--;
+        hevc_parse_nal(buf + nal, end - nal, sei);
+        start = next;
+    }
+}
+
+int hevc_parse_lp(const uint8_t *buf, size_t size, int length_size,
+                  hevc_sei *sei) {
+    if (length_size < 1 || length_size > 4)
+        return -1;
+    size_t pos = 0;
+    while (pos + length_size <= size) {
+        size_t len = 0;
+        for (int i = 0; i < length_size; i++)
+            len = (len << 8) | buf[pos + i];
+        pos += length_size;
+        if (len > size - pos)
+            return -1;
+        hevc_parse_nal(buf + pos, len, sei);
+        pos += len;
+    }
+    return 0;
+}
+
+int hevc_parse_config(const uint8_t *buf, size_t size, hevc_sei *sei) {
+    if (size < 23 || buf[0] != 1)
+        return -1; /* Annex B extradata or unknown version */
+    int length_size = (buf[21] & 0x03) + 1;
+    int num_arrays = buf[22];
+    size_t pos = 23;
+    for (int i = 0; i < num_arrays; i++) {
+        if (pos + 3 > size)
+            return -1;
+        int num_nalus = (buf[pos + 1] << 8) | buf[pos + 2];
+        pos += 3;
+        for (int j = 0; j < num_nalus; j++) {
+            if (pos + 2 > size)
+                return -1;
+            size_t len = (buf[pos] << 8) | buf[pos + 1];
+            pos += 2;
+            if (len > size - pos)
+                return -1;
+            hevc_parse_nal(buf + pos, len, sei);
+            pos += len;
+        }
+    }
+    return length_size;
+}
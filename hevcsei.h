@@ -0,0 +1,48 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_HEVCSEI
+#define _INCL_HEVCSEI
+
+#include "hdr10plus.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* HEVC mastering display colour volume SEI, values as coded */
+typedef struct hevc_mdcv {
+    uint16_t primaries[3][2]; /* units of 0.00002, order green, blue, red */
+    uint16_t white_point[2];  /* units of 0.00002 */
+    uint32_t max_luminance;   /* units of 0.0001 cd/m^2 */
+    uint32_t min_luminance;   /* units of 0.0001 cd/m^2 */
+} hevc_mdcv;
+
+/* HDR related SEI messages collected from one or more NAL units */
+typedef struct hevc_sei {
+    bool has_mdcv;
+    hevc_mdcv mdcv;
+    bool has_cll;
+    uint16_t max_cll;
+    uint16_t max_fall;
+    bool has_hdr10plus;
+    hdr10plus hdr10plus;
+    bool has_irap; /* an IRAP picture was seen */
+} hevc_sei;
+
+/* hevc_parse_nal parses a single NAL unit without start code or length
+ * prefix */
+void hevc_parse_nal(const uint8_t *nal, size_t size, hevc_sei *sei);
+
+/* hevc_parse_annexb parses the NAL units of an Annex B byte stream */
+void hevc_parse_annexb(const uint8_t *buf, size_t size, hevc_sei *sei);
+
+/* hevc_parse_lp parses NAL units with length_size byte big endian length
+ * prefixes as stored in ISO/IEC 14496-15 samples. Returns -1 if buf is
+ * malformed. */
+int hevc_parse_lp(const uint8_t *buf, size_t size, int length_size,
+                  hevc_sei *sei);
+
+/* hevc_parse_config parses the NAL unit arrays of an
+ * HEVCDecoderConfigurationRecord (hvcC). Returns the NAL unit length size of
+ * the samples or -1 if buf is not an hvcC record. */
+int hevc_parse_config(const uint8_t *buf, size_t size, hevc_sei *sei);
+
+#endif
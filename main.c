@@ -1,14 +1,33 @@
 /* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
 
+#include "bdmv.h"
+#include "checkpoint.h"
 #include "cmdline.h"
+#include "compare.h"
+#include "dynindex.h"
+#include "dynmeta.h"
 #include "errors.h"
 #include "eval.h"
+#include "ffio.h"
 #include "ffmpeg.h"
 #include "mdinfo.h"
+#include "mxf.h"
+#include "package.h"
+#include "probe.h"
+#include "scan.h"
+#include "trace.h"
+#include "watch.h"
+#include "wrappers.h"
 #include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* checkpoint interval of -resume without -checkpoint, in seconds */
+#define DEFAULT_CHECKPOINT_INTERVAL 10
 
 static void print_usage() {
     fprintf(stderr, "Usage:\n");
@@ -17,10 +36,11 @@ static void print_usage() {
             "-lmin %%d -lmax %%d\n");
 }
 
-static FILE *open_output_stream(const char *filename) {
+/* opens filename for writing, append keeps the current content */
+static FILE *open_output_stream(const char *filename, bool append) {
     if (filename == NULL)
         return stdout;
-    FILE *ostream = fopen(filename, "w");
+    FILE *ostream = fopen(filename, append ? "a" : "w");
     if (ostream == NULL) {
         md_error_custom(strerror(errno));
         return NULL;
@@ -51,52 +71,382 @@ int manual_metadata_input(eval_container *ct, FILE *ostream) {
     return 0;
 }
 
-int process_ffmpeg_input(eval_container *ct, FILE *ostream) {
-    if (ct->ffinput == NULL) {
-        md_error_custom("No input file specified for ffmpeg");
+/* cuts ostream back to the output a checkpoint covers */
+static int truncate_output(FILE *ostream, const ckpt_record *rec) {
+    if (fseeko(ostream, 0, SEEK_END) < 0 ||
+        (uint64_t)ftello(ostream) < rec->output_offset) {
+        md_error_custom("Output is shorter than the checkpoint");
         return -1;
     }
-    if (ct->ffdynamic) {
-        md_error_custom("dynamic metadata support is not implemented yet");
+    if (ftruncate(fileno(ostream), (off_t)rec->output_offset) < 0) {
+        md_error_custom(strerror(errno));
         return -1;
     }
-    return ffmpeg_access_sidedata(ct->ffinput, ostream, &ffmpeg_disp_meta, 24);
+    return 0;
+}
+
+/* extracts the HDR10+ metadata of every frame. Returns like
+ * process_ffmpeg_input, the checkpoint is kept unless the scan finished. */
+static int process_dynamic(eval_container *ct, FILE *ostream) {
+    ff_dynamic dyn = {.records = 0};
+    ff_fullscan fs = {.ostream = ostream, .records = &dyn.records};
+    ckpt_record resume;
+    char *path = NULL;
+
+    if (ct->ffcheckpoint > 0 || ct->ffresume) {
+        if (ct->output_file == NULL) {
+            md_error_custom("Checkpoints need an output file (-o)");
+            return 1;
+        }
+        if (ffio_is_stream(ct->ffinputs[0])) {
+            md_error_custom("Checkpoints need a seekable input");
+            return 1;
+        }
+        path = ckpt_path(ct->output_file);
+    }
+    if (ct->ffbinary) {
+        if (ct->output_file == NULL) {
+            md_error_custom("Binary output needs an output file (-o)");
+            return 1;
+        }
+        if (path != NULL) {
+            md_error_custom("Checkpoints are not supported for binary output");
+            free(path);
+            return 1;
+        }
+        dyn.index = dynidx_writer_open(ostream);
+        if (dyn.index == NULL)
+            return 1;
+    }
+    if (ct->ffresume) {
+        if (ckpt_load(path, &resume) < 0 ||
+            truncate_output(ostream, &resume) < 0) {
+            free(path);
+            return 1;
+        }
+        dyn.records = resume.records;
+        fs.resume = &resume;
+    }
+    if (path != NULL) {
+        double interval = ct->ffcheckpoint > 0 ? ct->ffcheckpoint
+                                               : DEFAULT_CHECKPOINT_INTERVAL;
+        fs.ckpt = ckpt_open(path, interval);
+        if (fs.ckpt == NULL) {
+            free(path);
+            return 1;
+        }
+        /* the old record stays valid until the first new one is synced */
+        if (ct->ffresume)
+            fs.ckpt->rec = resume;
+    }
+
+    ff_registry *reg = ff_registry_alloc();
+    const enum AVFrameSideDataType types[] = {AV_FRAME_DATA_DYNAMIC_HDR_PLUS};
+    ff_consumer *c =
+        ff_registry_add(reg, &ffmpeg_dynamic_json, ostream, &dyn, types, 1, 0);
+    c->until_eof = true;
+    ff_registry_set_budget(reg, ct->ffdeadline, ct->ffmaxbytes);
+    reg->fullscan = &fs;
+    reg->decode = ct->fffulldecode ? FF_DECODE_FULL : FF_DECODE_REDUCED;
+    if (ct->fffollow >= 0)
+        ff_registry_set_follow(reg, ct->fffollow);
+
+    int ret = ffmpeg_dispatch_sidedata(ct->ffinputs[0], reg) < 0 ? 1 : 0;
+    if (ret == 0 && dyn.records == 0) {
+        md_error_custom("Video stream does not contain HDR10+ metadata");
+        ret = 1;
+    }
+    int64_t span = trace_begin("write");
+    if (ret == 0 && dyn.index == NULL)
+        dyn_json_end(ostream, dyn.records);
+
+    /* an interrupted scan keeps its checkpoint for -resume */
+    ff_probe_status status = reg->stats.status;
+    if (ret != 0 && (status == FF_PROBE_TIMEOUT || status == FF_PROBE_BYTES))
+        ret = 2;
+    /* a binary container is usable up to the last frame written */
+    if (dyn.index != NULL) {
+        if (ret == 1)
+            dynidx_abort(dyn.index);
+        else if (dynidx_finish(dyn.index) < 0)
+            ret = 1;
+    }
+    trace_end("write", span);
+    if (ct->ffstats || ret == 2)
+        ff_stats_print(stderr, &reg->stats);
+    if (fs.ckpt != NULL)
+        ckpt_close(fs.ckpt, path, ret == 0);
+    free(path);
+    ff_registry_free(reg);
+    return ret;
+}
+
+/* converts the binary container of -tojson to x265 JSON */
+static int process_tojson(eval_container *ct, FILE *ostream) {
+    dynidx_reader *r = dynidx_open(ct->fftojson);
+    if (r == NULL)
+        return 1;
+    int ret = dynidx_to_json(r, ostream) < 0 ? 1 : 0;
+    dynidx_close(r);
+    return ret;
+}
+
+/* probes every HEVC track of the input in a single pass, the results are
+ * prefixed by the stream index and ID. The variants of an HLS or DASH package
+ * and the track files of an IMF composition are prefixed by their name. */
+static int process_tracks(eval_container *ct, FILE *ostream) {
+    const char *path = ct->ffinputs[0];
+    ff_registry *reg = probe_registry(ct, ostream);
+    ff_track *tracks;
+    size_t nb_tracks;
+    int ret = 0;
+    bool imf = !ffio_is_stream(path) && imf_is_input(path);
+    int dispatched;
+    if (imf)
+        dispatched = ffmpeg_dispatch_imf(path, reg, &tracks, &nb_tracks);
+    else if (pkg_is_input(path))
+        dispatched = ffmpeg_dispatch_package(path, reg, &tracks, &nb_tracks);
+    else
+        dispatched = ffmpeg_dispatch_tracks(path, reg, &tracks, &nb_tracks);
+    if (dispatched < 0)
+        ret = 1;
+    size_t found = 0;
+    for (size_t i = 0; i < nb_tracks; i++) {
+        const ff_track *t = &tracks[i];
+        size_t len = 64 + (t->name ? strlen(t->name) : 0);
+        char *prefix = md_malloc(len);
+        if (t->name != NULL)
+            snprintf(prefix, len, "%s %s", imf ? "track file" : "variant",
+                     t->name);
+        else
+            snprintf(prefix, len, "stream %d (id %d)", t->index, t->id);
+        if (t->stats.status == FF_PROBE_FOUND) {
+            scan_print_result(ostream, prefix, t->output);
+            found++;
+        } else {
+            const char *why = t->error ? t->error
+                                       : ff_probe_status_str(t->stats.status);
+            char *msg = md_malloc(strlen(why) + 8);
+            sprintf(msg, "error: %s", why);
+            scan_print_result(ostream, prefix, msg);
+            free(msg);
+        }
+        if (ct->ffstats) {
+            fprintf(stderr, "%s: ", prefix);
+            ff_stats_print(stderr, &t->stats);
+        }
+        free(prefix);
+    }
+    ff_tracks_free(tracks, nb_tracks);
+
+    /* like a single probe, but one resolved track is enough to succeed */
+    ff_probe_status status = reg->stats.status;
+    if (status == FF_PROBE_TIMEOUT || status == FF_PROBE_BYTES)
+        ret = 2;
+    else if (ret == 0 && found == 0) {
+        md_error_custom(ff_probe_status_str(status));
+        ret = 1;
+    }
+    if (ct->ffstats || ret == 2)
+        ff_stats_print(stderr, &reg->stats);
+    ff_registry_free(reg);
+    return ret;
+}
+
+/* probes every input in order, the results are prefixed by the file path like
+ * in -scan mode. Returns the worst status of the inputs: 1 if any failed, else
+ * 2 if the budget of any was exhausted. */
+static int process_batch(eval_container *ct, FILE *ostream) {
+    int ret = 0;
+    size_t failed = 0;
+    for (size_t i = 0; i < ct->nb_ffinputs; i++) {
+        const char *path = ct->ffinputs[i];
+        ff_stats stats;
+        char *result = probe_to_string(ct, path, &stats);
+        int64_t span = trace_begin("write");
+        bool exhausted = false;
+        if (result == NULL) {
+            const size_t len = 256;
+            char *msg = md_malloc(len);
+            snprintf(msg, len, "error: %s",
+                     global_md_error_str(global_md_error));
+            clear_global_md_error();
+            scan_print_result(ostream, path, msg);
+            free(msg);
+            exhausted = stats.status == FF_PROBE_TIMEOUT ||
+                        stats.status == FF_PROBE_BYTES;
+            if (exhausted) {
+                if (ret == 0)
+                    ret = 2;
+            } else {
+                ret = 1;
+                failed++;
+            }
+        } else {
+            scan_print_result(ostream, path, result);
+            free(result);
+        }
+        trace_end("write", span);
+        if (ct->ffstats || exhausted) {
+            fprintf(stderr, "%s: ", path);
+            ff_stats_print(stderr, &stats);
+        }
+    }
+    if (ret == 1) {
+        const size_t len = 64;
+        char *msg = md_malloc(len);
+        snprintf(msg, len, "%zu of %zu inputs failed", failed,
+                 ct->nb_ffinputs);
+        md_error_custom(msg);
+    }
+    return ret;
+}
+
+/* returns true if -follow is combined with an input or mode that is not read
+ * as a single growing file */
+static bool follow_conflicts(const eval_container *ct) {
+    if (ct->ffscan || ct->ffwatch || ct->fftojson || ct->ffcompare ||
+        ct->ffalltracks || ct->ffresume || ct->ffcheckpoint > 0 ||
+        ct->nb_ffinputs != 1)
+        return true;
+    const char *input = ct->ffinputs[0];
+    return ffio_is_stream(input) || pkg_is_input(input) ||
+           bdmv_is_input(input) || imf_is_input(input);
+}
+
+/* returns 0 on success, 1 on error, 2 if the probe budget was exhausted and 3
+ * if -compare found a mismatch. An error is set for 1 and may be for 2. */
+int process_ffmpeg_input(eval_container *ct, FILE *ostream) {
+    if (ct->fffollow >= 0 && follow_conflicts(ct)) {
+        md_error_custom("-follow takes a single video file and cannot be "
+                        "combined with -scan, -watch, -compare, -alltracks "
+                        "or checkpoints");
+        return 1;
+    }
+    if (ct->ffscan != NULL) {
+        unsigned threads = ct->ffthreads ? ct->ffthreads : scan_threads();
+        return scan_tree(ct->ffscan, ct, ostream, threads) < 0 ? 1 : 0;
+    }
+    if (ct->ffwatch != NULL) {
+        /* the events are kept in memory until the process exits, which a
+         * service never does */
+        if (ct->fftrace != NULL) {
+            md_error_custom("-trace cannot be combined with -watch");
+            return 1;
+        }
+        unsigned threads = ct->ffthreads ? ct->ffthreads : scan_threads();
+        /* without -o every file gets a sidecar */
+        FILE *results = ct->output_file ? ostream : NULL;
+        return watch_dir(ct->ffwatch, ct, results, threads) < 0 ? 1 : 0;
+    }
+    if (ct->fftojson != NULL)
+        return process_tojson(ct, ostream);
+    if (ct->nb_ffinputs == 0) {
+        md_error_custom("No input file specified for ffmpeg");
+        return 1;
+    }
+    if (ct->nb_ffinputs > 1 && (ct->ffdynamic || ct->ffresume)) {
+        md_error_custom("-dynamic takes a single input file");
+        return 1;
+    }
+    if (ct->ffcompare != NULL) {
+        if (ct->nb_ffinputs > 1 || ct->ffalltracks || ct->ffbinary ||
+            ct->ffresume || ct->ffcheckpoint > 0) {
+            md_error_custom("-compare takes a single input file and cannot be "
+                            "combined with -alltracks, -binary or checkpoints");
+            return 1;
+        }
+        return compare_inputs(ct->ffinputs[0], ct->ffcompare, ct, ostream);
+    }
+    if (ct->ffalltracks) {
+        if (ct->nb_ffinputs > 1 || ct->ffdynamic) {
+            md_error_custom("-alltracks takes a single input file and cannot "
+                            "be combined with -dynamic");
+            return 1;
+        }
+        return process_tracks(ct, ostream);
+    }
+    if (ct->ffdynamic)
+        return process_dynamic(ct, ostream);
+    if (ct->ffresume) {
+        md_error_custom("Only -dynamic scans can be resumed");
+        return 1;
+    }
+    if (ct->ffbinary) {
+        md_error_custom("Binary output is only available for -dynamic");
+        return 1;
+    }
+    if (ct->nb_ffinputs > 1)
+        return process_batch(ct, ostream);
+    /* packages are probed variant by variant, IMF compositions track file
+     * by track file */
+    const char *input = ct->ffinputs[0];
+    if (!ffio_is_stream(input) && (pkg_is_input(input) || imf_is_input(input)))
+        return process_tracks(ct, ostream);
+
+    ff_registry *reg = probe_registry(ct, ostream);
+    int ret = ffmpeg_dispatch_sidedata(ct->ffinputs[0], reg) < 0 ? 1 : 0;
+
+    /* an exhausted budget is not a failure, report how far the probe got */
+    ff_probe_status status = reg->stats.status;
+    if (ret != 0 && (status == FF_PROBE_TIMEOUT || status == FF_PROBE_BYTES))
+        ret = 2;
+    if (ct->ffstats || ret == 2)
+        ff_stats_print(stderr, &reg->stats);
+    ff_registry_free(reg);
+    return ret;
 }
 
 int main(int argc, char **argv) {
+    int exit_status = 0;
+
     /* parse command line */
-    cmdline_switch *sw = cmdline_parse(argc, argv);
+    cmdline *cl = eval_parse(argc, argv);
     exit_on_error();
-    if (sw == NULL) {
+    if (cl->nb_switches == 0) {
         print_usage();
+        cmdline_free(cl);
         return 0;
     }
 
     /* evaluate command line */
     eval_container *ct = eval_container_alloc();
-    eval_cmdline(ct, sw);
+    eval_cmdline(ct, cl);
     exit_on_error();
 
     /* free command line parser memory */
-    cmdline_free(sw);
+    cmdline_free(cl);
 
     if (ct->type == EVAL_UNDEFINED || ct->type == EVAL_GLOBAL) {
         print_usage();
     } else {
 
-        FILE *ostream = open_output_stream(ct->output_file);
+        FILE *ostream = open_output_stream(ct->output_file, ct->ffresume);
         exit_on_error();
+        if (ct->fftrace != NULL) {
+            trace_open(ct->fftrace);
+            exit_on_error();
+        }
 
         switch (ct->type) {
         case EVAL_PRIMARY:
             manual_metadata_input(ct, ostream);
             break;
-        case EVAL_FFMPEG:
-            process_ffmpeg_input(ct, ostream);
+        case EVAL_FFMPEG: {
+            int status = process_ffmpeg_input(ct, ostream);
+            /* for 2 statistics were printed and partial results are kept, 3
+             * reports inputs that -compare found to differ */
+            if (status == 2 || status == 3) {
+                exit_status = status;
+                clear_global_md_error();
+            }
             break;
+        }
         default:
             md_bug(__FILE__, __LINE__, false);
         }
+        /* failed probes are traced, too */
+        trace_close();
         exit_on_error();
 
         /* cleanup */
@@ -107,5 +457,5 @@ int main(int argc, char **argv) {
     }
     /* cleanup */
     eval_container_free(ct);
-    return 0;
+    return exit_status;
 }
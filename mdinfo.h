@@ -59,6 +59,15 @@ disp_meta_x265 *disp_meta_x265_alloc();
 /*destructor for disp_meta_x265*/
 void disp_meta_x265_free(disp_meta_x265 *meta);
 
+/* point_to_point_x265 converts a chromaticity coordinate to units of 0.00002,
+ * helper of meta_to_x265. Returns NULL and sets global_md_error if p is out
+ * of range. */
+point_x265 *point_to_point_x265(const point *p);
+
+/* lum_to_x265 converts a luminance in cd/m^2 to units of 0.0001 cd/m^2,
+ * helper of meta_to_x265. Sets global_md_error if lum is out of range. */
+uint32_t lum_to_x265(double lum);
+
 /* meta_to_x265 converts hdr display metadata to a format that can be used with
  * x265. In case of an error the function returns NULL and sets global_md_error
  * to something else than ERR_NONE.
@@ -0,0 +1,256 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "mpegts.h"
+#include "budget.h"
+#include "errors.h"
+#include "hevcsei.h"
+#include "wrappers.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TS_SYNC 0x47
+#define TS_PACKET 188
+#define TS_PID_PAT 0x0000
+#define TS_PID_NULL 0x1FFF
+#define TS_MAX_PMTS 16
+/* packets read per fread call */
+#define TS_BATCH 512
+
+/* PSI section being assembled from one or more packets */
+typedef struct ts_section {
+    uint8_t data[1024 + 3];
+    size_t size;
+    bool started;
+} ts_section;
+
+typedef struct ts_scanner {
+    int packet_size;
+    int video_pid;
+    int pmt_pids[TS_MAX_PMTS];
+    ts_section pmts[TS_MAX_PMTS]; /* the PMTs of the programs interleave */
+    int nb_pmts;
+    ts_section pat;
+    /* PES of the video PID that is being reassembled */
+    uint8_t *pes;
+    size_t pes_size;
+    size_t pes_alloc;
+    bool pes_started;
+    hevc_sei *sei;
+    unsigned iraps; /* IRAP access units without mastering display SEI */
+} ts_scanner;
+
+int ts_probe(const char *path) {
+    uint8_t buf[192 * 3];
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return 0;
+    size_t n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    if (n == sizeof(buf) && buf[4] == TS_SYNC && buf[196] == TS_SYNC &&
+        buf[388] == TS_SYNC)
+        return 192;
+    if (n >= 188 * 3 && buf[0] == TS_SYNC && buf[188] == TS_SYNC &&
+        buf[376] == TS_SYNC)
+        return 188;
+    return 0;
+}
+
+/* appends the payload of a PSI packet to sec, returns true if the section is
+ * complete */
+static bool section_add(ts_section *sec, const uint8_t *p, size_t size,
+                        bool unit_start) {
+    if (unit_start) {
+        size_t pointer = p[0];
+        if (pointer + 1 > size)
+            return false;
+        p += pointer + 1;
+        size -= pointer + 1;
+        sec->size = 0;
+        sec->started = true;
+    } else if (!sec->started)
+        return false;
+    size_t room = sizeof(sec->data) - sec->size;
+    if (size > room)
+        size = room;
+    memcpy(sec->data + sec->size, p, size);
+    sec->size += size;
+    if (sec->size < 3)
+        return false;
+    size_t length = (((sec->data[1] & 0x0f) << 8) | sec->data[2]) + 3;
+    if (sec->size < length)
+        return false;
+    sec->started = false;
+    sec->size = length;
+    return true;
+}
+
+static void parse_pat(ts_scanner *ts) {
+    const uint8_t *d = ts->pat.data;
+    if (d[0] != 0x00 || ts->pat.size < 12)
+        return;
+    /* skip the 8 byte header, stop before the CRC */
+    for (size_t i = 8; i + 4 <= ts->pat.size - 4; i += 4) {
+        int program = (d[i] << 8) | d[i + 1];
+        int pid = ((d[i + 2] & 0x1f) << 8) | d[i + 3];
+        if (program == 0)
+            continue; /* network PID */
+        bool known = false;
+        for (int j = 0; j < ts->nb_pmts; j++)
+            known |= ts->pmt_pids[j] == pid;
+        if (!known && ts->nb_pmts < TS_MAX_PMTS)
+            ts->pmt_pids[ts->nb_pmts++] = pid;
+    }
+}
+
+static void parse_pmt(ts_scanner *ts, const ts_section *pmt) {
+    const uint8_t *d = pmt->data;
+    if (d[0] != 0x02 || pmt->size < 16)
+        return;
+    size_t end = pmt->size - 4; /* CRC */
+    size_t pos = 12 + (((d[10] & 0x0f) << 8) | d[11]);
+    while (pos + 5 <= end) {
+        int stream_type = d[pos];
+        int pid = ((d[pos + 1] & 0x1f) << 8) | d[pos + 2];
+        size_t es_info = ((d[pos + 3] & 0x0f) << 8) | d[pos + 4];
+        if (stream_type == TS_STREAM_TYPE_HEVC) {
+            ts->video_pid = pid;
+            return;
+        }
+        pos += 5 + es_info;
+    }
+}
+
+/* hands a complete PES to the SEI parser */
+static void pes_flush(ts_scanner *ts) {
+    if (!ts->pes_started)
+        return;
+    ts->pes_started = false;
+    if (ts->pes_size < 9 || ts->pes[0] != 0 || ts->pes[1] != 0 ||
+        ts->pes[2] != 1)
+        return;
+    size_t header = 9 + ts->pes[8];
+    if (header >= ts->pes_size)
+        return;
+    /* access units are judged separately, the mastering display SEI has to
+     * come with the IRAP picture */
+    ts->sei->has_irap = false;
+    ts->sei->has_mdcv = false;
+    hevc_parse_annexb(ts->pes + header, ts->pes_size - header, ts->sei);
+    if (ts->sei->has_irap && !ts->sei->has_mdcv)
+        ts->iraps++;
+}
+
+static void pes_add(ts_scanner *ts, const uint8_t *p, size_t size,
+                    bool unit_start) {
+    if (unit_start) {
+        pes_flush(ts);
+        ts->pes_size = 0;
+        ts->pes_started = true;
+    } else if (!ts->pes_started)
+        return; /* joined in the middle of a PES */
+    if (ts->pes_size + size > ts->pes_alloc) {
+        ts->pes_alloc = (ts->pes_size + size) * 2;
+        ts->pes = md_realloc(ts->pes, ts->pes_alloc);
+    }
+    memcpy(ts->pes + ts->pes_size, p, size);
+    ts->pes_size += size;
+}
+
+/* true once an IRAP access unit with mastering display metadata was seen */
+static bool scan_found(const ts_scanner *ts) {
+    return ts->sei->has_irap && ts->sei->has_mdcv;
+}
+
+/* true once the metadata was found or enough IRAP access units went without
+ * it that the stream is not going to carry it */
+static bool scan_done(const ts_scanner *ts) {
+    return scan_found(ts) || ts->iraps >= TS_SCAN_IRAPS;
+}
+
+static void parse_packet(ts_scanner *ts, const uint8_t *p) {
+    if (p[0] != TS_SYNC)
+        return;
+    int pid = ((p[1] & 0x1f) << 8) | p[2];
+    ts_section *pmt = NULL;
+    for (int i = 0; i < ts->nb_pmts; i++) {
+        if (ts->pmt_pids[i] == pid)
+            pmt = &ts->pmts[i];
+    }
+    /* drop every PID that is of no interest as early as possible */
+    if (pid != ts->video_pid && (ts->video_pid >= 0 || (pid != TS_PID_PAT &&
+                                                        pmt == NULL)))
+        return;
+    if (p[1] & 0x80)
+        return; /* transport error */
+    bool unit_start = p[1] & 0x40;
+    int afc = (p[3] >> 4) & 0x03;
+    if (!(afc & 0x01))
+        return; /* no payload */
+    size_t offset = 4;
+    if (afc & 0x02)
+        offset += 1 + p[4];
+    if (offset >= TS_PACKET)
+        return;
+    const uint8_t *payload = p + offset;
+    size_t size = TS_PACKET - offset;
+
+    if (pid == ts->video_pid)
+        pes_add(ts, payload, size, unit_start);
+    else if (pid == TS_PID_PAT) {
+        if (section_add(&ts->pat, payload, size, unit_start))
+            parse_pat(ts);
+    } else if (section_add(pmt, payload, size, unit_start))
+        parse_pmt(ts, pmt);
+}
+
+int ts_scan_hevc(const char *path, int pid, uint64_t limit,
+                 probe_budget *budget, hevc_sei *sei, unsigned *iraps) {
+    int packet_size = ts_probe(path);
+    if (packet_size == 0) {
+        md_error_custom("Input is not an MPEG transport stream");
+        return -1;
+    }
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        md_error_custom(strerror(errno));
+        return -1;
+    }
+    ts_scanner *ts = md_calloc(1, sizeof(ts_scanner));
+    ts->packet_size = packet_size;
+    ts->video_pid = pid;
+    ts->sei = sei;
+    memset(sei, 0, sizeof(hevc_sei));
+
+    /* M2TS packets carry a 4 byte timestamp before the TS packet */
+    size_t skip = packet_size - TS_PACKET;
+    uint8_t *buf = md_malloc((size_t)packet_size * TS_BATCH);
+    uint64_t total = 0;
+    while (!scan_done(ts) && (limit == 0 || total < limit)) {
+        /* other threads may have used up a shared budget */
+        if (budget != NULL && budget_expired(budget))
+            break;
+        size_t n = fread(buf, packet_size, TS_BATCH, f);
+        if (n == 0)
+            break;
+        total += n * packet_size;
+        if (budget != NULL)
+            budget->bytes += n * packet_size;
+        for (size_t i = 0; i < n && !scan_done(ts); i++)
+            parse_packet(ts, buf + i * packet_size + skip);
+    }
+    /* the last PES of the scanned range is complete at end of file only */
+    if (!scan_done(ts) && feof(f))
+        pes_flush(ts);
+
+    bool found = scan_found(ts);
+    if (iraps != NULL)
+        *iraps = ts->iraps;
+    free(buf);
+    free(ts->pes);
+    free(ts);
+    fclose(f);
+    return found ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_MPEGTS
+#define _INCL_MPEGTS
+
+#include "budget.h"
+#include "hevcsei.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TS_STREAM_TYPE_HEVC 0x24
+
+/* default amount of bytes ts_scan_hevc reads before giving up, a few GOPs of
+ * a typical broadcast. If that does not reach an IRAP access unit, reading
+ * on is left to libavformat. */
+#define TS_SCAN_LIMIT (512 * 1024)
+/* IRAP access units without mastering display SEI after which ts_scan_hevc
+ * gives up, the SEI is repeated with every IRAP picture if present at all */
+#define TS_SCAN_IRAPS 2
+
+/* ts_probe returns the packet size (188 for MPEG-TS, 192 for BDAV M2TS) if the
+ * file at path looks like a transport stream, 0 otherwise */
+int ts_probe(const char *path);
+
+/* ts_scan_hevc reads the transport stream at path packet by packet. Only the
+ * PAT, the PMTs and the HEVC video PID are looked at, every other packet is
+ * skipped. The PES payloads of the video PID are reassembled and handed to
+ * the SEI parser until an IRAP access unit carrying a mastering display SEI
+ * was found, TS_SCAN_IRAPS IRAP access units went without one or limit bytes
+ * were read. If pid is not negative it is used as video PID and the PAT/PMT
+ * lookup is skipped. If budget is not NULL, the bytes read are accounted to
+ * it and the scan stops once it is expired. If iraps is not NULL it receives
+ * the number of IRAP access units without the metadata. Returns 1 if the
+ * metadata was found, 0 if not and -1 on error (error is set). */
+int ts_scan_hevc(const char *path, int pid, uint64_t limit,
+                 probe_budget *budget, hevc_sei *sei, unsigned *iraps);
+
+#endif
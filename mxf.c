@@ -0,0 +1,472 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "mxf.h"
+#include "budget.h"
+#include "errors.h"
+#include "hevcsei.h"
+#include "wrappers.h"
+#include "xml.h"
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/* the header partition pack follows a run-in of at most this size */
+#define MXF_MAX_RUN_IN 65536
+
+/* partition packs and the primer pack, byte 13 tells which */
+static const uint8_t pack_key[13] = {0x06, 0x0e, 0x2b, 0x34, 0x02,
+                                     0x05, 0x01, 0x01, 0x0d, 0x01,
+                                     0x02, 0x01, 0x01};
+#define PACK_HEADER 0x02
+#define PACK_PRIMER 0x05
+
+/* ST 2067-21 MasteringDisplayPrimaries, MasteringDisplayWhitePointChromaticity,
+ * MasteringDisplayMaximumLuminance and MasteringDisplayMinimumLuminance,
+ * byte 13 tells which */
+static const uint8_t mastering_ul[13] = {0x06, 0x0e, 0x2b, 0x34, 0x01,
+                                         0x01, 0x01, 0x0e, 0x04, 0x20,
+                                         0x04, 0x01, 0x01};
+
+static uint16_t rd16(const uint8_t *p) { return (uint16_t)(p[0] << 8 | p[1]); }
+
+static uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+           p[3];
+}
+
+static uint64_t rd64(const uint8_t *p) {
+    return (uint64_t)rd32(p) << 32 | rd32(p + 4);
+}
+
+static bool has_suffix(const char *s, const char *suffix) {
+    size_t len = strlen(s), slen = strlen(suffix);
+    return len > slen && !strcasecmp(s + len - slen, suffix);
+}
+
+/* compares the first n bytes of the universal labels a and b, byte 7 is the
+ * version of the registry and not significant */
+static bool ul_match(const uint8_t *a, const uint8_t *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (i != 7 && a[i] != b[i])
+            return false;
+    }
+    return true;
+}
+
+typedef struct klv {
+    const uint8_t *key;
+    const uint8_t *value;
+    size_t size; /* of the value, clipped to the buffer */
+} klv;
+
+/* reads the KLV packet at *pos of buf and advances pos behind it. Returns
+ * false if there is no complete key and length at pos. */
+static bool next_klv(const uint8_t *buf, size_t size, size_t *pos, klv *k) {
+    if (*pos >= size || size - *pos < 17)
+        return false;
+    const uint8_t *p = buf + *pos;
+    if (memcmp(p, pack_key, 4))
+        return false; /* not a SMPTE universal label */
+    size_t header = 17;
+    uint64_t length = p[16];
+    if (length & 0x80) {
+        /* BER long form */
+        size_t bytes = length & 0x7f;
+        if (bytes == 0 || bytes > 8 || size - *pos < 17 + bytes)
+            return false;
+        length = 0;
+        for (size_t i = 0; i < bytes; i++)
+            length = length << 8 | p[17 + i];
+        header += bytes;
+    }
+    size_t avail = size - *pos - header;
+    k->key = p;
+    k->value = p + header;
+    k->size = length < avail ? (size_t)length : avail;
+    *pos += header + k->size;
+    return true;
+}
+
+/* maps the local tags of the header metadata to universal labels */
+typedef struct primer {
+    const uint8_t *entries; /* 2 byte tag and 16 byte label each */
+    uint32_t count;
+} primer;
+
+static const uint8_t *primer_ul(const primer *pr, uint16_t tag) {
+    for (uint32_t i = 0; i < pr->count; i++) {
+        const uint8_t *e = pr->entries + 18 * (size_t)i;
+        if (rd16(e) == tag)
+            return e + 2;
+    }
+    return NULL;
+}
+
+/* MasteringDisplay items as coded */
+typedef struct mastering_items {
+    uint16_t primaries[3][2];
+    uint16_t white_point[2];
+    uint32_t max_luminance;
+    uint32_t min_luminance;
+    unsigned found; /* bit n - 1 for item n */
+} mastering_items;
+
+/* collects the MasteringDisplay items of the local set in v */
+static void parse_set(const uint8_t *v, size_t size, const primer *pr,
+                      mastering_items *items) {
+    size_t pos = 0;
+    while (size - pos >= 4) {
+        uint16_t tag = rd16(v + pos);
+        uint16_t len = rd16(v + pos + 2);
+        const uint8_t *d = v + pos + 4;
+        pos += 4;
+        if (len > size - pos)
+            return;
+        pos += len;
+        const uint8_t *ul = primer_ul(pr, tag);
+        if (ul == NULL || !ul_match(ul, mastering_ul, 13))
+            continue;
+        switch (ul[13]) {
+        case 1:
+            if (len < 12)
+                break;
+            for (int c = 0; c < 3; c++) {
+                items->primaries[c][0] = rd16(d + 4 * c);
+                items->primaries[c][1] = rd16(d + 4 * c + 2);
+            }
+            items->found |= 1;
+            break;
+        case 2:
+            if (len < 4)
+                break;
+            items->white_point[0] = rd16(d);
+            items->white_point[1] = rd16(d + 2);
+            items->found |= 2;
+            break;
+        case 3:
+            if (len < 4)
+                break;
+            items->max_luminance = rd32(d);
+            items->found |= 4;
+            break;
+        case 4:
+            if (len < 4)
+                break;
+            items->min_luminance = rd32(d);
+            items->found |= 8;
+            break;
+        }
+    }
+}
+
+/* stores items in sei in the order of the SEI message */
+static void conv_items(const mastering_items *items, hevc_sei *sei) {
+    /* the order of the primaries is not agreed on between writers, so they
+     * are told apart by their coordinates: red has the largest x and green
+     * the largest y */
+    const uint16_t(*p)[2] = items->primaries;
+    int r = 0;
+    for (int c = 1; c < 3; c++) {
+        if (p[c][0] > p[r][0])
+            r = c;
+    }
+    int g = r == 0 ? 1 : 0;
+    for (int c = 0; c < 3; c++) {
+        if (c != r && p[c][1] > p[g][1])
+            g = c;
+    }
+    int b = 3 - r - g;
+    const int order[3] = {g, b, r};
+    for (int c = 0; c < 3; c++) {
+        sei->mdcv.primaries[c][0] = p[order[c]][0];
+        sei->mdcv.primaries[c][1] = p[order[c]][1];
+    }
+    sei->mdcv.white_point[0] = items->white_point[0];
+    sei->mdcv.white_point[1] = items->white_point[1];
+    sei->mdcv.max_luminance = items->max_luminance;
+    sei->mdcv.min_luminance = items->min_luminance;
+    sei->has_mdcv = true;
+}
+
+int mxf_parse_header(const uint8_t *buf, size_t size, hevc_sei *sei) {
+    memset(sei, 0, sizeof(hevc_sei));
+    size_t pos = 0;
+    size_t run_in = size < MXF_MAX_RUN_IN ? size : MXF_MAX_RUN_IN;
+    while (pos + 16 <= run_in && !(ul_match(buf + pos, pack_key, 13) &&
+                                   buf[pos + 13] == PACK_HEADER))
+        pos++;
+    if (pos + 16 > run_in)
+        return -1;
+    klv k;
+    if (!next_klv(buf, size, &pos, &k) || k.size < 40)
+        return -1;
+    /* the header metadata follows the partition pack */
+    uint64_t header_bytes = rd64(k.value + 32);
+    size_t end = size;
+    if (header_bytes > 0 && header_bytes < size - pos)
+        end = pos + (size_t)header_bytes;
+
+    primer pr = {.entries = NULL, .count = 0};
+    mastering_items items;
+    memset(&items, 0, sizeof(items));
+    while (items.found != 0xf && next_klv(buf, end, &pos, &k)) {
+        if (ul_match(k.key, pack_key, 13) && k.key[13] == PACK_PRIMER) {
+            if (k.size < 8 || rd32(k.value + 4) != 18)
+                continue;
+            uint32_t count = rd32(k.value);
+            if (count > (k.size - 8) / 18)
+                count = (uint32_t)((k.size - 8) / 18);
+            pr.entries = k.value + 8;
+            pr.count = count;
+        } else if (ul_match(k.key, pack_key, 13))
+            break; /* the next partition */
+        else if (k.key[4] == 0x02 && k.key[5] == 0x53 && pr.entries != NULL)
+            parse_set(k.value, k.size, &pr, &items); /* 2 byte local tags */
+        else if (k.key[4] == 0x01 && k.key[5] == 0x02)
+            break; /* essence */
+    }
+    if (items.found != 0xf)
+        return 0;
+    conv_items(&items, sei);
+    return 1;
+}
+
+static void path_error(const char *path, const char *msg) {
+    size_t len = strlen(path) + strlen(msg) + 3;
+    char *buf = md_malloc(len);
+    snprintf(buf, len, "%s: %s", path, msg);
+    md_error_custom(buf);
+}
+
+/* reads up to limit bytes from the start of path, the buffer is NUL
+ * terminated. Returns NULL and sets an error if the file cannot be read. */
+static uint8_t *read_head(const char *path, size_t limit, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        path_error(path, strerror(errno));
+        return NULL;
+    }
+    uint8_t *buf = md_malloc(limit + 1);
+    *size = fread(buf, 1, limit, f);
+    buf[*size] = '\0';
+    bool failed = ferror(f);
+    fclose(f);
+    if (failed) {
+        path_error(path, "Read error");
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+bool mxf_is_input(const char *path) { return has_suffix(path, ".mxf"); }
+
+int mxf_probe(const char *path, probe_budget *budget, hevc_sei *sei) {
+    if (budget != NULL && budget_expired(budget)) {
+        memset(sei, 0, sizeof(hevc_sei));
+        return 0;
+    }
+    size_t size;
+    uint8_t *buf = read_head(path, MXF_HEADER_LIMIT, &size);
+    if (buf == NULL)
+        return -1;
+    if (budget != NULL)
+        budget->bytes += size;
+    int ret = mxf_parse_header(buf, size, sei);
+    free(buf);
+    if (ret < 0)
+        path_error(path, "Not an MXF file");
+    return ret;
+}
+
+bool imf_is_input(const char *path) {
+    if (!has_suffix(path, ".xml"))
+        return false;
+    size_t size;
+    char *head = (char *)read_head(path, 4096, &size);
+    if (head == NULL) {
+        clear_global_md_error();
+        return false;
+    }
+    bool cpl = strstr(head, "CompositionPlaylist") != NULL;
+    free(head);
+    return cpl;
+}
+
+/* reads and parses the XML document at path, whose root must be called
+ * root. Returns NULL and sets an error otherwise. */
+static xml_node *read_xml(const char *path, const char *root) {
+    size_t size;
+    char *buf = (char *)read_head(path, IMF_MAX_XML, &size);
+    if (buf == NULL)
+        return NULL;
+    xml_node *doc = xml_parse(buf, size);
+    free(buf);
+    if (doc != NULL && strcmp(doc->name, root)) {
+        xml_free(doc);
+        doc = NULL;
+        path_error(path, "Unexpected XML document");
+    }
+    return doc;
+}
+
+/* returns the character data of node without surrounding blanks or NULL */
+static char *node_text(const xml_node *node) {
+    if (node == NULL || node->text == NULL)
+        return NULL;
+    const char *s = node->text;
+    while (isspace((unsigned char)*s))
+        s++;
+    size_t len = strlen(s);
+    while (len > 0 && isspace((unsigned char)s[len - 1]))
+        len--;
+    char *text = md_malloc(len + 1);
+    memcpy(text, s, len);
+    text[len] = '\0';
+    return text;
+}
+
+/* returns the path of the first chunk of the asset id in the asset map,
+ * relative to its directory, or NULL */
+static char *asset_path(const xml_node *map, const char *id) {
+    const xml_node *list = xml_child(map, "AssetList");
+    for (const xml_node *a = list ? xml_child(list, "Asset") : NULL;
+         a != NULL; a = xml_next(a, "Asset")) {
+        char *aid = node_text(xml_child(a, "Id"));
+        bool match = aid != NULL && !strcasecmp(aid, id);
+        free(aid);
+        if (!match)
+            continue;
+        const xml_node *chunks = xml_child(a, "ChunkList");
+        const xml_node *chunk = chunks ? xml_child(chunks, "Chunk") : NULL;
+        return chunk ? node_text(xml_child(chunk, "Path")) : NULL;
+    }
+    return NULL;
+}
+
+/* appends the track file of resource res to files unless it is there */
+static int add_track_file(const xml_node *res, const xml_node *map,
+                          const char *dir, char ***files, size_t *nb_files) {
+    char *id = node_text(xml_child(res, "TrackFileId"));
+    if (id == NULL)
+        return 0; /* not a track file resource */
+    char *rel = asset_path(map, id);
+    if (rel == NULL) {
+        path_error(id, "Track file is not in the asset map");
+        free(id);
+        return -1;
+    }
+    free(id);
+    size_t dlen = rel[0] == '/' ? 0 : strlen(dir);
+    char *path = md_malloc(dlen + strlen(rel) + 1);
+    memcpy(path, dir, dlen);
+    strcpy(path + dlen, rel);
+    free(rel);
+    for (size_t i = 0; i < *nb_files; i++) {
+        if (!strcmp((*files)[i], path)) {
+            free(path);
+            return 0;
+        }
+    }
+    *files = md_realloc(*files, (*nb_files + 1) * sizeof(char *));
+    (*files)[(*nb_files)++] = path;
+    return 0;
+}
+
+char **imf_track_files(const char *path, size_t *nb_files) {
+    *nb_files = 0;
+    const char *slash = strrchr(path, '/');
+    size_t dlen = slash ? (size_t)(slash - path + 1) : 0;
+    char *dir = md_malloc(dlen + 1);
+    memcpy(dir, path, dlen);
+    dir[dlen] = '\0';
+    char *map_path = md_malloc(dlen + sizeof("ASSETMAP.xml"));
+    sprintf(map_path, "%sASSETMAP.xml", dir);
+
+    char **files = NULL;
+    xml_node *cpl = read_xml(path, "CompositionPlaylist");
+    xml_node *map = cpl ? read_xml(map_path, "AssetMap") : NULL;
+    int ret = map ? 0 : -1;
+    const xml_node *segments = map ? xml_child(cpl, "SegmentList") : NULL;
+    for (const xml_node *seg = segments ? xml_child(segments, "Segment") : NULL;
+         ret == 0 && seg != NULL; seg = xml_next(seg, "Segment")) {
+        const xml_node *seqs = xml_child(seg, "SequenceList");
+        for (const xml_node *seq =
+                 seqs ? xml_child(seqs, "MainImageSequence") : NULL;
+             ret == 0 && seq != NULL;
+             seq = xml_next(seq, "MainImageSequence")) {
+            const xml_node *list = xml_child(seq, "ResourceList");
+            for (const xml_node *res =
+                     list ? xml_child(list, "Resource") : NULL;
+                 ret == 0 && res != NULL; res = xml_next(res, "Resource"))
+                ret = add_track_file(res, map, dir, &files, nb_files);
+        }
+    }
+    if (ret == 0 && *nb_files == 0) {
+        path_error(path, "CPL without main image track file");
+        ret = -1;
+    }
+    if (ret < 0) {
+        for (size_t i = 0; i < *nb_files; i++)
+            free(files[i]);
+        free(files);
+        files = NULL;
+        *nb_files = 0;
+    }
+    if (map != NULL)
+        xml_free(map);
+    if (cpl != NULL)
+        xml_free(cpl);
+    free(map_path);
+    free(dir);
+    return files;
+}
+
+typedef struct mxf_job {
+    const char *path;
+    probe_budget *budget; /* shared by the jobs */
+    mxf_result *result;
+    pthread_t thread;
+    bool started;
+} mxf_job;
+
+static void *mxf_worker(void *arg) {
+    mxf_job *job = arg;
+    mxf_result *res = job->result;
+    res->ret = mxf_probe(job->path, job->budget, &res->sei);
+    if (res->ret < 0) {
+        /* errors are per thread */
+        res->error = md_strdup(global_md_error_str(global_md_error));
+        clear_global_md_error();
+    }
+    return NULL;
+}
+
+void mxf_scan(char *const *paths, size_t nb_files, probe_budget *budget,
+              mxf_result *results) {
+    mxf_job jobs[MXF_MAX_THREADS];
+    size_t i = 0;
+    while (i < nb_files && !budget_expired(budget)) {
+        size_t n = 0;
+        for (; i < nb_files && n < MXF_MAX_THREADS; i++) {
+            mxf_job *job = &jobs[n++];
+            job->path = paths[i];
+            job->budget = budget;
+            job->result = &results[i];
+            job->started = nb_files > 1 && pthread_create(&job->thread, NULL,
+                                                          &mxf_worker,
+                                                          job) == 0;
+            if (!job->started)
+                mxf_worker(job);
+        }
+        for (size_t k = 0; k < n; k++) {
+            if (jobs[k].started)
+                pthread_join(jobs[k].thread, NULL);
+        }
+    }
+}
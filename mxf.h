@@ -0,0 +1,58 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_MXF
+#define _INCL_MXF
+
+#include "budget.h"
+#include "hevcsei.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* amount of bytes read from the start of an MXF file, the header metadata
+ * has to fit in */
+#define MXF_HEADER_LIMIT (512 * 1024)
+/* CPLs and asset maps larger than this are not read completely */
+#define IMF_MAX_XML (16 * 1024 * 1024)
+/* track files that are read at the same time */
+#define MXF_MAX_THREADS 16
+
+/* mxf_is_input returns true if path names an MXF file */
+bool mxf_is_input(const char *path);
+
+/* mxf_parse_header parses the header partition of an MXF file in buf, which
+ * holds the start of the file, for the ST 2067-21 MasteringDisplay items of
+ * a picture descriptor. The values are stored in sei->mdcv like those of a
+ * mastering display SEI. Returns 1 if every item was found, 0 if not and -1
+ * if buf is not the start of an MXF file. */
+int mxf_parse_header(const uint8_t *buf, size_t size, hevc_sei *sei);
+
+/* mxf_probe reads up to MXF_HEADER_LIMIT bytes of the MXF file at path and
+ * parses them with mxf_parse_header. The bytes read are accounted to budget,
+ * nothing is read once it is exhausted. Returns like mxf_parse_header, an
+ * error is set for -1. */
+int mxf_probe(const char *path, probe_budget *budget, hevc_sei *sei);
+
+/* imf_is_input returns true if path is an IMF composition playlist */
+bool imf_is_input(const char *path);
+
+/* imf_track_files returns the paths of the distinct track files of the main
+ * image sequences of the CPL at path, as listed by the ASSETMAP.xml in the
+ * directory of the CPL. The list and its paths must be freed. Returns NULL
+ * and sets an error if the CPL or the asset map cannot be read or a track
+ * file is missing from the asset map. */
+char **imf_track_files(const char *path, size_t *nb_files);
+
+/* what mxf_scan found in a track file */
+typedef struct mxf_result {
+    int ret;     /* like mxf_probe */
+    char *error; /* message if ret is -1, must be freed */
+    hevc_sei sei;
+} mxf_result;
+
+/* mxf_scan probes the nb_files MXF files in paths with mxf_probe on up to
+ * MXF_MAX_THREADS threads. results must have an entry per file. The bytes
+ * read are accounted to budget. */
+void mxf_scan(char *const *paths, size_t nb_files, probe_budget *budget,
+              mxf_result *results);
+
+#endif
@@ -0,0 +1,758 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "package.h"
+#include "budget.h"
+#include "errors.h"
+#include "hevcsei.h"
+#include "mpegts.h"
+#include "wrappers.h"
+#include "xml.h"
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+
+#define BOX(a, b, c, d)                                                        \
+    ((uint32_t)(a) << 24 | (uint32_t)(b) << 16 | (uint32_t)(c) << 8 |          \
+     (uint32_t)(d))
+
+static uint16_t rd16(const uint8_t *p) { return (uint16_t)(p[0] << 8 | p[1]); }
+
+static uint32_t rd32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+           p[3];
+}
+
+static uint64_t rd64(const uint8_t *p) {
+    return (uint64_t)rd32(p) << 32 | rd32(p + 4);
+}
+
+static bool has_suffix(const char *s, const char *suffix) {
+    size_t len = strlen(s), slen = strlen(suffix);
+    return len > slen && !strcasecmp(s + len - slen, suffix);
+}
+
+static char *copy_str(const char *s, size_t len) {
+    char *copy = md_malloc(len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+bool pkg_is_input(const char *path) {
+    return has_suffix(path, ".m3u8") || has_suffix(path, ".mpd");
+}
+
+static void path_error(const char *path, const char *msg) {
+    size_t len = strlen(path) + strlen(msg) + 3;
+    char *buf = md_malloc(len);
+    snprintf(buf, len, "%s: %s", path, msg);
+    md_error_custom(buf);
+}
+
+/* reads up to limit bytes of path from offset on, length -1 meaning up to
+ * the end. The buffer is NUL terminated. Returns NULL and sets an error if
+ * the file cannot be read. */
+static uint8_t *read_part(const char *path, uint64_t offset, int64_t length,
+                          size_t limit, size_t *size) {
+    if (strstr(path, "://") != NULL) {
+        path_error(path, "Remote segments are not supported");
+        return NULL;
+    }
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        path_error(path, strerror(errno));
+        return NULL;
+    }
+    if (offset > 0 && fseeko(f, (off_t)offset, SEEK_SET) < 0) {
+        path_error(path, strerror(errno));
+        fclose(f);
+        return NULL;
+    }
+    if (length >= 0 && (uint64_t)length < limit)
+        limit = (size_t)length;
+    uint8_t *buf = md_malloc(limit + 1);
+    *size = fread(buf, 1, limit, f);
+    buf[*size] = '\0';
+    bool failed = ferror(f);
+    fclose(f);
+    if (failed) {
+        path_error(path, "Read error");
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+/* decodes the %XX escapes of len bytes of s */
+static char *percent_decode(const char *s, size_t len) {
+    char *out = md_malloc(len + 1);
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '%' && i + 2 < len && isxdigit((unsigned char)s[i + 1]) &&
+            isxdigit((unsigned char)s[i + 2])) {
+            char hex[3] = {s[i + 1], s[i + 2], '\0'};
+            out[n++] = (char)strtol(hex, NULL, 16);
+            i += 2;
+        } else
+            out[n++] = s[i];
+    }
+    out[n] = '\0';
+    return out;
+}
+
+/* resolves the URI ref against base, which is the path of a file or a
+ * directory ending with a slash. Local references lose their query and
+ * fragment, remote ones are kept as they are. */
+static char *resolve(const char *base, const char *ref) {
+    if (!strncmp(ref, "file://", 7))
+        ref += 7;
+    else if (strstr(ref, "://") != NULL)
+        return md_strdup(ref);
+    char *path = percent_decode(ref, strcspn(ref, "?#"));
+    if (path[0] == '/')
+        return path;
+    const char *slash = strrchr(base, '/');
+    size_t dlen = slash ? (size_t)(slash - base + 1) : 0;
+    char *out = md_malloc(dlen + strlen(path) + 1);
+    memcpy(out, base, dlen);
+    strcpy(out + dlen, path);
+    free(path);
+    return out;
+}
+
+static pkg_variant *add_variant(pkg_package *pkg, const char *name) {
+    pkg->variants = md_realloc(pkg->variants,
+                               (pkg->nb_variants + 1) * sizeof(pkg_variant));
+    pkg_variant *v = &pkg->variants[pkg->nb_variants++];
+    memset(v, 0, sizeof(pkg_variant));
+    v->name = md_strdup(name);
+    v->init.length = -1;
+    v->segment.length = -1;
+    return v;
+}
+
+void pkg_free(pkg_package *pkg) {
+    for (size_t i = 0; i < pkg->nb_variants; i++) {
+        free(pkg->variants[i].name);
+        free(pkg->variants[i].init.path);
+        free(pkg->variants[i].segment.path);
+    }
+    free(pkg->variants);
+    free(pkg);
+}
+
+/* returns the value of the attribute name in the attribute list of an HLS
+ * tag or NULL */
+static char *hls_attr(const char *list, const char *name) {
+    size_t nlen = strlen(name);
+    const char *p = list;
+    while (*p) {
+        while (*p == ',' || *p == ' ')
+            p++;
+        const char *eq = strchr(p, '=');
+        if (eq == NULL)
+            return NULL;
+        bool match = (size_t)(eq - p) == nlen && !strncmp(p, name, nlen);
+        const char *value = eq + 1;
+        const char *end, *next;
+        if (*value == '"') {
+            value++;
+            end = strchr(value, '"');
+            if (end == NULL)
+                return NULL;
+            next = end + 1;
+        } else {
+            end = value + strcspn(value, ",");
+            next = end;
+        }
+        if (match)
+            return copy_str(value, end - value);
+        p = next;
+    }
+    return NULL;
+}
+
+/* parses an HLS byte range "length[@offset]", a missing offset continues at
+ * *next */
+static void hls_byterange(const char *s, pkg_range *r, uint64_t *next) {
+    char *end;
+    r->length = (int64_t)strtoull(s, &end, 10);
+    r->offset = *end == '@' ? strtoull(end + 1, NULL, 10) : *next;
+    *next = r->offset + (uint64_t)r->length;
+}
+
+/* strips the line ending and leading blanks of line */
+static char *hls_line(char *line) {
+    line[strcspn(line, "\r")] = '\0';
+    while (*line == ' ' || *line == '\t')
+        line++;
+    return line;
+}
+
+/* fills in the init and first media segment of v from the media playlist
+ * in text, which is modified */
+static void hls_media(char *text, const char *path, pkg_variant *v) {
+    pkg_range range = {.offset = 0, .length = -1};
+    uint64_t next = 0;
+    char *save = NULL;
+    for (char *line = strtok_r(text, "\n", &save); line != NULL;
+         line = strtok_r(NULL, "\n", &save)) {
+        line = hls_line(line);
+        if (!strncmp(line, "#EXT-X-MAP:", 11)) {
+            char *uri = hls_attr(line + 11, "URI");
+            if (uri == NULL || v->init.path != NULL) {
+                free(uri);
+                continue;
+            }
+            v->init.path = resolve(path, uri);
+            free(uri);
+            char *br = hls_attr(line + 11, "BYTERANGE");
+            if (br != NULL) {
+                uint64_t map_next = 0;
+                hls_byterange(br, &v->init, &map_next);
+                free(br);
+            }
+        } else if (!strncmp(line, "#EXT-X-BYTERANGE:", 17))
+            hls_byterange(line + 17, &range, &next);
+        else if (line[0] != '#' && line[0] != '\0') {
+            v->segment.path = resolve(path, line);
+            v->segment.offset = range.offset;
+            v->segment.length = range.length;
+            return; /* the first segment is enough */
+        }
+    }
+}
+
+pkg_package *pkg_parse_hls(const char *buf, size_t size, const char *path) {
+    if (size < 7 || memcmp(buf, "#EXTM3U", 7)) {
+        path_error(path, "Not an HLS playlist");
+        return NULL;
+    }
+    char *text = copy_str(buf, size);
+    pkg_package *pkg = md_calloc(1, sizeof(pkg_package));
+    if (strstr(text, "#EXT-X-STREAM-INF:") == NULL) {
+        /* a media playlist is a package with a single variant */
+        const char *slash = strrchr(path, '/');
+        hls_media(text, path, add_variant(pkg, slash ? slash + 1 : path));
+        free(text);
+        return pkg;
+    }
+
+    bool stream_inf = false; /* the next URI is a variant playlist */
+    char *save = NULL;
+    for (char *line = strtok_r(text, "\n", &save); line != NULL;
+         line = strtok_r(NULL, "\n", &save)) {
+        line = hls_line(line);
+        if (!strncmp(line, "#EXT-X-STREAM-INF:", 18)) {
+            stream_inf = true;
+            continue;
+        }
+        if (line[0] == '#' || line[0] == '\0' || !stream_inf)
+            continue;
+        stream_inf = false;
+        /* variants that only differ in their audio share the playlist */
+        bool seen = false;
+        for (size_t i = 0; i < pkg->nb_variants && !seen; i++)
+            seen = !strcmp(pkg->variants[i].name, line);
+        if (seen)
+            continue;
+        pkg_variant *v = add_variant(pkg, line);
+        char *vpath = resolve(path, line);
+        size_t vsize;
+        char *vtext =
+            (char *)read_part(vpath, 0, -1, PKG_MAX_MANIFEST, &vsize);
+        if (vtext != NULL)
+            hls_media(vtext, vpath, v);
+        else
+            clear_global_md_error(); /* reported as variant without segments */
+        free(vtext);
+        free(vpath);
+    }
+    free(text);
+    if (pkg->nb_variants == 0) {
+        pkg_free(pkg);
+        path_error(path, "HLS playlist without variants");
+        return NULL;
+    }
+    return pkg;
+}
+
+/* returns the trimmed text of the BaseURL of node resolved against base,
+ * base itself if node has none */
+static char *dash_base(const xml_node *node, const char *base) {
+    const xml_node *url = xml_child(node, "BaseURL");
+    if (url == NULL || url->text == NULL)
+        return md_strdup(base);
+    const char *s = url->text;
+    while (isspace((unsigned char)*s))
+        s++;
+    size_t len = strlen(s);
+    while (len > 0 && isspace((unsigned char)s[len - 1]))
+        len--;
+    char *ref = copy_str(s, len);
+    char *ret = resolve(base, ref);
+    free(ref);
+    return ret;
+}
+
+/* returns the segment information element called name of the innermost of
+ * the representation, adaptation set and period that has one */
+static const xml_node *dash_segment_info(xml_node *const levels[3],
+                                         const char *name) {
+    for (int i = 0; i < 3; i++) {
+        const xml_node *node = xml_child(levels[i], name);
+        if (node != NULL)
+            return node;
+    }
+    return NULL;
+}
+
+/* like dash_segment_info, but for an attribute of the element name, as
+ * attributes of segment templates are inherited one by one */
+static const char *dash_inherit(xml_node *const levels[3], const char *name,
+                                const char *attr) {
+    for (int i = 0; i < 3; i++) {
+        const xml_node *node = xml_child(levels[i], name);
+        const char *value = node ? xml_attr(node, attr) : NULL;
+        if (value != NULL)
+            return value;
+    }
+    return NULL;
+}
+
+/* parses a DASH byte range "first-last" */
+static void dash_range(const char *s, pkg_range *r) {
+    char *end;
+    uint64_t first = strtoull(s, &end, 10);
+    if (*end != '-')
+        return;
+    uint64_t last = strtoull(end + 1, NULL, 10);
+    if (last < first)
+        return;
+    r->offset = first;
+    r->length = (int64_t)(last - first + 1);
+}
+
+/* expands the identifiers of a segment template */
+static char *dash_expand(const char *tmpl, const char *id, uint64_t bandwidth,
+                         uint64_t number, uint64_t time) {
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&buf, &size);
+    if (out == NULL)
+        md_bug(__FILE__, __LINE__, true);
+    for (const char *p = tmpl; *p;) {
+        const char *end = *p == '$' ? strchr(p + 1, '$') : NULL;
+        if (end == NULL) {
+            fputc(*p++, out);
+            continue;
+        }
+        size_t len = end - p - 1;
+        char ident[32];
+        snprintf(ident, sizeof(ident), "%.*s", (int)len, p + 1);
+        int width = 0;
+        char *fmt = strchr(ident, '%');
+        if (fmt != NULL) {
+            *fmt = '\0';
+            width = atoi(fmt + 1); /* %0<width>d */
+        }
+        if (len == 0)
+            fputc('$', out);
+        else if (!strcmp(ident, "RepresentationID"))
+            fputs(id, out);
+        else if (!strcmp(ident, "Number"))
+            fprintf(out, "%0*llu", width, (unsigned long long)number);
+        else if (!strcmp(ident, "Bandwidth"))
+            fprintf(out, "%0*llu", width, (unsigned long long)bandwidth);
+        else if (!strcmp(ident, "Time"))
+            fprintf(out, "%0*llu", width, (unsigned long long)time);
+        else
+            fprintf(out, "%.*s", (int)(len + 2), p); /* unknown, keep it */
+        p = end + 1;
+    }
+    fclose(out);
+    return buf;
+}
+
+static bool dash_is_video(const xml_node *as, const xml_node *rep) {
+    const char *type = xml_attr(as, "contentType");
+    if (type != NULL)
+        return !strcmp(type, "video");
+    const char *mime = xml_attr(rep, "mimeType");
+    if (mime == NULL)
+        mime = xml_attr(as, "mimeType");
+    if (mime != NULL)
+        return !strncmp(mime, "video/", 6);
+    const char *codecs = xml_attr(rep, "codecs");
+    if (codecs == NULL)
+        codecs = xml_attr(as, "codecs");
+    return codecs != NULL &&
+           (!strncmp(codecs, "hvc1", 4) || !strncmp(codecs, "hev1", 4) ||
+            !strncmp(codecs, "dvh1", 4) || !strncmp(codecs, "dvhe", 4));
+}
+
+/* adds the representation rep of the adaptation set as in period */
+static void dash_representation(pkg_package *pkg, xml_node *period,
+                                xml_node *as, xml_node *rep,
+                                const char *as_base) {
+    char *base = dash_base(rep, as_base);
+    const char *id = xml_attr(rep, "id");
+    char name[32];
+    if (id == NULL) {
+        snprintf(name, sizeof(name), "%zu", pkg->nb_variants);
+        id = name;
+    }
+    const char *bw = xml_attr(rep, "bandwidth");
+    uint64_t bandwidth = bw ? strtoull(bw, NULL, 10) : 0;
+    pkg_variant *v = add_variant(pkg, id);
+    xml_node *const levels[3] = {rep, as, period};
+
+    const char *init =
+        dash_inherit(levels, "SegmentTemplate", "initialization");
+    const char *media = dash_inherit(levels, "SegmentTemplate", "media");
+    const xml_node *list = dash_segment_info(levels, "SegmentList");
+    if (init != NULL || media != NULL) {
+        const char *start =
+            dash_inherit(levels, "SegmentTemplate", "startNumber");
+        uint64_t number = start ? strtoull(start, NULL, 10) : 1;
+        uint64_t time = 0;
+        const xml_node *tmpl = dash_segment_info(levels, "SegmentTemplate");
+        const xml_node *timeline = xml_child(tmpl, "SegmentTimeline");
+        const xml_node *s = timeline ? xml_child(timeline, "S") : NULL;
+        if (s != NULL && xml_attr(s, "t") != NULL)
+            time = strtoull(xml_attr(s, "t"), NULL, 10);
+        if (init != NULL) {
+            char *ref = dash_expand(init, id, bandwidth, number, time);
+            v->init.path = resolve(base, ref);
+            free(ref);
+        }
+        if (media != NULL) {
+            char *ref = dash_expand(media, id, bandwidth, number, time);
+            v->segment.path = resolve(base, ref);
+            free(ref);
+        }
+    } else if (list != NULL) {
+        const xml_node *ini = xml_child(list, "Initialization");
+        if (ini != NULL) {
+            const char *src = xml_attr(ini, "sourceURL");
+            v->init.path = src ? resolve(base, src) : md_strdup(base);
+            if (xml_attr(ini, "range") != NULL)
+                dash_range(xml_attr(ini, "range"), &v->init);
+        }
+        const xml_node *seg = xml_child(list, "SegmentURL");
+        if (seg != NULL) {
+            const char *src = xml_attr(seg, "media");
+            v->segment.path = src ? resolve(base, src) : md_strdup(base);
+            if (xml_attr(seg, "mediaRange") != NULL)
+                dash_range(xml_attr(seg, "mediaRange"), &v->segment);
+        }
+    } else {
+        /* a single file, the media follows the init segment */
+        v->init.path = md_strdup(base);
+        v->segment.path = md_strdup(base);
+        const xml_node *sb = dash_segment_info(levels, "SegmentBase");
+        const xml_node *ini = sb ? xml_child(sb, "Initialization") : NULL;
+        const char *range = ini ? xml_attr(ini, "range") : NULL;
+        if (range != NULL) {
+            dash_range(range, &v->init);
+            if (v->init.length > 0)
+                v->segment.offset = v->init.offset + v->init.length;
+        }
+    }
+    free(base);
+}
+
+pkg_package *pkg_parse_dash(const char *buf, size_t size, const char *path) {
+    xml_node *mpd = xml_parse(buf, size);
+    if (mpd == NULL)
+        return NULL;
+    if (strcmp(mpd->name, "MPD")) {
+        xml_free(mpd);
+        path_error(path, "Not a DASH manifest");
+        return NULL;
+    }
+    pkg_package *pkg = md_calloc(1, sizeof(pkg_package));
+    char *mpd_base = dash_base(mpd, path);
+    xml_node *period = xml_child(mpd, "Period");
+    if (period != NULL) {
+        char *period_base = dash_base(period, mpd_base);
+        for (xml_node *as = xml_child(period, "AdaptationSet"); as != NULL;
+             as = xml_next(as, "AdaptationSet")) {
+            char *as_base = dash_base(as, period_base);
+            for (xml_node *rep = xml_child(as, "Representation"); rep != NULL;
+                 rep = xml_next(rep, "Representation")) {
+                if (dash_is_video(as, rep))
+                    dash_representation(pkg, period, as, rep, as_base);
+            }
+            free(as_base);
+        }
+        free(period_base);
+    }
+    free(mpd_base);
+    xml_free(mpd);
+    if (pkg->nb_variants == 0) {
+        pkg_free(pkg);
+        path_error(path, "DASH manifest without video representation");
+        return NULL;
+    }
+    return pkg;
+}
+
+pkg_package *pkg_open(const char *path) {
+    size_t size;
+    uint8_t *buf = read_part(path, 0, -1, PKG_MAX_MANIFEST, &size);
+    if (buf == NULL)
+        return NULL;
+    pkg_package *pkg = has_suffix(path, ".mpd")
+                           ? pkg_parse_dash((char *)buf, size, path)
+                           : pkg_parse_hls((char *)buf, size, path);
+    free(buf);
+    return pkg;
+}
+
+/* box of an ISO base media file, the payload is clipped to the buffer */
+typedef struct bmff_box {
+    uint32_t type;
+    const uint8_t *data;
+    size_t size;
+} bmff_box;
+
+/* reads the box at *pos of buf and advances pos behind it. Returns false at
+ * the end of buf or if the box header is malformed. */
+static bool next_box(const uint8_t *buf, size_t size, size_t *pos,
+                     bmff_box *box) {
+    if (*pos + 8 > size)
+        return false;
+    const uint8_t *p = buf + *pos;
+    size_t avail = size - *pos;
+    uint64_t len = rd32(p);
+    size_t header = 8;
+    box->type = rd32(p + 4);
+    if (len == 1) {
+        if (avail < 16)
+            return false;
+        len = rd64(p + 8);
+        header = 16;
+    } else if (len == 0)
+        len = avail; /* up to the end of the file */
+    if (len < header)
+        return false;
+    if (len > avail)
+        len = avail;
+    box->data = p + header;
+    box->size = len - header;
+    *pos += len;
+    return true;
+}
+
+static bool find_box(const uint8_t *buf, size_t size, uint32_t type,
+                     bmff_box *box) {
+    size_t pos = 0;
+    while (next_box(buf, size, &pos, box)) {
+        if (box->type == type)
+            return true;
+    }
+    return false;
+}
+
+/* parses the boxes of an HEVC visual sample entry. Returns the NAL unit
+ * length size or 0 if there is no hvcC box. */
+static int parse_sample_entry(const bmff_box *entry, hevc_sei *sei) {
+    /* the SampleEntry and VisualSampleEntry fields precede the boxes */
+    if (entry->size < 78)
+        return 0;
+    const uint8_t *buf = entry->data + 78;
+    size_t size = entry->size - 78;
+    size_t pos = 0;
+    bmff_box box;
+    int length_size = 0;
+    while (next_box(buf, size, &pos, &box)) {
+        const uint8_t *d = box.data;
+        switch (box.type) {
+        case BOX('h', 'v', 'c', 'C'): {
+            int ls = hevc_parse_config(d, box.size, sei);
+            if (ls > 0)
+                length_size = ls;
+            break;
+        }
+        case BOX('m', 'd', 'c', 'v'):
+            /* same layout as the SEI message */
+            if (box.size < 24)
+                break;
+            for (int c = 0; c < 3; c++) {
+                sei->mdcv.primaries[c][0] = rd16(d + 4 * c);
+                sei->mdcv.primaries[c][1] = rd16(d + 4 * c + 2);
+            }
+            sei->mdcv.white_point[0] = rd16(d + 12);
+            sei->mdcv.white_point[1] = rd16(d + 14);
+            sei->mdcv.max_luminance = rd32(d + 16);
+            sei->mdcv.min_luminance = rd32(d + 20);
+            sei->has_mdcv = true;
+            break;
+        case BOX('c', 'l', 'l', 'i'):
+            if (box.size < 4)
+                break;
+            sei->max_cll = rd16(d);
+            sei->max_fall = rd16(d + 2);
+            sei->has_cll = true;
+            break;
+        }
+    }
+    return length_size;
+}
+
+/* parses the moov box of the init segment in buf. Returns the NAL unit
+ * length size of the first HEVC track or -1 if there is none. */
+static int parse_init(const uint8_t *buf, size_t size, hevc_sei *sei) {
+    bmff_box moov, trak;
+    if (!find_box(buf, size, BOX('m', 'o', 'o', 'v'), &moov))
+        return -1;
+    size_t pos = 0;
+    while (next_box(moov.data, moov.size, &pos, &trak)) {
+        bmff_box mdia, minf, stbl, stsd, entry;
+        if (trak.type != BOX('t', 'r', 'a', 'k') ||
+            !find_box(trak.data, trak.size, BOX('m', 'd', 'i', 'a'), &mdia) ||
+            !find_box(mdia.data, mdia.size, BOX('m', 'i', 'n', 'f'), &minf) ||
+            !find_box(minf.data, minf.size, BOX('s', 't', 'b', 'l'), &stbl) ||
+            !find_box(stbl.data, stbl.size, BOX('s', 't', 's', 'd'), &stsd) ||
+            stsd.size < 8)
+            continue;
+        /* version, flags and entry count of the full box */
+        size_t epos = 0;
+        while (next_box(stsd.data + 8, stsd.size - 8, &epos, &entry)) {
+            switch (entry.type) {
+            case BOX('h', 'v', 'c', '1'):
+            case BOX('h', 'e', 'v', '1'):
+            case BOX('d', 'v', 'h', '1'):
+            case BOX('d', 'v', 'h', 'e'):
+            case BOX('e', 'n', 'c', 'v'): {
+                int length_size = parse_sample_entry(&entry, sei);
+                if (length_size > 0)
+                    return length_size;
+                break;
+            }
+            }
+        }
+    }
+    return -1;
+}
+
+static bool has_metadata(const hevc_sei *sei) {
+    return sei->has_mdcv || sei->has_cll;
+}
+
+static int probe_init(const pkg_variant *v, probe_budget *budget,
+                      pkg_result *res) {
+    if (v->init.path == NULL)
+        return 0; /* transport stream segments */
+    if (budget_expired(budget))
+        return 0;
+    size_t size;
+    uint8_t *buf = read_part(v->init.path, v->init.offset, v->init.length,
+                             PKG_INIT_LIMIT, &size);
+    if (buf == NULL)
+        return -1;
+    budget->bytes += size;
+    int length_size = parse_init(buf, size, &res->sei);
+    free(buf);
+    if (length_size < 0) {
+        path_error(v->init.path, "Init segment without HEVC track");
+        return -1;
+    }
+    res->length_size = length_size;
+    return has_metadata(&res->sei) ? 1 : 0;
+}
+
+static int probe_media(const pkg_variant *v, probe_budget *budget,
+                       pkg_result *res) {
+    if (v->segment.path == NULL) {
+        md_error_custom("No media segment found for the variant");
+        return -1;
+    }
+    if (budget_expired(budget))
+        return 0;
+    /* segments without init segment are transport streams */
+    if (v->init.path == NULL)
+        return ts_scan_hevc(v->segment.path, -1, PKG_SEGMENT_LIMIT, budget,
+                            &res->sei, NULL);
+    size_t size;
+    uint8_t *buf = read_part(v->segment.path, v->segment.offset,
+                             v->segment.length, PKG_SEGMENT_LIMIT, &size);
+    if (buf == NULL)
+        return -1;
+    budget->bytes += size;
+    /* only the first fragment, the limit may cut off its last NAL unit */
+    bmff_box mdat;
+    if (find_box(buf, size, BOX('m', 'd', 'a', 't'), &mdat))
+        hevc_parse_lp(mdat.data, mdat.size, res->length_size, &res->sei);
+    free(buf);
+    return has_metadata(&res->sei) ? 1 : 0;
+}
+
+typedef struct variant_job {
+    const pkg_variant *variant;
+    bool media;
+    probe_budget *budget; /* shared by the jobs */
+    pkg_result *result;
+    pthread_t thread;
+    bool started;
+} variant_job;
+
+static void *variant_worker(void *arg) {
+    variant_job *job = arg;
+    pkg_result *res = job->result;
+    if (job->media)
+        res->ret = probe_media(job->variant, job->budget, res);
+    else
+        res->ret = probe_init(job->variant, job->budget, res);
+    if (res->ret < 0) {
+        /* errors are per thread */
+        free(res->error);
+        res->error = md_strdup(global_md_error_str(global_md_error));
+        clear_global_md_error();
+    }
+    return NULL;
+}
+
+void pkg_scan(const pkg_package *pkg, bool media, const bool *todo,
+              probe_budget *budget, pkg_result *results) {
+    size_t pending = 0;
+    for (size_t i = 0; i < pkg->nb_variants; i++) {
+        if (!todo[i])
+            continue;
+        /* also for variants skipped once the budget is exhausted */
+        results[i].ret = 0;
+        memset(&results[i].sei, 0, sizeof(hevc_sei));
+        pending++;
+    }
+
+    variant_job jobs[PKG_MAX_THREADS];
+    size_t i = 0;
+    while (i < pkg->nb_variants && !budget_expired(budget)) {
+        size_t n = 0;
+        for (; i < pkg->nb_variants && n < PKG_MAX_THREADS; i++) {
+            if (!todo[i])
+                continue;
+            variant_job *job = &jobs[n++];
+            job->variant = &pkg->variants[i];
+            job->media = media;
+            job->budget = budget;
+            job->result = &results[i];
+            job->started = pending > 1 && pthread_create(&job->thread, NULL,
+                                                         &variant_worker,
+                                                         job) == 0;
+            if (!job->started)
+                variant_worker(job);
+        }
+        for (size_t k = 0; k < n; k++) {
+            if (jobs[k].started)
+                pthread_join(jobs[k].thread, NULL);
+        }
+    }
+}
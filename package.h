@@ -0,0 +1,80 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_PACKAGE
+#define _INCL_PACKAGE
+
+#include "budget.h"
+#include "hevcsei.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* playlists and manifests larger than this are not read completely */
+#define PKG_MAX_MANIFEST (16 * 1024 * 1024)
+/* amount of bytes read from an init segment */
+#define PKG_INIT_LIMIT (1024 * 1024)
+/* amount of bytes read from the first media segment */
+#define PKG_SEGMENT_LIMIT (4 * 1024 * 1024)
+/* variants that are read at the same time */
+#define PKG_MAX_THREADS 16
+
+/* byte range of a local file */
+typedef struct pkg_range {
+    char *path; /* NULL if there is no such segment */
+    uint64_t offset;
+    int64_t length; /* -1 up to the end of the file */
+} pkg_range;
+
+/* video variant of an HLS or DASH package */
+typedef struct pkg_variant {
+    char *name;        /* variant playlist URI or representation ID */
+    pkg_range init;    /* initialization segment */
+    pkg_range segment; /* first media segment */
+} pkg_variant;
+
+typedef struct pkg_package {
+    pkg_variant *variants;
+    size_t nb_variants;
+} pkg_package;
+
+/* pkg_is_input returns true if path names an HLS playlist or a DASH
+ * manifest */
+bool pkg_is_input(const char *path);
+
+/* pkg_parse_hls parses the HLS master or media playlist in buf, relative
+ * URIs are resolved against the path of the playlist. Variant playlists of a
+ * master playlist are read from disk. Returns NULL and sets an error if
+ * there is no variant. */
+pkg_package *pkg_parse_hls(const char *buf, size_t size, const char *path);
+
+/* pkg_parse_dash parses the video representations of the first period of
+ * the DASH manifest in buf, relative URLs are resolved against the path of
+ * the manifest. Returns NULL and sets an error if there is no video
+ * representation. */
+pkg_package *pkg_parse_dash(const char *buf, size_t size, const char *path);
+
+/* pkg_open reads the playlist or manifest at path. Returns NULL and sets an
+ * error if it cannot be read or holds no video variant. */
+pkg_package *pkg_open(const char *path);
+
+/* destructor for pkg_package */
+void pkg_free(pkg_package *pkg);
+
+/* what pkg_scan found for a variant */
+typedef struct pkg_result {
+    int ret; /* 1 if metadata was found, 0 if not, -1 on error */
+    char *error;     /* message if ret is -1, must be freed */
+    hevc_sei sei;    /* of the last segment read */
+    int length_size; /* NAL unit length size of the hvcC record, 0 if none */
+} pkg_result;
+
+/* pkg_scan reads a segment of every variant of pkg whose todo flag is set,
+ * on up to PKG_MAX_THREADS threads: the init segment (its sample entry with
+ * hvcC, mdcv and clli boxes) if media is false, otherwise the first media
+ * segment, of which only the first mdat box or the transport stream is
+ * parsed. results must have an entry per variant and keep the length size
+ * of the init segment for the media pass, variants left out because budget
+ * is exhausted get ret 0. The bytes read are accounted to budget. */
+void pkg_scan(const pkg_package *pkg, bool media, const bool *todo,
+              probe_budget *budget, pkg_result *results);
+
+#endif
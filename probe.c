@@ -0,0 +1,49 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "probe.h"
+#include "errors.h"
+#include "eval.h"
+#include "ffmpeg.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+ff_registry *probe_registry(const eval_container *ct, FILE *ostream) {
+    /* every requested piece of side data is pulled in a single pass */
+    const enum AVFrameSideDataType mdcv_types[] = {
+        AV_FRAME_DATA_MASTERING_DISPLAY_METADATA};
+    const enum AVFrameSideDataType cll_types[] = {
+        AV_FRAME_DATA_CONTENT_LIGHT_LEVEL};
+    ff_registry *reg = ff_registry_alloc();
+    ff_registry_add(reg, &ffmpeg_disp_meta, ostream, NULL, mdcv_types, 1, 24);
+    if (ct->ffcll)
+        ff_registry_add(reg, &ffmpeg_content_light, ostream, NULL, cll_types,
+                        1, 24);
+    ff_registry_set_budget(reg, ct->ffdeadline, ct->ffmaxbytes);
+    reg->decode = ct->fffulldecode ? FF_DECODE_FULL : FF_DECODE_REDUCED;
+    if (ct->fffollow >= 0)
+        ff_registry_set_follow(reg, ct->fffollow);
+    return reg;
+}
+
+char *probe_to_string(const eval_container *ct, const char *path,
+                      ff_stats *stats) {
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *mem = open_memstream(&buf, &size);
+    if (mem == NULL) {
+        md_error_custom(strerror(errno));
+        return NULL;
+    }
+    ff_registry *reg = probe_registry(ct, mem);
+    int ret = ffmpeg_dispatch_sidedata(path, reg);
+    if (stats)
+        *stats = reg->stats;
+    ff_registry_free(reg);
+    fclose(mem);
+    if (ret < 0) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
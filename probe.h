@@ -0,0 +1,19 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_PROBE
+#define _INCL_PROBE
+
+#include "eval.h"
+#include "ffmpeg.h"
+#include <stdio.h>
+
+/* probe_registry builds the consumer registry for the ffmpeg options in ct,
+ * the consumers print to ostream. Must be freed with ff_registry_free. */
+ff_registry *probe_registry(const eval_container *ct, FILE *ostream);
+
+/* probe_to_string probes path with the ffmpeg options in ct and returns the
+ * output of the consumers as string that must be freed. Returns NULL and sets
+ * an error if the probe failed. stats may be NULL. */
+char *probe_to_string(const eval_container *ct, const char *path,
+                      ff_stats *stats);
+
+#endif
@@ -0,0 +1,422 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+/* d_type of struct dirent is not part of POSIX */
+#define _DEFAULT_SOURCE
+#include "scan.h"
+#include "budget.h"
+#include "errors.h"
+#include "eval.h"
+#include "probe.h"
+#include "trace.h"
+#include "wrappers.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* files smaller than this cannot hold a meaningful video stream */
+#define SCAN_MIN_SIZE 4096
+
+static const char *const scan_extensions[] = {
+    "265", "av1",  "h265", "hevc", "ivf", "m2ts", "m4v", "mkv",
+    "mov", "mp4",  "mts",  "mxf",  "obu", "ts",   "webm"};
+
+typedef struct scan_item {
+    char *path;
+    bool is_dir;
+    int64_t submitted; /* monotonic clock in ns */
+} scan_item;
+
+/* work-stealing deque: the owner pushes and pops at the back, thieves take
+ * from the front */
+typedef struct scan_deque {
+    pthread_mutex_t lock;
+    scan_item *items;
+    size_t head;
+    size_t tail;
+    size_t alloc;
+} scan_deque;
+
+typedef struct scan_ctx scan_ctx;
+
+typedef struct scan_worker {
+    scan_ctx *ctx;
+    unsigned id;
+    pthread_t thread;
+    bool started;
+    scan_deque deque;
+    /* per thread accounting, summed up after the join */
+    int64_t walk_ns;
+    int64_t probe_ns;
+    uint64_t dirs;
+    uint64_t files;
+    uint64_t candidates;
+    uint64_t found;
+    uint64_t failed;
+} scan_worker;
+
+struct scan_ctx {
+    const eval_container *ct;
+    FILE *ostream;
+    pthread_mutex_t out_lock;
+    scan_worker *workers;
+    unsigned nb_workers;
+    /* items that are queued or being processed */
+    atomic_size_t pending;
+    /* idle workers wait for new items or the end of the scan */
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+};
+
+static void deque_init(scan_deque *dq) {
+    pthread_mutex_init(&dq->lock, NULL);
+    dq->items = NULL;
+    dq->head = 0;
+    dq->tail = 0;
+    dq->alloc = 0;
+}
+
+static void deque_destroy(scan_deque *dq) {
+    for (size_t i = dq->head; i < dq->tail; i++)
+        free(dq->items[i].path);
+    free(dq->items);
+    pthread_mutex_destroy(&dq->lock);
+}
+
+static void deque_push(scan_deque *dq, scan_item item) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail == dq->alloc) {
+        if (dq->head > 0) {
+            /* reclaim the space of stolen items */
+            memmove(dq->items, dq->items + dq->head,
+                    (dq->tail - dq->head) * sizeof(scan_item));
+            dq->tail -= dq->head;
+            dq->head = 0;
+        }
+        if (dq->tail == dq->alloc) {
+            dq->alloc = dq->alloc ? dq->alloc * 2 : 64;
+            dq->items = md_realloc(dq->items, dq->alloc * sizeof(scan_item));
+        }
+    }
+    dq->items[dq->tail++] = item;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+static bool deque_pop(scan_deque *dq, scan_item *item) {
+    bool ok = false;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        *item = dq->items[--dq->tail];
+        ok = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+static bool deque_steal(scan_deque *dq, scan_item *item) {
+    bool ok = false;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        *item = dq->items[dq->head++];
+        ok = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+static void scan_submit(scan_worker *w, char *path, bool is_dir) {
+    atomic_fetch_add(&w->ctx->pending, 1);
+    scan_item item = {
+        .path = path, .is_dir = is_dir, .submitted = budget_now()};
+    deque_push(&w->deque, item);
+    pthread_mutex_lock(&w->ctx->idle_lock);
+    pthread_cond_signal(&w->ctx->idle_cond);
+    pthread_mutex_unlock(&w->ctx->idle_lock);
+}
+
+static bool has_video_extension(const char *name) {
+    const char *dot = strrchr(name, '.');
+    if (dot == NULL || strlen(dot + 1) > 4)
+        return false;
+    char ext[5];
+    size_t i = 0;
+    for (const char *c = dot + 1; *c; c++)
+        ext[i++] = tolower((unsigned char)*c);
+    ext[i] = '\0';
+    for (size_t j = 0; j < sizeof(scan_extensions) / sizeof(char *); j++) {
+        if (!strcmp(ext, scan_extensions[j]))
+            return true;
+    }
+    return false;
+}
+
+static bool has_video_magic(const uint8_t *b, size_t n) {
+    if (n < 16)
+        return false;
+    if (!memcmp(b + 4, "ftyp", 4) || !memcmp(b + 4, "moov", 4))
+        return true; /* ISO base media file */
+    if (b[0] == 0x1A && b[1] == 0x45 && b[2] == 0xDF && b[3] == 0xA3)
+        return true; /* matroska / webm */
+    if (b[0] == 0x47 || b[4] == 0x47)
+        return true; /* MPEG-TS / BDAV M2TS */
+    if (b[0] == 0 && b[1] == 0 && (b[2] == 1 || (b[2] == 0 && b[3] == 1)))
+        return true; /* Annex B elementary stream */
+    if (b[0] == 0x06 && b[1] == 0x0E && b[2] == 0x2B && b[3] == 0x34)
+        return true; /* MXF */
+    if (!memcmp(b, "DKIF", 4))
+        return true; /* IVF */
+    if (b[0] == 0x12 && b[1] == 0x00)
+        return true; /* AV1 temporal delimiter OBU */
+    return false;
+}
+
+bool scan_is_candidate(int dirfd, const char *name) {
+    if (!has_video_extension(name))
+        return false;
+    int fd = openat(dirfd, name, O_RDONLY | O_NOCTTY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    uint8_t magic[16];
+    bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+              st.st_size >= SCAN_MIN_SIZE &&
+              read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+              has_video_magic(magic, sizeof(magic));
+    close(fd);
+    return ok;
+}
+
+char *scan_join_path(const char *dir, const char *name) {
+    size_t dlen = strlen(dir);
+    size_t nlen = strlen(name);
+    char *path = md_malloc(dlen + nlen + 2);
+    memcpy(path, dir, dlen);
+    size_t pos = dlen;
+    if (dlen == 0 || dir[dlen - 1] != '/')
+        path[pos++] = '/';
+    memcpy(path + pos, name, nlen + 1);
+    return path;
+}
+
+static void scan_dir(scan_worker *w, const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return;
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        close(fd);
+        return;
+    }
+    w->dirs++;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        const char *name = ent->d_name;
+        if (!strcmp(name, ".") || !strcmp(name, ".."))
+            continue;
+        unsigned char type = ent->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR
+                   : S_ISREG(st.st_mode) ? DT_REG
+                                         : DT_UNKNOWN;
+        }
+        if (type == DT_DIR) {
+            scan_submit(w, scan_join_path(path, name), true);
+        } else if (type == DT_REG) {
+            w->files++;
+            if (scan_is_candidate(fd, name)) {
+                w->candidates++;
+                scan_submit(w, scan_join_path(path, name), false);
+            }
+        }
+    }
+    closedir(dir);
+}
+
+void scan_print_result(FILE *ostream, const char *path, const char *result) {
+    const char *line = result;
+    while (*line) {
+        const char *end = strchr(line, '\n');
+        int len = end ? (int)(end - line) : (int)strlen(line);
+        fprintf(ostream, "%s: %.*s\n", path, len, line);
+        line += len + (end ? 1 : 0);
+    }
+    fflush(ostream);
+}
+
+static void scan_report(scan_ctx *ctx, const char *path, const char *result) {
+    int64_t span = trace_begin("write");
+    pthread_mutex_lock(&ctx->out_lock);
+    scan_print_result(ctx->ostream, path, result);
+    pthread_mutex_unlock(&ctx->out_lock);
+    trace_end("write", span);
+}
+
+static void scan_file(scan_worker *w, const char *path) {
+    char *result = probe_to_string(w->ctx->ct, path, NULL);
+    if (result == NULL) {
+        w->failed++;
+        const size_t len = 256;
+        char *msg = md_malloc(len);
+        snprintf(msg, len, "error: %s", global_md_error_str(global_md_error));
+        clear_global_md_error();
+        scan_report(w->ctx, path, msg);
+        free(msg);
+        return;
+    }
+    w->found++;
+    scan_report(w->ctx, path, result);
+    free(result);
+}
+
+/* takes an item from the own deque or steals one from another worker */
+static bool scan_next(scan_worker *w, scan_item *item) {
+    if (deque_pop(&w->deque, item))
+        return true;
+    scan_ctx *ctx = w->ctx;
+    for (unsigned i = 1; i < ctx->nb_workers; i++) {
+        scan_worker *victim = &ctx->workers[(w->id + i) % ctx->nb_workers];
+        if (deque_steal(&victim->deque, item))
+            return true;
+    }
+    return false;
+}
+
+/* waits until an item can be taken, returns false once the scan is over */
+static bool scan_wait(scan_worker *w, scan_item *item) {
+    scan_ctx *ctx = w->ctx;
+    bool ok = true;
+    /* submitters signal under the lock, so no item slips in between the
+     * check and the wait */
+    pthread_mutex_lock(&ctx->idle_lock);
+    while (!scan_next(w, item)) {
+        if (atomic_load(&ctx->pending) == 0) {
+            ok = false; /* nothing queued and nobody can produce more */
+            break;
+        }
+        pthread_cond_wait(&ctx->idle_cond, &ctx->idle_lock);
+    }
+    pthread_mutex_unlock(&ctx->idle_lock);
+    return ok;
+}
+
+static void *scan_thread(void *arg) {
+    scan_worker *w = arg;
+    scan_ctx *ctx = w->ctx;
+    while (true) {
+        scan_item item;
+        if (!scan_next(w, &item) && !scan_wait(w, &item))
+            break;
+        int64_t start = budget_now();
+        if (item.is_dir) {
+            scan_dir(w, item.path);
+            w->walk_ns += budget_now() - start;
+        } else {
+            trace_file(item.path);
+            int64_t span = trace_begin("file");
+            scan_file(w, item.path);
+            /* how long the file waited for a worker */
+            trace_end_arg("file", span, "queued_us",
+                          (start - item.submitted) / 1000);
+            w->probe_ns += budget_now() - start;
+        }
+        free(item.path);
+        if (atomic_fetch_sub(&ctx->pending, 1) == 1) {
+            /* the scan is over, release the idle workers */
+            pthread_mutex_lock(&ctx->idle_lock);
+            pthread_cond_broadcast(&ctx->idle_cond);
+            pthread_mutex_unlock(&ctx->idle_lock);
+        }
+    }
+    return NULL;
+}
+
+unsigned scan_threads() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1;
+}
+
+int scan_tree(const char *root, const eval_container *ct, FILE *ostream,
+              unsigned threads) {
+    struct stat st;
+    if (stat(root, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        md_error_custom("Scan root is not a directory");
+        return -1;
+    }
+    if (threads == 0)
+        threads = 1;
+
+    scan_ctx ctx;
+    ctx.ct = ct;
+    ctx.ostream = ostream;
+    pthread_mutex_init(&ctx.out_lock, NULL);
+    ctx.workers = md_calloc(threads, sizeof(scan_worker));
+    ctx.nb_workers = threads;
+    atomic_init(&ctx.pending, 0);
+    pthread_mutex_init(&ctx.idle_lock, NULL);
+    pthread_cond_init(&ctx.idle_cond, NULL);
+    for (unsigned i = 0; i < threads; i++) {
+        ctx.workers[i].ctx = &ctx;
+        ctx.workers[i].id = i;
+        deque_init(&ctx.workers[i].deque);
+    }
+    scan_submit(&ctx.workers[0], md_strdup(root), true);
+
+    int64_t start = budget_now();
+    /* the workers that did start steal the work of the others */
+    for (unsigned i = 0; i < threads; i++) {
+        scan_worker *w = &ctx.workers[i];
+        w->started = pthread_create(&w->thread, NULL, &scan_thread, w) == 0;
+        if (!w->started)
+            break;
+    }
+    scan_worker sum;
+    memset(&sum, 0, sizeof(sum));
+    for (unsigned i = 0; i < threads; i++) {
+        scan_worker *w = &ctx.workers[i];
+        if (w->started)
+            pthread_join(w->thread, NULL);
+        sum.walk_ns += w->walk_ns;
+        sum.probe_ns += w->probe_ns;
+        sum.dirs += w->dirs;
+        sum.files += w->files;
+        sum.candidates += w->candidates;
+        sum.found += w->found;
+        sum.failed += w->failed;
+        deque_destroy(&w->deque);
+    }
+    double wall = (budget_now() - start) / 1e9;
+    bool started = ctx.workers[0].started;
+    free(ctx.workers);
+    pthread_mutex_destroy(&ctx.out_lock);
+    pthread_mutex_destroy(&ctx.idle_lock);
+    pthread_cond_destroy(&ctx.idle_cond);
+    if (!started) {
+        md_error_custom("Could not start scan thread");
+        return -1;
+    }
+
+    /* walk and probe times are summed over all threads so FS bound and
+     * decode bound runs can be told apart */
+    fprintf(stderr,
+            "scanned %llu directories, %llu files, %llu candidates "
+            "(%llu with metadata, %llu without)\n"
+            "directory walk: %.3f s, probe: %.3f s (thread time), "
+            "wall: %.3f s, %.1f files/s\n",
+            (unsigned long long)sum.dirs, (unsigned long long)sum.files,
+            (unsigned long long)sum.candidates, (unsigned long long)sum.found,
+            (unsigned long long)sum.failed, sum.walk_ns / 1e9,
+            sum.probe_ns / 1e9, wall, wall > 0 ? sum.candidates / wall : 0);
+    return (int)sum.failed;
+}
@@ -0,0 +1,32 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_SCAN
+#define _INCL_SCAN
+
+#include "eval.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/* scan_tree walks the directory tree below root on threads worker threads and
+ * probes every file that looks like a video file with the ffmpeg options in
+ * ct. Results are written to ostream as they complete, one line per piece of
+ * metadata prefixed by the file path. A summary is printed to stderr.
+ * Returns the amount of files that could not be probed or -1 and sets an
+ * error if root cannot be scanned. */
+int scan_tree(const char *root, const eval_container *ct, FILE *ostream,
+              unsigned threads);
+
+/* scan_threads returns the default amount of worker threads */
+unsigned scan_threads();
+
+/* scan_is_candidate returns true if the file name in dirfd looks like a video
+ * file judged by extension, size and magic bytes */
+bool scan_is_candidate(int dirfd, const char *name);
+
+/* scan_print_result prints every line of result prefixed with path and
+ * flushes ostream */
+void scan_print_result(FILE *ostream, const char *path, const char *result);
+
+/* scan_join_path returns dir/name as newly allocated string */
+char *scan_join_path(const char *dir, const char *name);
+
+#endif
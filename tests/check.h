@@ -0,0 +1,40 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_CHECK
+#define _INCL_CHECK
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* failed checks of the test program, main returns check_status() */
+static int check_failures = 0;
+
+/* CHECK reports cond if it does not hold and goes on with the test */
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,   \
+                    #cond);                                                    \
+            check_failures++;                                                  \
+        }                                                                      \
+    } while (0)
+
+static inline int check_status() { return check_failures == 0 ? 0 : 1; }
+
+/* writes the fixture to a new file in the working directory, returns its
+ * path. The caller unlinks and frees it. */
+static inline char *check_write_file(const uint8_t *buf, size_t size) {
+    char *path = strdup("fixture.XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, buf, size) != (ssize_t)size) {
+        perror("fixture");
+        exit(1);
+    }
+    close(fd);
+    return path;
+}
+
+#endif
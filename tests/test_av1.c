@@ -0,0 +1,64 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "av1.h"
+#include "check.h"
+#include <stdint.h>
+#include <string.h>
+
+/* temporal delimiter and metadata OBUs with mastering display (BT.2020, 1000
+ * / 0.0001 cd/m^2), content light level (1000 / 400) and HDR10+ */
+static const uint8_t obus[] = {0x12, 0x00, 0x2a, 0x19, 0x02, 0xb5, 0x3f, 0x4a,
+                               0xc0, 0x2b, 0x85, 0xcc, 0x08, 0x21, 0x89, 0x0b,
+                               0xc6, 0x50, 0x0d, 0x54, 0x39, 0x00, 0x03, 0xe8,
+                               0x00, 0x00, 0x00, 0x00, 0x10, 0x2a, 0x05, 0x01,
+                               0x03, 0xe8, 0x01, 0x90, 0x2a, 0x23, 0x04, 0xb5,
+                               0x00, 0x3c, 0x00, 0x01, 0x04, 0x01, 0x40, 0x00,
+                               0x0c, 0x80, 0x07, 0xd0, 0x07, 0xd0, 0x05, 0xdc,
+                               0x00, 0x7d, 0x08, 0x08, 0x01, 0x93, 0x18, 0x0e,
+                               0x10, 0x0a, 0x41, 0x90, 0x32, 0x09, 0x2c, 0x64,
+                               0x00};
+
+/* av1C with a content light level OBU as configOBUs */
+static const uint8_t av1c[] = {0x81, 0x00, 0x0c, 0x00, 0x2a, 0x05, 0x01, 0x03,
+                               0xe8, 0x01, 0x90};
+
+static void test_obus() {
+    av1_metadata md;
+    memset(&md, 0, sizeof(md));
+    CHECK(av1_parse_obus(obus, sizeof(obus), &md) == 0);
+    CHECK(md.has_mdcv);
+    CHECK(md.mdcv.primaries[0][0] == 46399 && md.mdcv.primaries[0][1] == 19136);
+    CHECK(md.mdcv.white_point[0] == 20493 && md.mdcv.white_point[1] == 21561);
+    CHECK(md.mdcv.max_luminance == 1000 << 8);
+    CHECK(md.mdcv.min_luminance == 1 << 4);
+    CHECK(md.has_cll && md.max_cll == 1000 && md.max_fall == 400);
+    CHECK(md.has_hdr10plus && md.hdr10plus.num_windows == 1);
+
+    /* the size of the last OBU exceeds the buffer */
+    memset(&md, 0, sizeof(md));
+    CHECK(av1_parse_obus(obus, sizeof(obus) - 1, &md) < 0);
+    /* forbidden bit */
+    uint8_t buf[sizeof(obus)];
+    memcpy(buf, obus, sizeof(obus));
+    buf[0] |= 0x80;
+    CHECK(av1_parse_obus(buf, sizeof(buf), &md) < 0);
+}
+
+static void test_config() {
+    av1_metadata md;
+    memset(&md, 0, sizeof(md));
+    CHECK(av1_parse_config(av1c, sizeof(av1c), &md) == 0);
+    CHECK(md.has_cll && md.max_cll == 1000 && !md.has_mdcv);
+
+    /* marker bit missing */
+    uint8_t buf[sizeof(av1c)];
+    memcpy(buf, av1c, sizeof(av1c));
+    buf[0] = 0x01;
+    CHECK(av1_parse_config(buf, sizeof(buf), &md) < 0);
+    CHECK(av1_parse_config(av1c, 3, &md) < 0);
+}
+
+int main() {
+    test_obus();
+    test_config();
+    return check_status();
+}
@@ -0,0 +1,75 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "bdmv.h"
+#include "check.h"
+#include <stdint.h>
+#include <string.h>
+
+/* three play items: clip 00001 with a second angle 00002, then 00003 and
+ * 00001 again. One minute of 00001 and one second of 00003 in 45 kHz
+ * ticks. */
+static const uint8_t mpls[] = {0x4d, 0x50, 0x4c, 0x53, 0x30, 0x32, 0x30, 0x30,
+                               0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x78,
+                               0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x2c,
+                               0x30, 0x30, 0x30, 0x30, 0x31, 0x4d, 0x32, 0x54,
+                               0x53, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x29, 0x32, 0xe0, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x02, 0x00, 0x30, 0x30, 0x30, 0x30, 0x32, 0x4d,
+                               0x32, 0x54, 0x53, 0x00, 0x00, 0x20, 0x30, 0x30,
+                               0x30, 0x30, 0x33, 0x4d, 0x32, 0x54, 0x53, 0x00,
+                               0x00, 0x00, 0x00, 0x29, 0x32, 0xe0, 0x00, 0x29,
+                               0xe2, 0xa8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20,
+                               0x30, 0x30, 0x30, 0x30, 0x31, 0x4d, 0x32, 0x54,
+                               0x53, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x29, 0x32, 0xe0, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+/* one program with an audio stream on PID 0x1100 and HEVC on 0x1011 */
+static const uint8_t clpi[] = {0x48, 0x44, 0x4d, 0x56, 0x30, 0x32, 0x30, 0x30,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+                               0x00, 0x00, 0x00, 0x1a, 0x00, 0x01, 0x00, 0x00,
+                               0x00, 0x00, 0x01, 0x00, 0x02, 0x00, 0x11, 0x00,
+                               0x05, 0x81, 0x61, 0x10, 0x00, 0x00, 0x10, 0x11,
+                               0x05, 0x24, 0x61, 0x10, 0x00, 0x00};
+
+static void test_mpls() {
+    bdmv_playlist *pl = bdmv_parse_mpls(mpls, sizeof(mpls));
+    CHECK(pl != NULL);
+    if (pl == NULL)
+        return;
+    CHECK(pl->nb_items == 3);
+    CHECK(pl->items[0].nb_clips == 2);
+    CHECK(!strcmp(pl->items[0].clips[0], "00001"));
+    CHECK(!strcmp(pl->items[0].clips[1], "00002"));
+    CHECK(pl->items[1].nb_clips == 1);
+    CHECK(pl->items[1].in_time == 2700000 && pl->items[1].out_time == 2745000);
+    /* the repeated clip does not count twice */
+    CHECK(pl->duration == 2745000);
+    bdmv_playlist_free(pl);
+
+    /* the first play item is cut off */
+    CHECK(bdmv_parse_mpls(mpls, 60) == NULL);
+    uint8_t buf[sizeof(mpls)];
+    memcpy(buf, mpls, sizeof(mpls));
+    buf[3] = 'X';
+    CHECK(bdmv_parse_mpls(buf, sizeof(buf)) == NULL);
+}
+
+static void test_clpi() {
+    CHECK(bdmv_parse_clpi(clpi, sizeof(clpi)) == 0x1011);
+    /* the HEVC stream is cut off */
+    CHECK(bdmv_parse_clpi(clpi, sizeof(clpi) - 4) < 0);
+    /* without the HEVC stream */
+    uint8_t buf[sizeof(clpi)];
+    memcpy(buf, clpi, sizeof(clpi));
+    buf[41] = 0x1b;
+    CHECK(bdmv_parse_clpi(buf, sizeof(buf)) < 0);
+}
+
+int main() {
+    test_mpls();
+    test_clpi();
+    return check_status();
+}
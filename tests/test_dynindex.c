@@ -0,0 +1,118 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "check.h"
+#include "dynindex.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* three frames, the first two share the record with a targeted max luminance
+ * of 400 and maxscl 1000, 2000, 3000, the third has 1000 and 4000, 5000, 6000.
+ * The index starts at byte 128. */
+static const uint8_t fixture[] = {0x4d, 0x44, 0x44, 0x59, 0x4e, 0x49, 0x58,
+                                  0x31, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x1d, 0x00, 0x01, 0x01, 0x90, 0x01,
+                                  0x00, 0x00, 0x00, 0x00, 0xe8, 0x03, 0x00,
+                                  0x00, 0xd0, 0x07, 0x00, 0x00, 0xb8, 0x0b,
+                                  0x00, 0x00, 0xf4, 0x01, 0x00, 0x00, 0x00,
+                                  0x0a, 0x00, 0x00, 0x00, 0x1d, 0x00, 0x01,
+                                  0x01, 0xe8, 0x03, 0x00, 0x00, 0x00, 0x00,
+                                  0xa0, 0x0f, 0x00, 0x00, 0x88, 0x13, 0x00,
+                                  0x00, 0x70, 0x17, 0x00, 0x00, 0xf4, 0x01,
+                                  0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x5f, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00};
+
+#define INDEX_OFFSET 128
+
+/* returns the metadata of the frames in fixture */
+static hdr10plus frame_md(int frame) {
+    hdr10plus md;
+    memset(&md, 0, sizeof(md));
+    md.application_version = 1;
+    md.num_windows = 1;
+    md.targeted_max_luminance = frame < 2 ? 400 : 1000;
+    for (int c = 0; c < 3; c++)
+        md.windows[0].maxscl[c] = (frame < 2 ? 1000 : 4000) + c * 1000;
+    md.windows[0].average_maxrgb = 500;
+    md.windows[0].fraction_bright_pixels = 10;
+    return md;
+}
+
+static void test_write() {
+    FILE *f = tmpfile();
+    dynidx_writer *w = dynidx_writer_open(f);
+    CHECK(w != NULL);
+    if (w == NULL)
+        return;
+    for (int i = 0; i < 3; i++) {
+        hdr10plus md = frame_md(i);
+        CHECK(dynidx_write(w, &md) == 0);
+    }
+    CHECK(dynidx_finish(w) == 0);
+
+    uint8_t buf[sizeof(fixture) + 1];
+    rewind(f);
+    CHECK(fread(buf, 1, sizeof(buf), f) == sizeof(fixture));
+    CHECK(memcmp(buf, fixture, sizeof(fixture)) == 0);
+    fclose(f);
+}
+
+static void test_read() {
+    char *path = check_write_file(fixture, sizeof(fixture));
+    dynidx_reader *r = dynidx_open(path);
+    CHECK(r != NULL);
+    if (r != NULL) {
+        CHECK(r->hdr.frames == 3 && r->hdr.records == 2);
+        for (int i = 0; i < 3; i++) {
+            hdr10plus md, expected = frame_md(i);
+            int window;
+            CHECK(dynidx_get(r, i, &md) == 0);
+            CHECK(hdr10plus_diff(&md, &expected, &window) == NULL);
+        }
+        hdr10plus md;
+        CHECK(dynidx_get(r, 3, &md) < 0);
+        dynidx_close(r);
+    }
+    unlink(path);
+    free(path);
+}
+
+static void test_malformed() {
+    /* the index is cut off */
+    char *path = check_write_file(fixture, sizeof(fixture) - 4);
+    CHECK(dynidx_open(path) == NULL);
+    unlink(path);
+    free(path);
+
+    /* the last frame points into the middle of the second record */
+    uint8_t buf[sizeof(fixture)];
+    memcpy(buf, fixture, sizeof(fixture));
+    buf[INDEX_OFFSET + 16] += 20;
+    path = check_write_file(buf, sizeof(buf));
+    dynidx_reader *r = dynidx_open(path);
+    CHECK(r != NULL);
+    if (r != NULL) {
+        hdr10plus md;
+        CHECK(dynidx_get(r, 0, &md) == 0);
+        CHECK(dynidx_get(r, 2, &md) < 0);
+        dynidx_close(r);
+    }
+    unlink(path);
+    free(path);
+}
+
+int main() {
+    test_write();
+    test_read();
+    test_malformed();
+    return check_status();
+}
@@ -0,0 +1,63 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "check.h"
+#include "hdr10plus.h"
+#include <stdint.h>
+#include <string.h>
+
+/* one window with two percentiles and a tone mapping curve of two anchors */
+static const uint8_t t35[] = {0xb5, 0x00, 0x3c, 0x00, 0x01, 0x04, 0x01, 0x40,
+                              0x00, 0x0c, 0x80, 0x07, 0xd0, 0x07, 0xd0, 0x05,
+                              0xdc, 0x00, 0x7d, 0x08, 0x08, 0x01, 0x93, 0x18,
+                              0x0e, 0x10, 0x0a, 0x41, 0x90, 0x32, 0x09, 0x2c,
+                              0x64, 0x00};
+
+static void test_valid() {
+    hdr10plus md;
+    CHECK(hdr10plus_is_t35(t35, sizeof(t35)));
+    CHECK(hdr10plus_parse_t35(t35, sizeof(t35), &md) == 0);
+    CHECK(md.application_version == 1);
+    CHECK(md.num_windows == 1);
+    CHECK(md.targeted_max_luminance == 400);
+    const hdr10plus_window *w = &md.windows[0];
+    CHECK(w->maxscl[0] == 1000 && w->maxscl[1] == 2000 &&
+          w->maxscl[2] == 3000);
+    CHECK(w->average_maxrgb == 500);
+    CHECK(w->num_percentiles == 2);
+    CHECK(w->percentages[1] == 99 && w->percentiles[1] == 900);
+    CHECK(w->fraction_bright_pixels == 10);
+    CHECK(w->tone_mapping_flag == 1);
+    CHECK(w->knee_point_x == 100 && w->knee_point_y == 200);
+    CHECK(w->num_anchors == 2);
+    CHECK(w->anchors[0] == 300 && w->anchors[1] == 400);
+
+    int window;
+    hdr10plus other = md;
+    CHECK(hdr10plus_diff(&md, &other, &window) == NULL);
+    other.windows[0].anchors[1]++;
+    const char *field = hdr10plus_diff(&md, &other, &window);
+    CHECK(field != NULL && strcmp(field, "anchors") == 0 && window == 0);
+}
+
+static void test_malformed() {
+    hdr10plus md;
+    /* the tone mapping curve is cut off */
+    CHECK(hdr10plus_parse_t35(t35, sizeof(t35) - 3, &md) < 0);
+
+    /* other terminal provider */
+    uint8_t buf[sizeof(t35)];
+    memcpy(buf, t35, sizeof(t35));
+    buf[2] = 0x3b;
+    CHECK(!hdr10plus_is_t35(buf, sizeof(buf)));
+    CHECK(hdr10plus_parse_t35(buf, sizeof(buf), &md) < 0);
+
+    /* num_windows 0 */
+    memcpy(buf, t35, sizeof(t35));
+    buf[7] &= 0x3f;
+    CHECK(hdr10plus_parse_t35(buf, sizeof(buf), &md) < 0);
+}
+
+int main() {
+    test_valid();
+    test_malformed();
+    return check_status();
+}
@@ -0,0 +1,114 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "check.h"
+#include "hevcsei.h"
+#include <stdint.h>
+#include <string.h>
+
+/* a prefix SEI NAL unit with mastering display (BT.2020, 1000 / 0.0001
+ * cd/m^2, the min luminance needs an emulation prevention byte), content
+ * light level (1000 / 400) and HDR10+ messages, followed by an IDR */
+static const uint8_t annexb[] = {0x00, 0x00, 0x00, 0x01, 0x4e, 0x01, 0x89, 0x18,
+                                 0x21, 0x34, 0x9b, 0xaa, 0x19, 0x96, 0x08, 0xfc,
+                                 0x8a, 0x48, 0x39, 0x08, 0x3d, 0x13, 0x40, 0x42,
+                                 0x00, 0x98, 0x96, 0x80, 0x00, 0x00, 0x03, 0x00,
+                                 0x01, 0x90, 0x04, 0x03, 0xe8, 0x01, 0x90, 0x04,
+                                 0x22, 0xb5, 0x00, 0x3c, 0x00, 0x01, 0x04, 0x01,
+                                 0x40, 0x00, 0x0c, 0x80, 0x07, 0xd0, 0x07, 0xd0,
+                                 0x05, 0xdc, 0x00, 0x7d, 0x08, 0x08, 0x01, 0x93,
+                                 0x18, 0x0e, 0x10, 0x0a, 0x41, 0x90, 0x32, 0x09,
+                                 0x2c, 0x64, 0x00, 0x80, 0x00, 0x00, 0x01, 0x26,
+                                 0x01, 0xaf, 0x80};
+
+/* the mastering display message claims 48 payload bytes but has 24 */
+static const uint8_t truncated_sei[] = {0x00, 0x00, 0x01, 0x4e, 0x01, 0x89,
+                                        0x30, 0x21, 0x34, 0x9b, 0xaa, 0x19,
+                                        0x96, 0x08, 0xfc, 0x8a, 0x48, 0x39,
+                                        0x08, 0x3d, 0x13, 0x40, 0x42, 0x00,
+                                        0x98, 0x96, 0x80, 0x00, 0x00, 0x03,
+                                        0x00, 0x01, 0x80};
+
+/* hvcC with 4 byte NAL unit lengths and a content light level SEI */
+static const uint8_t hvcc[] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x01, 0xa7,
+                               0x00, 0x01, 0x00, 0x09, 0x4e, 0x01, 0x90, 0x04,
+                               0x03, 0xe8, 0x01, 0x90, 0x80};
+
+/* the same SEI and an IDR with 4 byte length prefixes */
+static const uint8_t lp[] = {0x00, 0x00, 0x00, 0x09, 0x4e, 0x01, 0x90, 0x04,
+                             0x03, 0xe8, 0x01, 0x90, 0x80, 0x00, 0x00, 0x00,
+                             0x04, 0x26, 0x01, 0xaf, 0x80};
+
+static void test_annexb() {
+    hevc_sei sei;
+    memset(&sei, 0, sizeof(sei));
+    hevc_parse_annexb(annexb, sizeof(annexb), &sei);
+    CHECK(sei.has_mdcv);
+    const hevc_mdcv *m = &sei.mdcv;
+    CHECK(m->primaries[0][0] == 8500 && m->primaries[0][1] == 39850);
+    CHECK(m->primaries[2][0] == 35400 && m->primaries[2][1] == 14600);
+    CHECK(m->white_point[0] == 15635 && m->white_point[1] == 16450);
+    CHECK(m->max_luminance == 10000000);
+    CHECK(m->min_luminance == 1);
+    CHECK(sei.has_cll && sei.max_cll == 1000 && sei.max_fall == 400);
+    CHECK(sei.has_hdr10plus && sei.hdr10plus.targeted_max_luminance == 400);
+    CHECK(sei.has_irap);
+
+    memset(&sei, 0, sizeof(sei));
+    hevc_parse_annexb(truncated_sei, sizeof(truncated_sei), &sei);
+    CHECK(!sei.has_mdcv && !sei.has_cll && !sei.has_irap);
+}
+
+static void test_config() {
+    hevc_sei sei;
+    memset(&sei, 0, sizeof(sei));
+    CHECK(hevc_parse_config(hvcc, sizeof(hvcc), &sei) == 4);
+    CHECK(sei.has_cll && sei.max_cll == 1000 && sei.max_fall == 400);
+
+    /* the NAL unit is cut off */
+    CHECK(hevc_parse_config(hvcc, sizeof(hvcc) - 1, &sei) < 0);
+    /* Annex B extradata is no hvcC */
+    CHECK(hevc_parse_config(annexb, sizeof(annexb), &sei) < 0);
+}
+
+static void test_length_prefixed() {
+    hevc_sei sei;
+    memset(&sei, 0, sizeof(sei));
+    CHECK(hevc_parse_lp(lp, sizeof(lp), 4, &sei) == 0);
+    CHECK(sei.has_cll && sei.max_cll == 1000);
+    CHECK(sei.has_irap);
+
+    /* the length of the IDR exceeds the buffer */
+    CHECK(hevc_parse_lp(lp, sizeof(lp) - 1, 4, &sei) < 0);
+    CHECK(hevc_parse_lp(lp, sizeof(lp), 5, &sei) < 0);
+}
+
+/* every track of -alltracks parses its samples with the NAL unit length size
+ * of its own hvcC */
+static void test_track_length_size() {
+    uint8_t config[sizeof(hvcc)];
+    memcpy(config, hvcc, sizeof(hvcc));
+    config[21] = 0xfd; /* lengthSizeMinusOne 1 */
+    hevc_sei sei;
+    memset(&sei, 0, sizeof(sei));
+    int length_size = hevc_parse_config(config, sizeof(config), &sei);
+    CHECK(length_size == 2);
+
+    /* the samples of lp with 2 byte length prefixes */
+    const uint8_t sample[] = {0x00, 0x09, 0x4e, 0x01, 0x90, 0x04, 0x03, 0xe8,
+                              0x01, 0x90, 0x80, 0x00, 0x04, 0x26, 0x01, 0xaf,
+                              0x80};
+    memset(&sei, 0, sizeof(sei));
+    CHECK(hevc_parse_lp(sample, sizeof(sample), length_size, &sei) == 0);
+    CHECK(sei.has_cll && sei.has_irap);
+    /* read with the length size of another track */
+    CHECK(hevc_parse_lp(sample, sizeof(sample), 4, &sei) < 0);
+}
+
+int main() {
+    test_annexb();
+    test_config();
+    test_length_prefixed();
+    test_track_length_size();
+    return check_status();
+}
@@ -0,0 +1,145 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "check.h"
+#include "mpegts.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PACKET 188
+#define PID_PAT 0x0000
+#define PID_PMT 0x1000
+#define PID_VIDEO 0x0100
+
+/* program 1 with its PMT on PID_PMT */
+static const uint8_t pat[] = {0x00, 0xb0, 0x0d, 0x00, 0x01, 0xc1, 0x00, 0x00,
+                              0x00, 0x01, 0xf0, 0x00, 0x2a, 0xb1, 0x04, 0xb2};
+
+/* an HEVC stream on PID_VIDEO */
+static const uint8_t pmt[] = {0x02, 0xb0, 0x12, 0x00, 0x01, 0xc1, 0x00, 0x00,
+                              0xe1, 0x00, 0xf0, 0x00, 0x24, 0xe1, 0x00, 0xf0,
+                              0x00, 0x2f, 0x00, 0x6e, 0xe7};
+
+/* video PES header with a PTS */
+static const uint8_t pes_header[] = {0x00, 0x00, 0x01, 0xe0, 0x00, 0x00, 0x80,
+                                     0x80, 0x05, 0x21, 0x00, 0x01, 0x00, 0x01};
+
+/* mastering display SEI (BT.2020, 1000 / 0.0001 cd/m^2) and an IDR */
+static const uint8_t access_unit[] = {0x00, 0x00, 0x00, 0x01, 0x4e, 0x01, 0x89,
+                                      0x18, 0x21, 0x34, 0x9b, 0xaa, 0x19, 0x96,
+                                      0x08, 0xfc, 0x8a, 0x48, 0x39, 0x08, 0x3d,
+                                      0x13, 0x40, 0x42, 0x00, 0x98, 0x96, 0x80,
+                                      0x00, 0x00, 0x03, 0x00, 0x01, 0x80, 0x00,
+                                      0x00, 0x01, 0x26, 0x01, 0xaf, 0x80};
+
+/* an IDR without SEI */
+static const uint8_t idr[] = {0x00, 0x00, 0x00, 0x01, 0x26, 0x01, 0xaf, 0x80};
+
+typedef struct ts_stream {
+    uint8_t data[PACKET * 8];
+    size_t size;
+} ts_stream;
+
+/* appends a packet of pid, payload is padded with adaptation field stuffing */
+static void put_packet(ts_stream *s, int pid, bool unit_start,
+                       const uint8_t *payload, size_t size) {
+    uint8_t *p = s->data + s->size;
+    s->size += PACKET;
+    size_t stuffing = PACKET - 4 - size;
+    p[0] = 0x47;
+    p[1] = (unit_start ? 0x40 : 0x00) | (pid >> 8);
+    p[2] = pid & 0xff;
+    p[3] = stuffing > 0 ? 0x30 : 0x10;
+    if (stuffing > 0) {
+        p[4] = stuffing - 1;
+        if (stuffing > 1) {
+            p[5] = 0x00; /* no adaptation field flags */
+            memset(p + 6, 0xff, stuffing - 2);
+        }
+    }
+    memcpy(p + 4 + stuffing, payload, size);
+}
+
+/* appends a section with a zero pointer field */
+static void put_section(ts_stream *s, int pid, const uint8_t *sec,
+                        size_t size) {
+    uint8_t buf[PACKET];
+    buf[0] = 0x00;
+    memcpy(buf + 1, sec, size);
+    put_packet(s, pid, true, buf, size + 1);
+}
+
+/* appends a PES of es, split into two packets after split bytes of es */
+static void put_pes(ts_stream *s, const uint8_t *es, size_t size,
+                    size_t split) {
+    uint8_t buf[PACKET];
+    memcpy(buf, pes_header, sizeof(pes_header));
+    memcpy(buf + sizeof(pes_header), es, split);
+    put_packet(s, PID_VIDEO, true, buf, sizeof(pes_header) + split);
+    if (split < size)
+        put_packet(s, PID_VIDEO, false, es + split, size - split);
+}
+
+static int scan(const ts_stream *s, int pid, hevc_sei *sei, unsigned *iraps) {
+    char *path = check_write_file(s->data, s->size);
+    int ret = ts_scan_hevc(path, pid, TS_SCAN_LIMIT, NULL, sei, iraps);
+    unlink(path);
+    free(path);
+    return ret;
+}
+
+static void test_found() {
+    ts_stream s = {.size = 0};
+    put_section(&s, PID_PAT, pat, sizeof(pat));
+    put_section(&s, PID_PMT, pmt, sizeof(pmt));
+    /* the SEI is split across two packets */
+    put_pes(&s, access_unit, sizeof(access_unit), 20);
+
+    hevc_sei sei;
+    unsigned iraps;
+    CHECK(scan(&s, -1, &sei, &iraps) == 1);
+    CHECK(sei.has_mdcv && sei.has_irap);
+    CHECK(sei.mdcv.primaries[0][0] == 8500);
+    CHECK(sei.mdcv.max_luminance == 10000000 && sei.mdcv.min_luminance == 1);
+    CHECK(iraps == 0);
+
+    /* the video PID is known, PAT and PMT are skipped */
+    CHECK(scan(&s, PID_VIDEO, &sei, NULL) == 1);
+}
+
+static void test_missing() {
+    ts_stream s = {.size = 0};
+    put_section(&s, PID_PAT, pat, sizeof(pat));
+    put_section(&s, PID_PMT, pmt, sizeof(pmt));
+    put_pes(&s, idr, sizeof(idr), sizeof(idr));
+    put_pes(&s, idr, sizeof(idr), sizeof(idr));
+
+    hevc_sei sei;
+    unsigned iraps;
+    CHECK(scan(&s, -1, &sei, &iraps) == 0);
+    CHECK(!sei.has_mdcv);
+    CHECK(iraps == TS_SCAN_IRAPS);
+}
+
+static void test_malformed() {
+    /* the PMT section is cut off, the video PID is never found */
+    ts_stream s = {.size = 0};
+    put_section(&s, PID_PAT, pat, sizeof(pat));
+    put_section(&s, PID_PMT, pmt, 10);
+    put_pes(&s, access_unit, sizeof(access_unit), sizeof(access_unit));
+
+    hevc_sei sei;
+    unsigned iraps;
+    CHECK(scan(&s, -1, &sei, &iraps) == 0);
+    CHECK(!sei.has_mdcv && iraps == 0);
+
+    /* no sync bytes */
+    s.data[0] = s.data[PACKET] = s.data[2 * PACKET] = 0x00;
+    CHECK(scan(&s, -1, &sei, &iraps) < 0);
+}
+
+int main() {
+    test_found();
+    test_missing();
+    test_malformed();
+    return check_status();
+}
@@ -0,0 +1,134 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "budget.h"
+#include "check.h"
+#include "errors.h"
+#include "mxf.h"
+#include <stdint.h>
+#include <string.h>
+
+/* 8 bytes of run-in, a header partition pack and a primer pack with BER long
+ * form lengths, then a CDCI descriptor with an unrelated local tag and the
+ * four MasteringDisplay items. The primer maps them with labels of registry
+ * version 0x0d, the primaries are coded in the order red, green, blue. */
+static const uint8_t fixture[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x06, 0x0e, 0x2b, 0x34, 0x02, 0x05,
+                                  0x01, 0x01, 0x0d, 0x01, 0x02, 0x01, 0x01,
+                                  0x02, 0x04, 0x00, 0x83, 0x00, 0x00, 0x58,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                  0x00, 0x00, 0x00, 0x00, 0x06, 0x0e, 0x2b,
+                                  0x34, 0x02, 0x05, 0x01, 0x01, 0x0d, 0x01,
+                                  0x02, 0x01, 0x01, 0x05, 0x01, 0x00, 0x83,
+                                  0x00, 0x00, 0x62, 0x00, 0x00, 0x00, 0x05,
+                                  0x00, 0x00, 0x00, 0x12, 0x3c, 0x0a, 0x06,
+                                  0x0e, 0x2b, 0x34, 0x01, 0x01, 0x01, 0x01,
+                                  0x01, 0x01, 0x15, 0x02, 0x00, 0x00, 0x00,
+                                  0x00, 0x83, 0x01, 0x06, 0x0e, 0x2b, 0x34,
+                                  0x01, 0x01, 0x01, 0x0d, 0x04, 0x20, 0x04,
+                                  0x01, 0x01, 0x01, 0x00, 0x00, 0x83, 0x02,
+                                  0x06, 0x0e, 0x2b, 0x34, 0x01, 0x01, 0x01,
+                                  0x0d, 0x04, 0x20, 0x04, 0x01, 0x01, 0x02,
+                                  0x00, 0x00, 0x83, 0x03, 0x06, 0x0e, 0x2b,
+                                  0x34, 0x01, 0x01, 0x01, 0x0d, 0x04, 0x20,
+                                  0x04, 0x01, 0x01, 0x03, 0x00, 0x00, 0x83,
+                                  0x04, 0x06, 0x0e, 0x2b, 0x34, 0x01, 0x01,
+                                  0x01, 0x0d, 0x04, 0x20, 0x04, 0x01, 0x01,
+                                  0x04, 0x00, 0x00, 0x06, 0x0e, 0x2b, 0x34,
+                                  0x02, 0x53, 0x01, 0x01, 0x0d, 0x01, 0x01,
+                                  0x01, 0x01, 0x01, 0x29, 0x00, 0x3c, 0x3c,
+                                  0x0a, 0x00, 0x10, 0x00, 0x01, 0x02, 0x03,
+                                  0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+                                  0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x83, 0x01,
+                                  0x00, 0x0c, 0x8a, 0x48, 0x39, 0x08, 0x21,
+                                  0x34, 0x9b, 0xaa, 0x19, 0x96, 0x08, 0xfc,
+                                  0x83, 0x02, 0x00, 0x04, 0x3d, 0x13, 0x40,
+                                  0x42, 0x83, 0x03, 0x00, 0x04, 0x00, 0x98,
+                                  0x96, 0x80, 0x83, 0x04, 0x00, 0x04, 0x00,
+                                  0x00, 0x00, 0x32};
+
+/* offsets in fixture */
+#define PARTITION_LENGTH 24 /* BER length of the partition pack */
+#define PARTITION_VALUE 28
+#define PRIMER_ITEM_SIZE 143 /* last byte of the primer item size */
+#define DESCRIPTOR 234
+
+static void check_mdcv(const hevc_sei *sei) {
+    CHECK(sei->has_mdcv);
+    const uint16_t primaries[3][2] = {
+        {8500, 39850}, {6550, 2300}, {35400, 14600}};
+    CHECK(!memcmp(sei->mdcv.primaries, primaries, sizeof(primaries)));
+    CHECK(sei->mdcv.white_point[0] == 15635);
+    CHECK(sei->mdcv.white_point[1] == 16450);
+    CHECK(sei->mdcv.max_luminance == 10000000);
+    CHECK(sei->mdcv.min_luminance == 50);
+}
+
+static void test_header() {
+    hevc_sei sei;
+    CHECK(mxf_parse_header(fixture, sizeof(fixture), &sei) == 1);
+    check_mdcv(&sei);
+}
+
+static void test_probe() {
+    char *path = check_write_file(fixture, sizeof(fixture));
+    probe_budget budget;
+    budget_start(&budget, 0, 0);
+    hevc_sei sei;
+    CHECK(mxf_probe(path, &budget, &sei) == 1);
+    check_mdcv(&sei);
+    CHECK(budget.bytes == sizeof(fixture));
+    /* nothing is read once the budget is exhausted */
+    budget.byte_limit = 1;
+    CHECK(mxf_probe(path, &budget, &sei) == 0);
+    CHECK(!sei.has_mdcv);
+    CHECK(budget.bytes == sizeof(fixture));
+    unlink(path);
+    free(path);
+}
+
+static void test_malformed() {
+    uint8_t buf[sizeof(fixture)];
+    hevc_sei sei;
+
+    memset(buf, 0, sizeof(buf));
+    CHECK(mxf_parse_header(buf, sizeof(buf), &sei) == -1);
+
+    /* BER long form without length bytes */
+    memcpy(buf, fixture, sizeof(buf));
+    buf[PARTITION_LENGTH] = 0x80;
+    CHECK(mxf_parse_header(buf, sizeof(buf), &sei) == -1);
+
+    /* a partition pack too short for its fields */
+    memcpy(buf, fixture, sizeof(buf));
+    CHECK(mxf_parse_header(buf, PARTITION_VALUE + 39, &sei) == -1);
+
+    /* primer entries that are not 18 bytes */
+    buf[PRIMER_ITEM_SIZE] = 17;
+    CHECK(mxf_parse_header(buf, sizeof(buf), &sei) == 0);
+    CHECK(!sei.has_mdcv);
+
+    /* descriptor cut off in the middle of the primaries */
+    CHECK(mxf_parse_header(fixture, DESCRIPTOR + 40, &sei) == 0);
+    CHECK(!sei.has_mdcv);
+
+    clear_global_md_error();
+    CHECK(mxf_probe("missing.mxf", NULL, &sei) == -1);
+    CHECK(global_md_error == ERR_CUSTOM);
+}
+
+int main() {
+    test_header();
+    test_probe();
+    test_malformed();
+    return check_status();
+}
@@ -0,0 +1,157 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "check.h"
+#include "errors.h"
+#include "package.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static bool str_eq(const char *a, const char *b) {
+    return a != NULL && b != NULL && !strcmp(a, b);
+}
+
+/* media playlist with an init segment map and byte ranges */
+static const char hls_media[] =
+    "#EXTM3U\n"
+    "#EXT-X-VERSION:7\n"
+    "#EXT-X-MAP:URI=\"init%20v.mp4\",BYTERANGE=\"720@16\"\r\n"
+    "#EXTINF:6.0,\n"
+    "#EXT-X-BYTERANGE:1000@2000\n"
+    "seg/0.m4s?token=1\n"
+    "#EXTINF:6.0,\n"
+    "seg/1.m4s\n";
+
+static void test_hls_media() {
+    pkg_package *pkg =
+        pkg_parse_hls(hls_media, strlen(hls_media), "/pkg/hls/video.m3u8");
+    CHECK(pkg != NULL && pkg->nb_variants == 1);
+    if (pkg == NULL || pkg->nb_variants != 1)
+        return;
+    pkg_variant *v = &pkg->variants[0];
+    CHECK(str_eq(v->name, "video.m3u8"));
+    CHECK(str_eq(v->init.path, "/pkg/hls/init v.mp4"));
+    CHECK(v->init.offset == 16 && v->init.length == 720);
+    CHECK(str_eq(v->segment.path, "/pkg/hls/seg/0.m4s"));
+    CHECK(v->segment.offset == 2000 && v->segment.length == 1000);
+    pkg_free(pkg);
+}
+
+/* master playlist with a variant playlist that is written to disk, another
+ * one that is missing and an audio rendition of the first */
+static void test_hls_master() {
+    static const char variant[] = "#EXTM3U\n#EXTINF:4.0,\nv0/seg.ts\n";
+    char *vpath = check_write_file((const uint8_t *)variant, strlen(variant));
+    char master[512];
+    snprintf(master, sizeof(master),
+             "#EXTM3U\n"
+             "#EXT-X-STREAM-INF:BANDWIDTH=5000000,CODECS=\"hvc1,mp4a\"\n"
+             "%s\n"
+             "#EXT-X-STREAM-INF:BANDWIDTH=5000000,AUDIO=\"b\"\n"
+             "%s\n"
+             "#EXT-X-STREAM-INF:BANDWIDTH=1000000\n"
+             "missing.m3u8\n",
+             vpath, vpath);
+    pkg_package *pkg = pkg_parse_hls(master, strlen(master), "master.m3u8");
+    CHECK(pkg != NULL && pkg->nb_variants == 2);
+    if (pkg != NULL && pkg->nb_variants == 2) {
+        CHECK(str_eq(pkg->variants[0].name, vpath));
+        CHECK(pkg->variants[0].init.path == NULL);
+        CHECK(str_eq(pkg->variants[0].segment.path, "v0/seg.ts"));
+        CHECK(pkg->variants[0].segment.offset == 0);
+        CHECK(pkg->variants[0].segment.length == -1);
+        CHECK(str_eq(pkg->variants[1].name, "missing.m3u8"));
+        CHECK(pkg->variants[1].segment.path == NULL);
+    }
+    CHECK(global_md_error == ERR_NONE);
+    if (pkg != NULL)
+        pkg_free(pkg);
+    unlink(vpath);
+    free(vpath);
+}
+
+/* BaseURLs on every level, a segment template, a segment list, a single
+ * file with a segment base and an audio set that is left out */
+static const char dash[] =
+    "<?xml version=\"1.0\"?>\n"
+    "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\">\n"
+    "  <BaseURL>media/</BaseURL>\n"
+    "  <Period>\n"
+    "    <BaseURL> period/ </BaseURL>\n"
+    "    <AdaptationSet contentType=\"video\">\n"
+    "      <SegmentTemplate initialization=\"$RepresentationID$/init.mp4\"\n"
+    "          media=\"$RepresentationID$/$Number%05d$.m4s\"\n"
+    "          startNumber=\"7\"/>\n"
+    "      <Representation id=\"hd\" bandwidth=\"8000000\"/>\n"
+    "    </AdaptationSet>\n"
+    "    <AdaptationSet mimeType=\"video/mp4\">\n"
+    "      <Representation id=\"list\">\n"
+    "        <SegmentList>\n"
+    "          <Initialization sourceURL=\"l.mp4\" range=\"0-99\"/>\n"
+    "          <SegmentURL media=\"l.mp4\" mediaRange=\"100-1099\"/>\n"
+    "        </SegmentList>\n"
+    "      </Representation>\n"
+    "      <Representation id=\"single\">\n"
+    "        <BaseURL>/abs/single.mp4</BaseURL>\n"
+    "        <SegmentBase><Initialization range=\"0-861\"/></SegmentBase>\n"
+    "      </Representation>\n"
+    "    </AdaptationSet>\n"
+    "    <AdaptationSet contentType=\"audio\">\n"
+    "      <Representation id=\"aac\"/>\n"
+    "    </AdaptationSet>\n"
+    "  </Period>\n"
+    "</MPD>\n";
+
+static void test_dash() {
+    pkg_package *pkg = pkg_parse_dash(dash, strlen(dash), "/pkg/dash.mpd");
+    CHECK(pkg != NULL && pkg->nb_variants == 3);
+    if (pkg == NULL || pkg->nb_variants != 3)
+        return;
+    pkg_variant *v = pkg->variants;
+    CHECK(str_eq(v[0].name, "hd"));
+    CHECK(str_eq(v[0].init.path, "/pkg/media/period/hd/init.mp4"));
+    CHECK(str_eq(v[0].segment.path, "/pkg/media/period/hd/00007.m4s"));
+    CHECK(v[0].segment.length == -1);
+    CHECK(str_eq(v[1].name, "list"));
+    CHECK(str_eq(v[1].init.path, "/pkg/media/period/l.mp4"));
+    CHECK(v[1].init.offset == 0 && v[1].init.length == 100);
+    CHECK(str_eq(v[1].segment.path, "/pkg/media/period/l.mp4"));
+    CHECK(v[1].segment.offset == 100 && v[1].segment.length == 1000);
+    CHECK(str_eq(v[2].name, "single"));
+    CHECK(str_eq(v[2].init.path, "/abs/single.mp4"));
+    CHECK(v[2].init.offset == 0 && v[2].init.length == 862);
+    CHECK(str_eq(v[2].segment.path, "/abs/single.mp4"));
+    CHECK(v[2].segment.offset == 862 && v[2].segment.length == -1);
+    pkg_free(pkg);
+}
+
+static void check_malformed(pkg_package *pkg) {
+    CHECK(pkg == NULL);
+    CHECK(global_md_error == ERR_CUSTOM);
+    clear_global_md_error();
+    if (pkg != NULL)
+        pkg_free(pkg);
+}
+
+static void test_malformed() {
+    static const char not_hls[] = "#EXTINF:6.0,\nseg.ts\n";
+    check_malformed(pkg_parse_hls(not_hls, strlen(not_hls), "a.m3u8"));
+    static const char no_uri[] =
+        "#EXTM3U\n#EXT-X-STREAM-INF:BANDWIDTH=1000\n# no URI\n";
+    check_malformed(pkg_parse_hls(no_uri, strlen(no_uri), "a.m3u8"));
+    static const char audio_only[] =
+        "<MPD><Period><AdaptationSet contentType=\"audio\">"
+        "<Representation id=\"a\"/></AdaptationSet></Period></MPD>";
+    check_malformed(pkg_parse_dash(audio_only, strlen(audio_only), "a.mpd"));
+    static const char not_mpd[] = "<Playlist><Period/></Playlist>";
+    check_malformed(pkg_parse_dash(not_mpd, strlen(not_mpd), "a.mpd"));
+    static const char cut[] = "<MPD><Period><AdaptationSet>";
+    check_malformed(pkg_parse_dash(cut, strlen(cut), "a.mpd"));
+}
+
+int main() {
+    test_hls_media();
+    test_hls_master();
+    test_dash();
+    test_malformed();
+    return check_status();
+}
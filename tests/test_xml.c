@@ -0,0 +1,72 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "check.h"
+#include "errors.h"
+#include "xml.h"
+#include <string.h>
+
+/* a DOCTYPE whose internal subset nests markup, entities in attributes and
+ * text, a CDATA section and namespace prefixes */
+static const char valid[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<!DOCTYPE MPD [\n"
+    "  <!ENTITY ext \"external\">\n"
+    "  <!ELEMENT MPD (Period)>\n"
+    "]>\n"
+    "<!-- a comment <with> markup -->\n"
+    "<mpd:MPD xmlns:mpd=\"urn:mpeg:dash:schema:mpd:2011\" "
+    "title='a &amp; b &lt;c&gt; &quot;d&quot; &apos;e&apos;'>\n"
+    "  <mpd:Period id=\"&#49;\">caf&#xe9; &#x20AC;</mpd:Period>\n"
+    "  <Period id=\"2\"><![CDATA[<raw> &amp;]]>tail</Period>\n"
+    "  <Empty/>\n"
+    "</mpd:MPD>\n";
+
+static void test_valid() {
+    xml_node *root = xml_parse(valid, strlen(valid));
+    CHECK(root != NULL);
+    if (root == NULL)
+        return;
+    CHECK(!strcmp(root->name, "MPD"));
+    CHECK(xml_attr(root, "title") != NULL &&
+          !strcmp(xml_attr(root, "title"), "a & b <c> \"d\" 'e'"));
+    CHECK(xml_attr(root, "missing") == NULL);
+
+    xml_node *first = xml_child(root, "Period");
+    CHECK(first != NULL);
+    if (first != NULL) {
+        CHECK(!strcmp(xml_attr(first, "id"), "1"));
+        CHECK(first->text != NULL &&
+              !strcmp(first->text, "caf\xc3\xa9 \xe2\x82\xac"));
+        xml_node *second = xml_next(first, "Period");
+        CHECK(second != NULL);
+        if (second != NULL) {
+            CHECK(!strcmp(xml_attr(second, "id"), "2"));
+            CHECK(second->text != NULL &&
+                  !strcmp(second->text, "<raw> &amp;tail"));
+            CHECK(xml_next(second, "Period") == NULL);
+        }
+    }
+    xml_node *empty = xml_child(root, "Empty");
+    CHECK(empty != NULL && empty->children == NULL && empty->text == NULL);
+    xml_free(root);
+}
+
+static void check_malformed(const char *doc) {
+    clear_global_md_error();
+    CHECK(xml_parse(doc, strlen(doc)) == NULL);
+    CHECK(global_md_error == ERR_CUSTOM);
+}
+
+static void test_malformed() {
+    check_malformed("<MPD><Period><![CDATA[never closed</Period></MPD>");
+    check_malformed("<MPD><Period></Segment></MPD>");
+    check_malformed("<MPD id=unquoted></MPD>");
+    check_malformed("<MPD/><MPD/>");
+    check_malformed("<MPD><!-- never closed </MPD>");
+    check_malformed("<MPD><Period>");
+}
+
+int main() {
+    test_valid();
+    test_malformed();
+    return check_status();
+}
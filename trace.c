@@ -0,0 +1,234 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#define _DEFAULT_SOURCE
+#include "trace.h"
+#include "budget.h"
+#include "errors.h"
+#include "wrappers.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef MD_USDT
+#include <sys/sdt.h>
+#endif
+
+/* events per chunk of a thread buffer */
+#define TRACE_CHUNK 4096
+/* bytes of the file name the USDT probes see without -trace */
+#define TRACE_FILE_MAX 4096
+
+typedef struct trace_event {
+    const char *phase;
+    const char *file; /* owned by the thread buffer */
+    const char *name[2]; /* of the optional arguments */
+    int64_t ts;
+    int64_t dur;
+    int64_t value[2];
+} trace_event;
+
+typedef struct trace_chunk {
+    struct trace_chunk *next;
+    size_t n;
+    trace_event events[TRACE_CHUNK];
+} trace_chunk;
+
+/* only written by its thread until trace_close */
+typedef struct trace_buffer {
+    struct trace_buffer *next;
+    long tid;
+    trace_chunk *head;
+    trace_chunk *tail;
+    char **files; /* every file name the events refer to */
+    size_t nb_files;
+} trace_buffer;
+
+static bool trace_enabled = false;
+static FILE *trace_stream = NULL;
+static int64_t trace_start;
+/* buffers of every thread that recorded an event */
+static _Atomic(trace_buffer *) trace_buffers = NULL;
+
+static _Thread_local trace_buffer *thread_buffer = NULL;
+static _Thread_local const char *thread_file = NULL;
+#ifdef MD_USDT
+static _Thread_local char usdt_file[TRACE_FILE_MAX];
+#endif
+
+int trace_open(const char *path) {
+    trace_stream = fopen(path, "w");
+    if (trace_stream == NULL) {
+        md_error_custom(strerror(errno));
+        return -1;
+    }
+    trace_start = budget_now();
+    trace_enabled = true;
+    return 0;
+}
+
+static trace_buffer *buffer_get() {
+    if (thread_buffer != NULL)
+        return thread_buffer;
+    trace_buffer *b = md_calloc(1, sizeof(trace_buffer));
+    b->tid = syscall(SYS_gettid);
+    b->head = b->tail = md_calloc(1, sizeof(trace_chunk));
+    b->next = atomic_load(&trace_buffers);
+    while (!atomic_compare_exchange_weak(&trace_buffers, &b->next, b))
+        ;
+    thread_buffer = b;
+    return b;
+}
+
+void trace_file(const char *path) {
+    if (!trace_enabled) {
+        /* the probes may fire after path was freed, keep a copy */
+#ifdef MD_USDT
+        snprintf(usdt_file, sizeof(usdt_file), "%s", path);
+        thread_file = usdt_file;
+#else
+        thread_file = NULL;
+#endif
+        return;
+    }
+    /* the events keep a copy, path may be freed before trace_close */
+    trace_buffer *b = buffer_get();
+    if (b->nb_files > 0 && strcmp(b->files[b->nb_files - 1], path) == 0) {
+        thread_file = b->files[b->nb_files - 1];
+        return;
+    }
+    b->files = md_realloc(b->files, (b->nb_files + 1) * sizeof(char *));
+    b->files[b->nb_files] = md_strdup(path);
+    thread_file = b->files[b->nb_files++];
+}
+
+int64_t trace_now() {
+#ifdef MD_USDT
+    return budget_now();
+#else
+    return trace_enabled ? budget_now() : 0;
+#endif
+}
+
+int64_t trace_begin(const char *phase) {
+#ifdef MD_USDT
+    DTRACE_PROBE2(convertmdinfo, phase_begin, phase, thread_file);
+#else
+    (void)phase;
+#endif
+    return trace_now();
+}
+
+void trace_end(const char *phase, int64_t start) {
+    trace_end_arg(phase, start, NULL, 0);
+}
+
+void trace_end_arg(const char *phase, int64_t start, const char *name,
+                   int64_t value) {
+    int64_t now = trace_now();
+    trace_span(phase, start, now - start, name, value, NULL, 0);
+}
+
+void trace_span(const char *phase, int64_t start, int64_t dur,
+                const char *name1, int64_t value1, const char *name2,
+                int64_t value2) {
+#ifdef MD_USDT
+    DTRACE_PROBE3(convertmdinfo, phase_end, phase, thread_file, dur);
+#endif
+    if (!trace_enabled)
+        return;
+    trace_buffer *b = buffer_get();
+    if (b->tail->n == TRACE_CHUNK) {
+        b->tail->next = md_calloc(1, sizeof(trace_chunk));
+        b->tail = b->tail->next;
+    }
+    b->tail->events[b->tail->n++] = (trace_event){
+        .phase = phase,
+        .file = thread_file,
+        .name = {name1, name2},
+        .ts = start - trace_start,
+        .dur = dur,
+        .value = {value1, value2},
+    };
+}
+
+/* writes s as JSON string */
+static void write_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void write_event(FILE *f, const trace_event *ev, long pid, long tid) {
+    fprintf(f,
+            "{\"name\":\"%s\",\"cat\":\"convertmdinfo\",\"ph\":\"X\","
+            "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld,\"args\":{",
+            ev->phase, ev->ts / 1e3, ev->dur / 1e3, pid, tid);
+    if (ev->file != NULL) {
+        fprintf(f, "\"file\":");
+        write_string(f, ev->file);
+    }
+    bool sep = ev->file != NULL;
+    for (int i = 0; i < 2; i++) {
+        if (ev->name[i] == NULL)
+            continue;
+        fprintf(f, "%s\"%s\":%lld", sep ? "," : "", ev->name[i],
+                (long long)ev->value[i]);
+        sep = true;
+    }
+    fprintf(f, "}}");
+}
+
+static void buffer_free(trace_buffer *b) {
+    while (b->head != NULL) {
+        trace_chunk *next = b->head->next;
+        free(b->head);
+        b->head = next;
+    }
+    for (size_t i = 0; i < b->nb_files; i++)
+        free(b->files[i]);
+    free(b->files);
+    free(b);
+}
+
+int trace_close() {
+    if (trace_stream == NULL)
+        return 0;
+    trace_enabled = false;
+    FILE *f = trace_stream;
+    long pid = getpid();
+    bool first = true;
+    fprintf(f, "{\"traceEvents\":[");
+    trace_buffer *b = atomic_exchange(&trace_buffers, NULL);
+    while (b != NULL) {
+        for (trace_chunk *c = b->head; c != NULL; c = c->next) {
+            for (size_t i = 0; i < c->n; i++) {
+                fprintf(f, first ? "\n" : ",\n");
+                write_event(f, &c->events[i], pid, b->tid);
+                first = false;
+            }
+        }
+        trace_buffer *next = b->next;
+        buffer_free(b);
+        b = next;
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    thread_buffer = NULL;
+    thread_file = NULL;
+    trace_stream = NULL;
+    if (ferror(f) | (fclose(f) == EOF)) {
+        md_error_custom("Could not write trace");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_TRACE
+#define _INCL_TRACE
+
+#include <stdint.h>
+
+/* Spans of the probe pipeline in Chrome trace-event format, viewable with
+ * chrome://tracing or Perfetto. Every thread records into its own buffer
+ * without locking, the buffers are written by trace_close.
+ *
+ * Built with MD_USDT, every span also fires the USDT probes
+ * convertmdinfo:phase_begin(phase, file) and
+ * convertmdinfo:phase_end(phase, file, duration_ns), whether or not -trace is
+ * given. */
+
+/* trace_open starts recording, the events are written to path by
+ * trace_close. Must be called before any other thread is started. Returns -1
+ * and sets an error if path cannot be created. */
+int trace_open(const char *path);
+
+/* trace_close writes the events of every thread and stops recording. Every
+ * other thread must have been joined. Returns -1 and sets an error if the
+ * trace could not be written. */
+int trace_close();
+
+/* trace_file sets the file the following spans of the calling thread belong
+ * to, path is copied */
+void trace_file(const char *path);
+
+/* trace_begin starts a span of phase, which must be a string literal, and
+ * returns the value to pass to trace_end */
+int64_t trace_begin(const char *phase);
+
+/* trace_end records the span of phase that started at start */
+void trace_end(const char *phase, int64_t start);
+
+/* trace_end_arg is trace_end with the additional argument name=value */
+void trace_end_arg(const char *phase, int64_t start, const char *name,
+                   int64_t value);
+
+/* trace_now returns the clock of the spans, 0 if no span is recorded. For
+ * phases that are too frequent for a span each, the caller sums up the
+ * durations and records them with trace_span. */
+int64_t trace_now();
+
+/* trace_span records a span of phase that started at start and took dur ns,
+ * with the arguments name1=value1 and name2=value2. Only phase_end fires. */
+void trace_span(const char *phase, int64_t start, int64_t dur,
+                const char *name1, int64_t value1, const char *name2,
+                int64_t value2);
+
+#endif
@@ -0,0 +1,213 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+/* d_type of struct dirent is not part of POSIX */
+#define _DEFAULT_SOURCE
+#include "watch.h"
+#include "bqueue.h"
+#include "errors.h"
+#include "eval.h"
+#include "probe.h"
+#include "scan.h"
+#include "trace.h"
+#include "wrappers.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SIDECAR_SUFFIX ".mdinfo"
+
+typedef struct watch_ctx {
+    const eval_container *ct;
+    FILE *ostream; /* NULL for sidecar files */
+    pthread_mutex_t out_lock;
+    bqueue *queue;
+} watch_ctx;
+
+static volatile sig_atomic_t watch_stop = 0;
+
+static void watch_signal(int sig) {
+    (void)sig;
+    watch_stop = 1;
+}
+
+/* writes result next to path, readers never see a partial sidecar */
+static int write_sidecar(const char *path, const char *result) {
+    size_t len = strlen(path);
+    char *final = md_malloc(len + sizeof(SIDECAR_SUFFIX));
+    char *tmp = md_malloc(len + sizeof(SIDECAR_SUFFIX) + 4);
+    sprintf(final, "%s%s", path, SIDECAR_SUFFIX);
+    sprintf(tmp, "%s%s.tmp", path, SIDECAR_SUFFIX);
+    int ret = -1;
+    FILE *f = fopen(tmp, "w");
+    if (f != NULL) {
+        bool ok = fputs(result, f) != EOF && fflush(f) == 0 &&
+                  fsync(fileno(f)) == 0;
+        ok = fclose(f) == 0 && ok;
+        if (ok && rename(tmp, final) == 0)
+            ret = 0;
+        else
+            unlink(tmp);
+    }
+    if (ret < 0)
+        fprintf(stderr, "%s: could not write sidecar: %s\n", path,
+                strerror(errno));
+    free(final);
+    free(tmp);
+    return ret;
+}
+
+static void watch_probe(watch_ctx *ctx, const char *path) {
+    trace_file(path);
+    int64_t span = trace_begin("file");
+    char *result = probe_to_string(ctx->ct, path, NULL);
+    int64_t write_span = trace_begin("write");
+    pthread_mutex_lock(&ctx->out_lock);
+    if (result == NULL) {
+        fprintf(stderr, "%s: error: %s\n", path,
+                global_md_error_str(global_md_error));
+        clear_global_md_error();
+    } else if (ctx->ostream != NULL)
+        scan_print_result(ctx->ostream, path, result);
+    pthread_mutex_unlock(&ctx->out_lock);
+    if (result != NULL && ctx->ostream == NULL)
+        write_sidecar(path, result);
+    trace_end("write", write_span);
+    trace_end("file", span);
+    free(result);
+}
+
+static void *watch_worker(void *arg) {
+    watch_ctx *ctx = arg;
+    char *path;
+    while ((path = bqueue_pop(ctx->queue)) != NULL) {
+        watch_probe(ctx, path);
+        free(path);
+    }
+    return NULL;
+}
+
+/* queues dir/name if it is a video file. Blocks while the queue is full, the
+ * kernel keeps buffering events in the meantime. */
+static void watch_submit(watch_ctx *ctx, int dirfd, const char *dir,
+                         const char *name) {
+    if (!scan_is_candidate(dirfd, name))
+        return;
+    char *path = scan_join_path(dir, name);
+    if (!bqueue_push(ctx->queue, path))
+        free(path);
+}
+
+/* picks up the files whose events were lost in an inotify queue overflow */
+static void watch_rescan(watch_ctx *ctx, int dirfd, const char *dir) {
+    int fd = openat(dirfd, ".", O_RDONLY | O_DIRECTORY);
+    DIR *d = fd < 0 ? NULL : fdopendir(fd);
+    if (d == NULL) {
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    struct dirent *ent;
+    while (!watch_stop && (ent = readdir(d)) != NULL) {
+        if (ctx->ostream == NULL) {
+            /* files that already have a sidecar are done */
+            char *sidecar =
+                md_malloc(strlen(ent->d_name) + sizeof(SIDECAR_SUFFIX));
+            sprintf(sidecar, "%s%s", ent->d_name, SIDECAR_SUFFIX);
+            bool done = faccessat(dirfd, sidecar, F_OK, 0) == 0;
+            free(sidecar);
+            if (done)
+                continue;
+        }
+        watch_submit(ctx, dirfd, dir, ent->d_name);
+    }
+    closedir(d);
+}
+
+int watch_dir(const char *dir, const eval_container *ct, FILE *ostream,
+              unsigned threads) {
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dirfd < 0) {
+        md_error_custom("Watch folder is not a directory");
+        return -1;
+    }
+    int ifd = inotify_init1(IN_CLOEXEC);
+    if (ifd < 0 ||
+        inotify_add_watch(ifd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        md_error_custom(strerror(errno));
+        if (ifd >= 0)
+            close(ifd);
+        close(dirfd);
+        return -1;
+    }
+    if (threads == 0)
+        threads = 1;
+
+    /* no SA_RESTART: the blocking read must return on a signal */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = &watch_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    watch_ctx ctx;
+    ctx.ct = ct;
+    ctx.ostream = ostream;
+    pthread_mutex_init(&ctx.out_lock, NULL);
+    ctx.queue = bqueue_alloc(WATCH_QUEUE_DEPTH);
+    pthread_t *workers = md_malloc(threads * sizeof(pthread_t));
+    /* the workers inherit a mask blocking SIGINT and SIGTERM, so the signals
+     * are delivered to this thread and interrupt its read */
+    sigset_t stop_signals, old_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+    unsigned started = 0;
+    while (started < threads &&
+           pthread_create(&workers[started], NULL, &watch_worker, &ctx) == 0)
+        started++;
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    /* without a worker nothing drains the queue and watch_submit blocks */
+    if (started == 0)
+        md_error_custom("Could not start watch thread");
+
+    _Alignas(struct inotify_event) char buf[4096];
+    while (started > 0 && !watch_stop) {
+        ssize_t n = read(ifd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            md_error_custom(strerror(errno));
+            break;
+        }
+        for (ssize_t pos = 0; pos < n;) {
+            const struct inotify_event *ev =
+                (const struct inotify_event *)(buf + pos);
+            if (ev->mask & IN_Q_OVERFLOW)
+                watch_rescan(&ctx, dirfd, dir);
+            else if (ev->len > 0 && !(ev->mask & IN_ISDIR))
+                watch_submit(&ctx, dirfd, dir, ev->name);
+            pos += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+
+    /* finish the files that were already queued */
+    bqueue_close(ctx.queue);
+    for (unsigned i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    bqueue_free(ctx.queue);
+    pthread_mutex_destroy(&ctx.out_lock);
+    close(ifd);
+    close(dirfd);
+    return global_md_error == ERR_NONE ? 0 : -1;
+}
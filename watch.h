@@ -0,0 +1,22 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_WATCH
+#define _INCL_WATCH
+
+#include "eval.h"
+#include <stddef.h>
+#include <stdio.h>
+
+/* maximum amount of files waiting for a worker */
+#define WATCH_QUEUE_DEPTH 64
+
+/* watch_dir waits for files to be completely written to or moved into dir and
+ * probes them with the ffmpeg options in ct on threads worker threads. If
+ * ostream is NULL the result of each file is written atomically to a sidecar
+ * file named after the input with the suffix ".mdinfo", otherwise the results
+ * are written as lines prefixed by the file path to ostream. Runs until
+ * SIGINT or SIGTERM is received. Returns -1 and sets an error if dir cannot be
+ * watched. */
+int watch_dir(const char *dir, const eval_container *ct, FILE *ostream,
+              unsigned threads);
+
+#endif
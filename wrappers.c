@@ -5,6 +5,17 @@
 
 #define ERROR_OOM "FATAL: Memory allocation error.\n"
 
+#ifdef MD_ALLOC_HOOK
+void (*md_alloc_hook)(size_t size) = NULL;
+#define ALLOC_HOOK(size)                                                       \
+    do {                                                                       \
+        if (md_alloc_hook)                                                     \
+            md_alloc_hook(size);                                               \
+    } while (0)
+#else
+#define ALLOC_HOOK(size)
+#endif
+
 /* memfail prints an error message that no memory could be allocated and exits.
  */
 static void memfail() {
@@ -14,6 +25,7 @@ static void memfail() {
 
 /* wrapper for malloc that exits the program on error. */
 void *md_malloc(size_t size) {
+    ALLOC_HOOK(size);
     void *ptr = malloc(size);
     if (ptr == NULL)
         memfail();
@@ -21,6 +33,7 @@ void *md_malloc(size_t size) {
 }
 
 void *md_calloc(size_t nmemb, size_t size) {
+    ALLOC_HOOK(nmemb * size);
     void *ptr = calloc(nmemb, size);
     if (ptr == NULL)
         memfail();
@@ -29,6 +42,7 @@ void *md_calloc(size_t nmemb, size_t size) {
 
 /* wrapper for realloc that exits the program on error. */
 void *md_realloc(void *ptr, size_t size) {
+    ALLOC_HOOK(size);
     void *ret_ptr = realloc(ptr, size);
     if (ret_ptr == NULL)
         memfail();
@@ -4,6 +4,12 @@
 
 #include <stdlib.h>
 
+#ifdef MD_ALLOC_HOOK
+/* called with the size of every allocation, only compiled into the
+ * benchmarks */
+extern void (*md_alloc_hook)(size_t size);
+#endif
+
 void *md_malloc(size_t size);
 void *md_calloc(size_t nmemb, size_t size);
 void *md_realloc(void *ptr, size_t size);
@@ -0,0 +1,351 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#include "xml.h"
+#include "errors.h"
+#include "wrappers.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* nesting deeper than this is rejected */
+#define XML_MAX_DEPTH 64
+
+typedef struct xml_reader {
+    const char *buf;
+    size_t size;
+    size_t pos;
+} xml_reader;
+
+static bool at(const xml_reader *r, const char *s) {
+    size_t len = strlen(s);
+    return r->pos + len <= r->size && !memcmp(r->buf + r->pos, s, len);
+}
+
+static void skip_space(xml_reader *r) {
+    while (r->pos < r->size && isspace((unsigned char)r->buf[r->pos]))
+        r->pos++;
+}
+
+/* advances behind the next occurence of end, returns false if there is
+ * none */
+static bool skip_past(xml_reader *r, const char *end) {
+    while (r->pos < r->size) {
+        if (at(r, end)) {
+            r->pos += strlen(end);
+            return true;
+        }
+        r->pos++;
+    }
+    return false;
+}
+
+static bool is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == ':' || c == '-' ||
+           c == '.' || (unsigned char)c >= 0x80;
+}
+
+/* reads a name, returns NULL if there is none */
+static char *read_name(xml_reader *r) {
+    size_t start = r->pos;
+    while (r->pos < r->size && is_name_char(r->buf[r->pos]))
+        r->pos++;
+    if (r->pos == start)
+        return NULL;
+    size_t len = r->pos - start;
+    char *name = md_malloc(len + 1);
+    memcpy(name, r->buf + start, len);
+    name[len] = '\0';
+    return name;
+}
+
+/* appends the UTF-8 encoding of cp to out */
+static size_t put_utf8(char *out, unsigned long cp) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xc0 | cp >> 6);
+        out[1] = (char)(0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xe0 | cp >> 12);
+        out[1] = (char)(0x80 | (cp >> 6 & 0x3f));
+        out[2] = (char)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | cp >> 18);
+    out[1] = (char)(0x80 | (cp >> 12 & 0x3f));
+    out[2] = (char)(0x80 | (cp >> 6 & 0x3f));
+    out[3] = (char)(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+/* copies len bytes of s with the entities expanded, the result is never
+ * longer than the input */
+static char *unescape(const char *s, size_t len) {
+    static const char *const names[] = {"amp;", "lt;", "gt;", "quot;",
+                                        "apos;"};
+    static const char chars[] = {'&', '<', '>', '"', '\''};
+    char *out = md_malloc(len + 1);
+    size_t n = 0;
+    for (size_t i = 0; i < len;) {
+        if (s[i] != '&') {
+            out[n++] = s[i++];
+            continue;
+        }
+        size_t rest = len - i - 1;
+        bool known = false;
+        for (size_t k = 0; k < sizeof(chars); k++) {
+            size_t nlen = strlen(names[k]);
+            if (rest >= nlen && !memcmp(s + i + 1, names[k], nlen)) {
+                out[n++] = chars[k];
+                i += nlen + 1;
+                known = true;
+                break;
+            }
+        }
+        if (!known && rest >= 3 && s[i + 1] == '#') {
+            bool hex = s[i + 2] == 'x';
+            size_t j = i + (hex ? 3 : 2);
+            unsigned long cp = 0;
+            size_t digits = 0;
+            while (j < len && digits < 8 &&
+                   (hex ? isxdigit((unsigned char)s[j])
+                        : isdigit((unsigned char)s[j]))) {
+                char c = (char)tolower((unsigned char)s[j]);
+                cp = cp * (hex ? 16 : 10) +
+                     (unsigned long)(isdigit((unsigned char)c) ? c - '0'
+                                                               : c - 'a' + 10);
+                j++;
+                digits++;
+            }
+            char enc[4];
+            size_t elen = put_utf8(enc, cp);
+            /* the reference must not be shorter than its encoding */
+            if (digits > 0 && j < len && s[j] == ';' && cp > 0 &&
+                cp <= 0x10ffff && elen <= j + 1 - i) {
+                memcpy(out + n, enc, elen);
+                n += elen;
+                i = j + 1;
+                known = true;
+            }
+        }
+        if (!known)
+            out[n++] = s[i++];
+    }
+    out[n] = '\0';
+    return out;
+}
+
+static void add_attr(xml_node *node, char *name, char *value) {
+    node->attrs =
+        md_realloc(node->attrs, (node->nb_attrs + 1) * 2 * sizeof(char *));
+    node->attrs[node->nb_attrs * 2] = name;
+    node->attrs[node->nb_attrs * 2 + 1] = value;
+    node->nb_attrs++;
+}
+
+/* appends len bytes of character data to node, entities are expanded unless
+ * the data is raw */
+static void add_text(xml_node *node, const char *s, size_t len, bool raw) {
+    char *text;
+    if (raw) {
+        text = md_malloc(len + 1);
+        memcpy(text, s, len);
+        text[len] = '\0';
+    } else
+        text = unescape(s, len);
+    if (node->text == NULL) {
+        node->text = text;
+        return;
+    }
+    size_t old = strlen(node->text);
+    node->text = md_realloc(node->text, old + strlen(text) + 1);
+    strcpy(node->text + old, text);
+    free(text);
+}
+
+static xml_node *node_alloc(char *name, xml_node *parent) {
+    xml_node *node = md_calloc(1, sizeof(xml_node));
+    /* drop the namespace prefix */
+    char *colon = strchr(name, ':');
+    if (colon != NULL)
+        memmove(name, colon + 1, strlen(colon + 1) + 1);
+    node->name = name;
+    node->parent = parent;
+    if (parent != NULL) {
+        if (parent->last_child != NULL)
+            parent->last_child->next = node;
+        else
+            parent->children = node;
+        parent->last_child = node;
+    }
+    return node;
+}
+
+/* reads the attributes of a start tag, returns -1 if they are malformed */
+static int read_attrs(xml_reader *r, xml_node *node) {
+    while (true) {
+        skip_space(r);
+        if (r->pos >= r->size)
+            return -1;
+        char c = r->buf[r->pos];
+        if (c == '>' || c == '/')
+            return 0;
+        char *name = read_name(r);
+        if (name == NULL)
+            return -1;
+        skip_space(r);
+        if (r->pos >= r->size || r->buf[r->pos] != '=') {
+            free(name);
+            return -1;
+        }
+        r->pos++;
+        skip_space(r);
+        char quote = r->pos < r->size ? r->buf[r->pos] : '\0';
+        if (quote != '"' && quote != '\'') {
+            free(name);
+            return -1;
+        }
+        size_t start = ++r->pos;
+        while (r->pos < r->size && r->buf[r->pos] != quote)
+            r->pos++;
+        if (r->pos >= r->size) {
+            free(name);
+            return -1;
+        }
+        add_attr(node, name, unescape(r->buf + start, r->pos - start));
+        r->pos++;
+    }
+}
+
+static xml_node *parse_error(xml_node *root, const char *msg) {
+    if (root != NULL)
+        xml_free(root);
+    md_error_custom(msg);
+    return NULL;
+}
+
+xml_node *xml_parse(const char *buf, size_t size) {
+    xml_reader r = {.buf = buf, .size = size, .pos = 0};
+    xml_node *root = NULL;
+    xml_node *cur = NULL; /* element whose content is read */
+    int depth = 0;
+    while (r.pos < r.size) {
+        if (r.buf[r.pos] != '<') {
+            size_t start = r.pos;
+            while (r.pos < r.size && r.buf[r.pos] != '<')
+                r.pos++;
+            if (cur != NULL)
+                add_text(cur, r.buf + start, r.pos - start, false);
+            continue;
+        }
+        if (at(&r, "<?")) {
+            if (!skip_past(&r, "?>"))
+                return parse_error(root, "Unterminated XML declaration");
+        } else if (at(&r, "<!--")) {
+            if (!skip_past(&r, "-->"))
+                return parse_error(root, "Unterminated XML comment");
+        } else if (at(&r, "<![CDATA[")) {
+            r.pos += 9;
+            size_t start = r.pos;
+            if (!skip_past(&r, "]]>"))
+                return parse_error(root, "Unterminated XML CDATA section");
+            if (cur != NULL)
+                add_text(cur, r.buf + start, r.pos - 3 - start, true);
+        } else if (at(&r, "<!")) {
+            /* DOCTYPE, the internal subset is skipped with it */
+            int nesting = 0;
+            for (; r.pos < r.size; r.pos++) {
+                if (r.buf[r.pos] == '<')
+                    nesting++;
+                else if (r.buf[r.pos] == '>' && --nesting == 0)
+                    break;
+            }
+            r.pos++;
+        } else if (at(&r, "</")) {
+            r.pos += 2;
+            char *name = read_name(&r);
+            if (name == NULL || cur == NULL)
+                return parse_error(root, "Unexpected XML end tag");
+            char *colon = strchr(name, ':');
+            bool match = !strcmp(colon ? colon + 1 : name, cur->name);
+            free(name);
+            skip_space(&r);
+            if (!match || r.pos >= r.size || r.buf[r.pos] != '>')
+                return parse_error(root, "Mismatched XML end tag");
+            r.pos++;
+            cur = cur->parent;
+            depth--;
+        } else {
+            r.pos++;
+            char *name = read_name(&r);
+            if (name == NULL)
+                return parse_error(root, "Malformed XML start tag");
+            if (cur == NULL && root != NULL) {
+                free(name);
+                return parse_error(root, "XML document with several roots");
+            }
+            xml_node *node = node_alloc(name, cur);
+            if (root == NULL)
+                root = node;
+            if (read_attrs(&r, node) < 0)
+                return parse_error(root, "Malformed XML attribute");
+            if (r.buf[r.pos] == '/') {
+                /* empty element */
+                r.pos++;
+                if (r.pos >= r.size || r.buf[r.pos] != '>')
+                    return parse_error(root, "Malformed XML start tag");
+            } else {
+                if (++depth > XML_MAX_DEPTH)
+                    return parse_error(root, "XML document nested too deep");
+                cur = node;
+            }
+            r.pos++;
+        }
+    }
+    if (root == NULL || cur != NULL)
+        return parse_error(root, "Incomplete XML document");
+    return root;
+}
+
+void xml_free(xml_node *root) {
+    xml_node *child = root->children;
+    while (child != NULL) {
+        xml_node *next = child->next;
+        xml_free(child);
+        child = next;
+    }
+    for (size_t i = 0; i < root->nb_attrs * 2; i++)
+        free(root->attrs[i]);
+    free(root->attrs);
+    free(root->text);
+    free(root->name);
+    free(root);
+}
+
+const char *xml_attr(const xml_node *node, const char *name) {
+    for (size_t i = 0; i < node->nb_attrs; i++) {
+        if (!strcmp(node->attrs[i * 2], name))
+            return node->attrs[i * 2 + 1];
+    }
+    return NULL;
+}
+
+xml_node *xml_child(const xml_node *node, const char *name) {
+    for (xml_node *c = node->children; c != NULL; c = c->next) {
+        if (!strcmp(c->name, name))
+            return c;
+    }
+    return NULL;
+}
+
+xml_node *xml_next(const xml_node *node, const char *name) {
+    for (xml_node *c = node->next; c != NULL; c = c->next) {
+        if (!strcmp(c->name, name))
+            return c;
+    }
+    return NULL;
+}
@@ -0,0 +1,37 @@
+/* This file is part of convertmdinfo, (c) 2021 Joerg Walter */
+#ifndef _INCL_XML
+#define _INCL_XML
+
+#include <stddef.h>
+
+/* Minimal XML reader for manifests: elements, attributes and character data.
+ * Namespace prefixes of element names are dropped, DTDs are skipped and
+ * only the predefined and numeric entities are expanded. */
+typedef struct xml_node {
+    char *name;
+    char **attrs; /* name, value pairs */
+    size_t nb_attrs;
+    char *text; /* character data directly inside the element, NULL if none */
+    struct xml_node *parent;
+    struct xml_node *children;   /* first child element */
+    struct xml_node *last_child; /* for appending */
+    struct xml_node *next;       /* next sibling element */
+} xml_node;
+
+/* xml_parse returns the root element of the document in buf. Returns NULL
+ * and sets an error if the document is malformed. */
+xml_node *xml_parse(const char *buf, size_t size);
+
+/* destructor for the tree below root */
+void xml_free(xml_node *root);
+
+/* xml_attr returns the value of the attribute name of node or NULL */
+const char *xml_attr(const xml_node *node, const char *name);
+
+/* xml_child returns the first child element of node called name or NULL */
+xml_node *xml_child(const xml_node *node, const char *name);
+
+/* xml_next returns the next sibling of node called name or NULL */
+xml_node *xml_next(const xml_node *node, const char *name);
+
+#endif